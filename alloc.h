@@ -2,139 +2,892 @@
  * @Author: suzy HideSue@github.com
  * @Date: 2023-11-23 12:49:24
  * @LastEditors: suzy HideSue@github.com
- * @LastEditTime: 2023-11-25 19:55:01
+ * @LastEditTime: 2026-10-19 18:05:12
  * @FilePath: /tinystl/alloc.h
  * @Description: alloc头文件，用于分配和回收内存，实现了一个内存池
- * 
- * Copyright (c) 2023 by ${suzy HideSue@github.com}, All Rights Reserved. 
+ *               每个线程有自己的freelist缓存，缓存与中心池之间批量搬运区块，快速路径不加锁
+ *               中心池按NUMA节点分成几个arena，线程从自己节点的arena拿区块，区块还给它所在chunk的arena，见numa.h
+ *               小型区块按size_class.h里的表分级，中型区块交给page_heap按页分配，更大的直接malloc
+ *               内存池按固定大小、按自身大小对齐的chunk向page_source申请，chunk里的区块全部空闲时可以trim还回去
+ *               page_source要求按class分chunk时（mmap_page_source的PER_CLASS），每个class从自己的chunk里切，区块地址按class连成片
+ *               每个class记着从中心池拿出去的区块数的高水位、页级区块记着在用页数的高水位，存成pool_profile，下次启动时warm_up按它一次预留、预先切好，见pool_profile.h
+ *               定义TINYSTL_ALLOC_STATS时记录统计信息，见alloc_stats.h
+ *               定义TINYSTL_ALLOC_HARDENED时是硬化模式：区块前后加canary、记录size class、释放后先进隔离区，freelist链接编码存放
+ *               尺寸传错、重复释放、越界写、释放后写都会当场报错abort，而不是以后在别处崩
+ *               定义TINYSTL_ALLOC_PROFILE时对allocate按字节采样，记下调用栈，见alloc_profile.h
+ *
+ * Copyright (c) 2023 by ${suzy HideSue@github.com}, All Rights Reserved.
  */
 #ifndef ALLOC_H
 #define ALLOC_H
 
 #include<cstddef>
+#include<cstdint>
+#include<cstdio>
 #include<cstdlib>
-#include<iostream>
+#include<cstring>
+#include<mutex>
+#include<new>
+#include "size_class.h"
+#include "alloc_stats.h"
+#include "alloc_profile.h"
+#include "page_source.h"
+#include "page_heap.h"
+#include "numa.h"
+#include "pool_profile.h"
+
+#ifndef TINYSTL_ALLOC_CHUNK_BYTES
+#define TINYSTL_ALLOC_CHUNK_BYTES (256 * 1024)  // 内存池每次向系统申请的chunk大小，必须是2的幂
+#endif
+#ifndef TINYSTL_ALLOC_QUARANTINE
+#define TINYSTL_ALLOC_QUARANTINE 256            // 硬化模式下每个线程隔离区最多放多少个释放的区块
+#endif
+#ifndef TINYSTL_ALLOC_QUARANTINE_BYTES
+#define TINYSTL_ALLOC_QUARANTINE_BYTES (1024 * 1024) // 隔离区里区块的总字节数上限
+#endif
+#ifndef TINYSTL_ALLOC_POISON_BYTES
+#define TINYSTL_ALLOC_POISON_BYTES 256          // 释放时每个区块开头填多少字节的毒值，出隔离区时检查有没有被改
+#endif
 
 namespace tinystl
 {
     union obj {
         union obj *free_list_link;  // 指针，指向一个obj
-        char client_data[1];        // char数组，只有一个元素 
+        char client_data[1];        // char数组，只有一个元素
     };
 
-    enum {ALIGN = 8};                       // 小型区块的上调边界
-    enum {MAX_BYTES = 128};                 // 小型区块的上限
-    enum {NFREELISTS = MAX_BYTES / ALIGN};  // freelist个数
-    
+    enum {CHUNK_BYTES = TINYSTL_ALLOC_CHUNK_BYTES};
+    enum {CHUNK_HEADER_BYTES = CACHE_LINE}; // chunk头占一条cache line，后面的区块从这里开始切
+
+    static_assert((CHUNK_BYTES & (CHUNK_BYTES - 1)) == 0, "CHUNK_BYTES必须是2的幂");
+    static_assert((size_t) MAX_BYTES <= (size_t) CHUNK_BYTES - CHUNK_HEADER_BYTES, "一个chunk至少要能切出一个最大的区块");
+
+#ifdef TINYSTL_ALLOC_HARDENED
+    enum {ALLOC_HARDENED = 1};
+#else
+    enum {ALLOC_HARDENED = 0};
+#endif
+    enum {HARDEN_HEADER_BYTES = 16};        // 区块头：申请的字节数、size class、canary
+    enum {HARDEN_TRAILER_BYTES = 8};        // 紧跟在用户数据后面的canary
+    enum {QUARANTINE_BLOCKS = TINYSTL_ALLOC_QUARANTINE};
+    enum {QUARANTINE_BYTES = TINYSTL_ALLOC_QUARANTINE_BYTES};
+    enum {POISON_BYTES = TINYSTL_ALLOC_POISON_BYTES};
+    enum {POISON_VALUE = 0xdb};
+
     class alloc {
         private:
-            static obj *free_list[NFREELISTS];  // NFREELISTS条freelist
-            static char *start_free;            // 内存池起始位置
-            static char *end_free;              // 内存池结束位置
-            static size_t heap_size;            // 已申请的内存大小
+#ifdef TINYSTL_ALLOC_HARDENED
+            /**
+             * @description: 硬化模式下隔离区里的一个区块，按用户指针记录，释放时还要用申请时的对齐找回区块起点
+             */
+            struct quarantine_entry {
+                char *user;
+                size_t size;
+                size_t alignment;
+            };
+            /**
+             * @description: 硬化模式下紧挨着用户指针前面的区块头
+             */
+            struct block_header {
+                uint64_t requested : 48;        // 用户申请的字节数，尾部canary就在user + requested
+                uint64_t size_class : 16;       // class_key，释放时传的大小算出来不一样就是传错了
+                uint64_t canary;                // 在用时是secret ^ 头的地址，释放后取反，重复释放一眼就能看出来
+            };
+#endif
+            /**
+             * @description: 线程缓存，每个线程一份，快速路径只访问它，不加锁
+             */
+            struct thread_cache {
+                obj *free_list[NFREELISTS];     // 本线程的freelist
+                size_t length[NFREELISTS];      // 每条freelist上的区块数
+                bool dead;                      // 线程退出时已析构，之后的请求直接走中心池
+#ifdef TINYSTL_ALLOC_HARDENED
+                quarantine_entry quarantine[QUARANTINE_BLOCKS]; // 环形队列，满了或字节数超了从最老的开始真正释放
+                size_t quarantine_head;
+                size_t quarantine_count;
+                size_t quarantine_bytes;
+#endif
+#ifdef TINYSTL_ALLOC_STATS
+                stat_counter allocs[NFREELISTS];
+                stat_counter frees[NFREELISTS];
+                thread_cache *prev_cache;       // 所有线程缓存串成链表，取快照时汇总
+                thread_cache *next_cache;
+                bool registered;
+#endif
+
+                constexpr thread_cache () : free_list(), length(), dead(false)
+#ifdef TINYSTL_ALLOC_HARDENED
+                    , quarantine(), quarantine_head(0), quarantine_count(0), quarantine_bytes(0)
+#endif
+#ifdef TINYSTL_ALLOC_STATS
+                    , allocs(), frees(), prev_cache(nullptr), next_cache(nullptr), registered(false)
+#endif
+                {}
+                ~thread_cache ();               // 线程退出时把所有区块还给中心池
+            };
+            /**
+             * @description: chunk头，放在每个chunk的起始位置，区块地址按CHUNK_BYTES取整就能找到它
+             */
+            struct chunk_header {
+                chunk_header *prev;
+                chunk_header *next;
+                size_t live;                    // 不在中心池里的区块数（用户手里的和线程缓存里的），为0说明整个chunk都空闲
+                page_source *source;            // chunk从哪来，还回哪去
+                uint32_t home;                  // 属于第几个arena，区块回收时还到这里
+                int32_t node;                   // 申请这个chunk的线程所在的节点，按节点分池时页也绑在这个节点上
+            };
+#ifdef TINYSTL_ALLOC_STATS
+            /**
+             * @description: 线程缓存和已退出线程的计数，由stats_lock保护，large_allocs/large_frees是原子的
+             */
+            struct central_stats {
+                thread_cache *caches;                   // 还活着的线程缓存
+                uint64_t retired_allocs[NFREELISTS];    // 已退出线程的计数
+                uint64_t retired_frees[NFREELISTS];
+                std::atomic<uint64_t> large_allocs;
+                std::atomic<uint64_t> large_frees;
+            };
+            /**
+             * @description: 每个arena自己的计数，由arena的锁保护，取快照时把各arena的加起来
+             */
+            struct arena_stats {
+                uint64_t fetched[NFREELISTS];           // 从中心池搬到线程缓存（或直接给用户）的区块数
+                uint64_t returned[NFREELISTS];          // 从线程缓存还回中心池的区块数
+                uint64_t refills[NFREELISTS];
+                uint64_t chunks_acquired;
+                uint64_t chunks_released;
+                uint64_t steal_fallbacks;
+                uint64_t oom_failures;
+            };
+#endif
+            /**
+             * @description: 每个class的自适应refill批量，像TCP慢启动：接连refill就翻倍，闲了一阵再refill就减半
+             *               min/max为0时用默认值，由所在arena的锁保护
+             */
+            struct refill_state {
+                size_t batch;                   // 上一次refill切的区块数，0表示还没refill过
+                size_t min;                     // set_refill_limits设置的下限
+                size_t max;                     // set_refill_limits设置的上限
+                uint64_t last;                  // 上一次refill时的refill_tick
+            };
+            /**
+             * @description: warm_up切好、还没串成freelist的一段连续区块，排队的段把段头放在段里第一个区块的位置
+             *               正在取的那一段记在arena里，中心池按地址往后取，不用顺着链表去读一个个早就不在cache里的区块
+             */
+            struct warm_run {
+                warm_run *next;                 // 同一个class的下一段
+                char *end;                      // 段尾，段里的区块都在同一个chunk上
+            };
+            enum {REFILL_HOT_TICKS = NFREELISTS};       // 两次refill之间别的class的refill不超过这么多次，算热，翻倍
+            enum {REFILL_IDLE_TICKS = 4 * NFREELISTS};  // 每隔这么多次别的refill，算闲了一轮，减半
+            /**
+             * @description: 中心池，每个NUMA节点一个，所有字段由lock保护
+             *               arena的freelist上只挂自己的chunk切出来的区块，trim时才能放心地把全空闲的chunk还回去
+             *               按cache line对齐，不同节点的线程不会为了同一条cache line来回抢
+             */
+            struct alignas(CACHE_LINE) arena {
+                obj *free_list[NFREELISTS];     // NFREELISTS条freelist
+                char *start_free;               // 内存池起始位置
+                char *end_free;                 // 内存池结束位置
+                size_t heap_size;               // 已申请的内存大小
+                size_t free_bytes;              // freelist上空闲区块的总字节数
+                chunk_header *chunks;           // 所有chunk串成的链表
+                chunk_header *current_chunk;    // 正在切的chunk
+                char *class_start[NFREELISTS];  // 按class分chunk时每个class自己的内存池，和start_free/end_free/current_chunk一个意思
+                char *class_end[NFREELISTS];
+                chunk_header *class_chunk[NFREELISTS];
+                size_t trim_mark;               // 上次trim后剩下的空闲字节
+                refill_state refill_ctl[NFREELISTS];
+                uint64_t refill_tick;           // 这个arena所有class的refill次数，当作时钟用
+                size_t outstanding[NFREELISTS]; // 从这个arena拿出去还没还回来的区块数（用户手里的和线程缓存里的）
+                size_t high_water[NFREELISTS];  // outstanding到过的最大值，warm_up的目标深度
+                reserved_page_source *reserve;  // warm_up预留的一段，new_chunk先从这里拿，用完或trim时close
+                char *warm_start[NFREELISTS];   // warm_up切好的、正在取的一段，freelist空了先从这里取，为nullptr时没有
+                char *warm_end[NFREELISTS];
+                warm_run *warm_runs[NFREELISTS];// 排在后面的段，区块都算在free_bytes里
+                std::mutex lock;
+#ifdef TINYSTL_ALLOC_STATS
+                arena_stats st;
+#endif
+
+                constexpr arena () : free_list(), start_free(nullptr), end_free(nullptr), heap_size(0), free_bytes(0),
+                    chunks(nullptr), current_chunk(nullptr), class_start(), class_end(), class_chunk(),
+                    trim_mark(0), refill_ctl(), refill_tick(0),
+                    outstanding(), high_water(), reserve(nullptr), warm_start(), warm_end(), warm_runs(), lock()
+#ifdef TINYSTL_ALLOC_STATS
+                    , st()
+#endif
+                {}
+            };
+        private:
+            static arena arenas[MAX_NUMA_NODES];
+            static std::atomic<bool> node_arenas;       // 是否按节点分池，关掉时所有线程都用arenas[0]
+            static std::atomic<bool> multi_arena;       // arenas[0]以外的arena申请过chunk，之后释放时才要看区块属于哪个arena
+            static std::atomic<size_t> trim_threshold;  // arena空闲字节比上次trim后多出这么多时自动trim，0表示不自动trim
+            static thread_local thread_cache tcache;
+#ifdef TINYSTL_ALLOC_STATS
+            static std::mutex stats_lock;               // 保护cstats
+            static central_stats cstats;
+#endif
         private:
             /**
-             * @description: 将bytes上调至8的倍数
+             * @description: 将bytes上调至所属size class的大小
              * @param {size_t} bytes
              * @return {*}
-             */            
-            static size_t round_up (size_t bytes); 
+             */
+            static constexpr size_t round_up (size_t bytes);
             /**
-             * @description: 根据区块大小，决定使用第几条freelist
+             * @description: 根据区块大小，决定使用第几条freelist，查表即可
              * @param {size_t} bytes
              * @return {*}
-             */            
-            static size_t freelist_index (size_t bytes);
+             */
+            static constexpr size_t freelist_index (size_t bytes);
+            /**
+             * @description: 区块所在的chunk
+             * @param {void} *p
+             * @return {*}
+             */
+            static chunk_header *chunk_of (void *p);
+            /**
+             * @description: 当前线程该用的arena，按节点分池时看线程在哪个节点，否则都是arenas[0]
+             * @return {*}
+             */
+            static arena &local_arena ();
+            /**
+             * @description: freelist上p的下一个区块，硬化模式下链接是编码存的，解出来没对齐说明被改坏了
+             * @param {obj} *p
+             * @return {*}
+             */
+            static obj *next_of (obj *p);
+            static void set_next (obj *p, obj *next);
             /**
-             * @description: 返回一个大小为n的对象
+             * @description: 返回一个大小为n的对象，其余区块挂到arena的freelist上，调用者需持有a.lock
+             * @param {arena} &a
              * @param {size_t} n
              * @return {*}
-             */            
-            static void* refill (size_t n);
+             */
+            static void* refill (arena &a, size_t n);
+            /**
+             * @description: 算出第index个class这次refill要切多少个区块，并更新它的状态，调用者需持有a.lock
+             * @param {arena} &a
+             * @param {size_t} index
+             * @return {*}
+             */
+            static size_t next_refill_batch (arena &a, size_t index);
+            /**
+             * @description: 第index个class有count个区块离开了arena，顺便更新高水位，调用者需持有a.lock
+             * @param {arena} &a
+             * @param {size_t} index
+             * @param {size_t} count
+             * @return {*}
+             */
+            static void note_fetched (arena &a, size_t index, size_t count);
+            /**
+             * @description: 从第index个class正在取的warm_run里按地址取最多nobjs个连续区块，nobjs改成实际取到的个数，调用者需持有a.lock
+             * @param {arena} &a
+             * @param {size_t} index
+             * @param {size_t} &nobjs
+             * @return {*}
+             */
+            static char *take_warm (arena &a, size_t index, size_t &nobjs);
             /**
-             * @description: 取空间以容纳 nobjs * size 大小的区块，如果条件不允许，nobjs可能会有所调整 
+             * @description: 把[start, end)挂成第index个class的一段warm_run，没有正在取的段时直接接上，调用者需持有a.lock
+             * @param {arena} &a
+             * @param {size_t} index
+             * @param {char} *start
+             * @param {char} *end
+             * @return {*}
+             */
+            static void add_warm (arena &a, size_t index, char *start, char *end);
+            /**
+             * @description: 正在取的一段取完或者不要了，换排在后面的下一段，调用者需持有a.lock
+             * @param {arena} &a
+             * @param {size_t} index
+             * @return {*}
+             */
+            static void next_warm (arena &a, size_t index);
+            /**
+             * @description: 把第index个class剩下的warm_run全部串到freelist上，借区块的慢路径要在freelist上找，调用者需持有a.lock
+             * @param {arena} &a
+             * @param {size_t} index
+             * @return {*}
+             */
+            static void spill_warm (arena &a, size_t index);
+            /**
+             * @description: 为了拿到按alignment对齐的区块，实际要按多大去申请：小区块换成自然对齐够的class，
+             *               超过CACHE_LINE的对齐交给页级区块（按页对齐），按整页算，小请求也只占一页
+             * @param {size_t} n
+             * @param {size_t} alignment
+             * @return {*}
+             */
+            static size_t aligned_size (size_t n, size_t alignment);
+            /**
+             * @description: 取空间以容纳 nobjs * size 大小的区块，如果条件不允许，nobjs可能会有所调整，调用者需持有a.lock
+             * @param {arena} &a
              * @param {size_t} size
              * @param {int} &nobjs
              * @return {*}
-             */            
-            static char *chunk_alloc (size_t size, size_t &nobjs);
+             */
+            static char *chunk_alloc (arena &a, size_t size, size_t &nobjs);
+            /**
+             * @description: 把内存池里切不成整块的零头拆成几个小区块挂到arena，每块都放进对齐要求满足的最大class，调用者需持有a.lock
+             * @param {arena} &a
+             * @param {char} *p
+             * @param {size_t} bytes ALIGN的倍数
+             * @return {*}
+             */
+            static void split_leftover (arena &a, char *p, size_t bytes);
+            /**
+             * @description: 向系统要一个新chunk，按节点分池时把它绑到当前节点上，失败返回nullptr，调用者需持有a.lock
+             * @param {arena} &a
+             * @param {int} size_class 按class分chunk时是这个chunk专给的class，-1表示共用
+             * @return {*}
+             */
+            static chunk_header *new_chunk (arena &a, int size_class);
+            /**
+             * @description: 把一个全部空闲的chunk还给它的page_source，调用者需持有a.lock
+             * @param {arena} &a
+             * @param {chunk_header} *chunk
+             * @return {*}
+             */
+            static void release_chunk (arena &a, chunk_header *chunk);
+            /**
+             * @description: 线程缓存为空时调用，加锁从中心池搬运一批区块到线程缓存，返回其中一个
+             * @param {thread_cache} &tc
+             * @param {size_t} n 已上调至size class的大小
+             * @return {*}
+             */
+            static void *fetch_from_central (thread_cache &tc, size_t n);
+            /**
+             * @description: 把线程缓存第index条freelist的前count个区块还给中心池
+             * @param {thread_cache} &tc
+             * @param {size_t} index
+             * @param {size_t} count
+             * @return {*}
+             */
+            static void release_to_central (thread_cache &tc, size_t index, size_t count);
+            /**
+             * @description: 把第index个class从first开始的count个区块还给中心池，每个区块回到它所在chunk的arena
+             *               先在锁外按arena分好，每个arena只加一次锁
+             * @param {size_t} index
+             * @param {obj} *first
+             * @param {size_t} count
+             * @return {*} 第count个区块原来的下一个
+             */
+            static obj *release_chain (size_t index, obj *first, size_t count);
+            /**
+             * @description: 把从first开始的count个同属于a的区块挂到a的第index条freelist上，在锁里一趟走完链表
+             * @param {arena} &a
+             * @param {size_t} index
+             * @param {obj} *first
+             * @param {size_t} count
+             * @return {*} 第count个区块原来的下一个
+             */
+            static obj *release_run (arena &a, size_t index, obj *first, size_t count);
+            /**
+             * @description: 把ptrs里count个第index个class的区块还给中心池，同一个arena的一边串链一边减live，只走一趟
+             * @param {size_t} index
+             * @param {void} **ptrs
+             * @param {size_t} count
+             * @return {*}
+             */
+            static void release_array (size_t index, void **ptrs, size_t count);
+            /**
+             * @description: count个区块挂回a的第index条freelist以后更新计数，空闲太多时trim，调用者需持有a.lock
+             * @param {arena} &a
+             * @param {size_t} index
+             * @param {size_t} count
+             * @return {*}
+             */
+            static void note_returned_locked (arena &a, size_t index, size_t count);
+            /**
+             * @description: 区块分属几个arena时，先按arena拆成几条链再分别还回去
+             * @param {size_t} index
+             * @param {obj} *first
+             * @param {size_t} count
+             * @return {*}
+             */
+            static void release_scattered (size_t index, obj *first, size_t count);
+            /**
+             * @description: 从arena拿count个区块写到out里，arena不够时从内存池切，调用者需持有a.lock
+             * @param {arena} &a
+             * @param {size_t} n 已上调至size class的大小
+             * @param {void} **out
+             * @param {size_t} count
+             * @return {*} 拿到的区块数，内存池要不到chunk时比count少，不抛异常
+             */
+            static size_t fetch_batch_locked (arena &a, size_t n, void **out, size_t count);
+            /**
+             * @description: 摘掉arena里属于全空闲chunk的区块，把这些chunk还给系统，调用者需持有a.lock
+             * @param {arena} &a
+             * @return {*} 还给系统的字节数
+             */
+            static size_t trim_locked (arena &a);
+            /**
+             * @description: 不带硬化检查的allocate、deallocate、allocate_aligned、deallocate_aligned，三个层级的分配都在这里
+             */
+            static void *raw_allocate (size_t n);
+            static void raw_deallocate (void *p, size_t n);
+            static void *raw_allocate_aligned (size_t n, size_t alignment);
+            static void raw_deallocate_aligned (void *p, size_t n, size_t alignment);
+            /**
+             * @description: reallocate不用挪地方的情况：同一个size class、同样页数、页级区块缩小或者后面有空闲页可以原地变大
+             * @param {void} *p
+             * @param {size_t} old_sz
+             * @param {size_t} new_sz
+             * @return {*} 区块已经是new_sz大小时返回true，否则区块不变
+             */
+            static bool resize_in_place (void *p, size_t old_sz, size_t new_sz);
+#ifdef TINYSTL_ALLOC_HARDENED
+            /**
+             * @description: 每次运行都不一样的密钥，取自ASLR之后的静态变量地址，不需要初始化，静态初始化期间的分配也能用
+             * @return {*}
+             */
+            static uint64_t secret ();
+            /**
+             * @description: 底层区块大小对应的class：小区块是freelist下标，页级区块按页数，malloc的大块都算一类
+             * @param {size_t} bytes
+             * @return {*}
+             */
+            static size_t class_key (size_t bytes);
+            /**
+             * @description: 用户指针前面要空出多少字节放区块头，对齐要求大于区块头时空出一个对齐单位，用户指针仍然对齐
+             * @param {size_t} alignment
+             * @return {*}
+             */
+            static size_t header_pad (size_t alignment);
+            /**
+             * @description: 多申请区块头和尾部canary的空间，写好头和尾
+             * @param {size_t} n
+             * @param {size_t} alignment
+             * @return {*}
+             */
+            static void *hardened_allocate (size_t n, size_t alignment);
+            /**
+             * @description: 检查头尾canary和size class，标成已释放、填毒值，放进当前线程的隔离区
+             * @param {void} *p
+             * @param {size_t} n
+             * @param {size_t} alignment
+             * @return {*}
+             */
+            static void hardened_deallocate (void *p, size_t n, size_t alignment);
+            /**
+             * @description: 隔离区里最老的区块出队，检查毒值没被改过，再真正释放
+             * @param {thread_cache} &tc
+             * @return {*}
+             */
+            static void evict_quarantine (thread_cache &tc);
+            /**
+             * @description: 检查隔离过的区块有没有被释放后写，然后还给内存池
+             * @param {quarantine_entry} &e
+             * @return {*}
+             */
+            static void release_quarantined (const quarantine_entry &e);
+            /**
+             * @description: 发现内存被破坏，打印原因和地址后abort
+             * @param {char} *what
+             * @param {void} *p
+             * @return {*}
+             */
+            [[noreturn]] static void report_corruption (const char *what, const void *p);
+#endif
+#ifdef TINYSTL_ALLOC_STATS
+            /**
+             * @description: 线程缓存第一次计数时挂到cstats.caches上，取快照时才能找到它
+             * @param {thread_cache} &tc
+             * @return {*}
+             */
+            static void register_cache (thread_cache &tc);
+#endif
         public:
             /**
-             * @description: 空间配置函数，n大于128调用malloc，否则检查对应的freelist是否有可用区块，有直接用，没有则上调倍数，调用refill
+             * @description: 空间配置函数，n大于MAX_PAGE_BYTES调用malloc，大于MAX_BYTES按页分配，否则检查线程缓存对应的freelist是否有可用区块，有直接用，没有则向中心池批量申请
              * @param {size_t} n
              * @return {*}
-             */        
+             */
             static void *allocate (size_t n);
             /**
-             * @description: 按照1、2级配置器回收区块
+             * @description: 按照分配时的层级回收区块，小区块先回到线程缓存，缓存过长时批量还给中心池
              * @param {void} *p
              * @param {size_t} n
              * @return {*}
-             */            
+             */
             static void deallocate (void *p, size_t n);
+            /**
+             * @description: 调整区块大小，同一个size class（或同样页数）直接返回p，页级区块缩小时把尾部的页还回去，
+             *               变大时后面紧跟着空闲页或者页池就原地接上，
+             *               两边都超过MAX_PAGE_BYTES用realloc（glibc对mmap出来的大块会用mremap，不用拷贝），其余情况才拷贝
+             * @param {void} *p
+             * @param {size_t} old_sz
+             * @param {size_t} new_sz
+             * @return {*}
+             */
             static void *reallocate (void *p, size_t old_sz, size_t new_sz);
+            /**
+             * @description: 一次申请count个大小为n的区块，写到out里。先拿线程缓存里的，不够的加一次锁从中心池拿，
+             *               中心池也不够就直接从内存池切一整段，不经过freelist。建链表、树这种一次要很多节点时用
+             * @param {size_t} n
+             * @param {void} **out 至少能放count个指针
+             * @param {size_t} count
+             * @return {*}
+             */
+            static void allocate_batch (size_t n, void **out, size_t count);
+            /**
+             * @description: 一次回收count个大小为n的区块，线程缓存最多留一批，多出来的加一次锁直接从数组挂到中心池上
+             * @param {void} **ptrs
+             * @param {size_t} count
+             * @param {size_t} n
+             * @return {*}
+             */
+            static void deallocate_batch (void **ptrs, size_t count, size_t n);
+            /**
+             * @description: 申请n字节、按alignment对齐的区块，alignment是2的幂，最大PAGE_SIZE
+             *               不超过CACHE_LINE时还是从freelist拿，只是换成对齐满足的class，更大的对齐按页分配
+             * @param {size_t} n
+             * @param {size_t} alignment
+             * @return {*}
+             */
+            static void *allocate_aligned (size_t n, size_t alignment);
+            /**
+             * @description: 回收allocate_aligned分配的区块，n和alignment要和申请时一样
+             * @param {void} *p
+             * @param {size_t} n
+             * @param {size_t} alignment
+             * @return {*}
+             */
+            static void deallocate_aligned (void *p, size_t n, size_t alignment);
+            /**
+             * @description: 把当前线程的缓存还给中心池，再把全部空闲的chunk和页还给系统，其他线程缓存里的区块不动
+             * @return {*} 还给系统的字节数
+             */
+            static size_t trim ();
+            /**
+             * @description: 设置自动trim的阈值，空闲内存比上次trim后多出bytes字节时自动trim，0表示关闭
+             * @param {size_t} bytes
+             * @return {*}
+             */
+            static void set_trim_threshold (size_t bytes);
+            /**
+             * @description: 设置bytes所在class的refill批量上下限（区块数），bytes为0时设置所有class，上下限为0表示用默认值
+             *               默认下限REFILL_MIN_OBJS，上限是REFILL_BYTES字节和REFILL_MAX_OBJS个里较小的那个
+             * @param {size_t} bytes
+             * @param {size_t} min_objs
+             * @param {size_t} max_objs
+             * @return {*}
+             */
+            static void set_refill_limits (size_t bytes, size_t min_objs, size_t max_objs);
+            /**
+             * @description: 设置alloc和page_heap之后申请chunk用的page_source，比如换成mmap_page_source
+             * @param {page_source} *src 生命周期由调用者保证
+             * @return {*}
+             */
+            static void set_page_source (page_source *src);
+            /**
+             * @description: 打开或关掉按NUMA节点分池，默认打开；只有一个节点时本来就只用arenas[0]
+             *               关掉后所有线程都从arenas[0]拿，已经在别的arena里的区块照样还回原来的arena
+             * @param {bool} enabled
+             * @return {*}
+             */
+            static void set_node_arenas (bool enabled);
+            /**
+             * @description: 小型区块p所在chunk是哪个节点上的线程申请的，按节点分池时就是它的页所在的节点
+             *               n超过MAX_BYTES（页级、大块）时返回-1
+             * @param {void} *p
+             * @param {size_t} n 申请时的大小
+             * @return {*}
+             */
+            static int node_of (void *p, size_t n);
+            /**
+             * @description: 取一份统计快照，没定义TINYSTL_ALLOC_STATS时只有字节数
+             * @return {*}
+             */
+            static alloc_stats stats ();
+            /**
+             * @description: 每个class从中心池拿出去的区块数的高水位，各arena加起来，加上页级区块在用页数的高水位，退出前save下来给下次启动warm_up用
+             * @return {*}
+             */
+            static pool_profile high_water ();
+            /**
+             * @description: 高水位从现在拿出去的区块数重新算，比如跳过启动阶段，只记稳定运行时的
+             * @return {*}
+             */
+            static void reset_high_water ();
+            /**
+             * @description: 按profile把调用线程所在节点的arena预先填满：每个class切出depth个区块挂到中心池上，页级区块按pages预备好空闲页
+             *               需要的chunk按总字节数一次向page_source预留（reserved_page_source），不是一个一个要；切好的每页都写过，缺页也在这里发生
+             *               切好的区块不串成freelist，按段挂着，线程来取时按地址取一批，见warm_run
+             *               预留没用完的chunk留给以后增长用，trim时连同全空闲的chunk一起还回去；只在启动时调用一次，重复调用会再加一份
+             * @param {pool_profile} &profile
+             * @return {*} 预热的字节数，page_source要不到内存时只预热一部分
+             */
+            static size_t warm_up (const pool_profile &profile);
     };
 
     // 静态成员变量初始化
-    char *alloc::start_free = nullptr;
-    char *alloc::end_free = nullptr;
-    size_t alloc::heap_size = 0;
-    obj *alloc::free_list[NFREELISTS] = {
-        nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr
-    };
-    
-    inline size_t alloc::round_up (size_t bytes) {
-        // 这样就能上调至 ALIGN 的倍数，你就说吊不吊
-        return (((bytes) + ALIGN - 1) & ~(ALIGN - 1));
-    }
-
-    inline size_t alloc::freelist_index (size_t bytes) {
-        return (((bytes) + ALIGN - 1) / ALIGN - 1);
-    }
-    
-    void *alloc::refill (size_t n) {
-        // 注意这里的n已经上调至8的倍数
-        // 一次性申请20个区块
-        size_t nobjs = 20;
-        char *chunk = chunk_alloc(n, nobjs);
-        
-        obj *my_free_list;
+    alloc::arena alloc::arenas[MAX_NUMA_NODES];
+    std::atomic<bool> alloc::node_arenas(true);
+    std::atomic<bool> alloc::multi_arena(false);
+    std::atomic<size_t> alloc::trim_threshold(0);
+    thread_local alloc::thread_cache alloc::tcache;
+#ifdef TINYSTL_ALLOC_STATS
+    std::mutex alloc::stats_lock;
+    alloc::central_stats alloc::cstats;
+#endif
+
+    constexpr size_t alloc::round_up (size_t bytes) {
+        return size_classes.size[freelist_index(bytes)];
+    }
+
+    constexpr size_t alloc::freelist_index (size_t bytes) {
+        // 先上调至 ALIGN 的倍数，再查表
+        return size_classes.index[((bytes) + ALIGN - 1) / ALIGN];
+    }
+
+    inline alloc::chunk_header *alloc::chunk_of (void *p) {
+        return (chunk_header *) ((uintptr_t) p & ~(uintptr_t) (CHUNK_BYTES - 1));
+    }
+
+    inline alloc::arena &alloc::local_arena () {
+        if (MAX_NUMA_NODES == 1 || !node_arenas.load(std::memory_order_relaxed)) {
+            return arenas[0];
+        }
+        return arenas[(size_t) numa::current_node() % MAX_NUMA_NODES];
+    }
+
+    inline obj *alloc::next_of (obj *p) {
+#ifdef TINYSTL_ALLOC_HARDENED
+        // 和glibc的safe-linking一样，存的是 next ^ (链接所在地址 >> 12) ^ secret
+        // 释放后写、越界写改掉的链接解出来几乎不可能正好对齐，不会把任意地址当成区块发出去
+        uintptr_t v = (uintptr_t) p->free_list_link ^ ((uintptr_t) p >> 12) ^ (uintptr_t) secret();
+        if ((v & (ALIGN - 1)) != 0) {
+            report_corruption("free list link corrupted", p);
+        }
+        return (obj *) v;
+#else
+        return p->free_list_link;
+#endif
+    }
+
+    inline void alloc::set_next (obj *p, obj *next) {
+#ifdef TINYSTL_ALLOC_HARDENED
+        p->free_list_link = (obj *) ((uintptr_t) next ^ ((uintptr_t) p >> 12) ^ (uintptr_t) secret());
+#else
+        p->free_list_link = next;
+#endif
+    }
+
+    alloc::thread_cache::~thread_cache () {
+        dead = true;
+#ifdef TINYSTL_ALLOC_HARDENED
+        while (quarantine_count > 0) {
+            evict_quarantine(*this);
+        }
+#endif
+        for (size_t i = 0; i < NFREELISTS; i++) {
+            if (free_list[i] == nullptr) {
+                continue;
+            }
+            // 整条链表还给中心池，各回各的arena
+            release_chain(i, free_list[i], length[i]);
+            free_list[i] = nullptr;
+            length[i] = 0;
+        }
+#ifdef TINYSTL_ALLOC_STATS
+        std::lock_guard<std::mutex> guard(stats_lock);
+        if (registered) {
+            for (size_t i = 0; i < NFREELISTS; i++) {
+                cstats.retired_allocs[i] += allocs[i].get();
+                cstats.retired_frees[i] += frees[i].get();
+            }
+            if (prev_cache != nullptr) {
+                prev_cache->next_cache = next_cache;
+            } else {
+                cstats.caches = next_cache;
+            }
+            if (next_cache != nullptr) {
+                next_cache->prev_cache = prev_cache;
+            }
+            registered = false;
+        }
+#endif
+    }
+
+    void *alloc::refill (arena &a, size_t n) {
+        // 注意这里的n已经上调至size class的大小
+        // 一次性申请一批区块，批量大小按这个class最近refill得有多频繁自适应
+        size_t nobjs = next_refill_batch(a, freelist_index(n));
+        char *chunk = chunk_alloc(a, n, nobjs);
+        TINYSTL_STAT(a.st.refills[freelist_index(n)]++);
+
+        obj **my_free_list;
         obj *result;
         obj *current_obj, *next_obj;
-        int i;
-        
+        size_t i;
+
         // 只申请到了1个区块
         if (1 == nobjs) {
             return chunk;
         }
         // 其他情况
-        my_free_list = free_list[freelist_index(n)];
+        my_free_list = a.free_list + freelist_index(n);
         result = (obj *) chunk;
-        my_free_list = next_obj = (obj *) (chunk + n);
+        *my_free_list = next_obj = (obj *) (chunk + n);
         for (i = 1; ; i++) {
             current_obj = next_obj;
             next_obj = (obj *) ((char *) next_obj + n);
             if (nobjs - 1 == i) {
-                current_obj->free_list_link = 0;
+                set_next(current_obj, nullptr);
                 break;
             } else {
-                current_obj->free_list_link = next_obj;
+                set_next(current_obj, next_obj);
             }
         }
+        a.free_bytes += (nobjs - 1) * n;
         return result;
     }
 
-    char *alloc::chunk_alloc (size_t size, size_t &nobjs) {
-        // size已经上调至8的倍数
+    size_t alloc::next_refill_batch (arena &a, size_t index) {
+        refill_state &st = a.refill_ctl[index];
+        size_t lo = st.min != 0 ? st.min : (size_t) REFILL_MIN_OBJS;
+        size_t hi = st.max != 0 ? st.max : size_classes.refill_max[index];
+        uint64_t now = ++a.refill_tick;
+        if (st.batch == 0) {
+            st.batch = lo;
+        } else {
+            uint64_t idle = now - st.last;
+            if (idle <= (uint64_t) REFILL_HOT_TICKS) {
+                st.batch *= 2;
+            } else {
+                for (uint64_t k = idle / REFILL_IDLE_TICKS; k > 0 && st.batch > lo; k--) {
+                    st.batch /= 2;
+                }
+            }
+        }
+        if (st.batch < lo) {
+            st.batch = lo;
+        }
+        if (st.batch > hi) {
+            st.batch = hi;
+        }
+        st.last = now;
+        return st.batch;
+    }
+
+    inline void alloc::note_fetched (arena &a, size_t index, size_t count) {
+        size_t out = a.outstanding[index] += count;
+        if (out > a.high_water[index]) {
+            a.high_water[index] = out;
+        }
+    }
+
+    char *alloc::take_warm (arena &a, size_t index, size_t &nobjs) {
+        size_t n = size_classes.size[index];
+        char *block = a.warm_start[index];
+        size_t avail = (a.warm_end[index] - block) / n;
+        if (nobjs > avail) {
+            nobjs = avail;
+        }
+        // 游标在arena里，取一批只动arena，不往区块里写段头
+        a.warm_start[index] = block + nobjs * n;
+        if (a.warm_start[index] == a.warm_end[index]) {
+            next_warm(a, index);
+        }
+        a.free_bytes -= nobjs * n;
+        return block;
+    }
+
+    void alloc::add_warm (arena &a, size_t index, char *start, char *end) {
+        if (a.warm_start[index] == nullptr) {
+            a.warm_start[index] = start;
+            a.warm_end[index] = end;
+        } else if ((size_t) (end - start) >= sizeof(warm_run)) {
+            warm_run *run = (warm_run *) start;
+            run->next = a.warm_runs[index];
+            run->end = end;
+            a.warm_runs[index] = run;
+        } else {
+            // 最小的class只有一个区块时放不下段头，挂到freelist上
+            set_next((obj *) start, a.free_list[index]);
+            a.free_list[index] = (obj *) start;
+        }
+    }
+
+    void alloc::next_warm (arena &a, size_t index) {
+        warm_run *run = a.warm_runs[index];
+        if (run == nullptr) {
+            a.warm_start[index] = a.warm_end[index] = nullptr;
+            return;
+        }
+        // 段头只在换段时读一次
+        a.warm_runs[index] = run->next;
+        a.warm_start[index] = (char *) run;
+        a.warm_end[index] = run->end;
+    }
+
+    void alloc::spill_warm (arena &a, size_t index) {
+        size_t n = size_classes.size[index];
+        while (a.warm_start[index] != nullptr) {
+            char *block = a.warm_start[index];
+            size_t count = (a.warm_end[index] - block) / n;
+            // 先换下一段，段头等下会被链接盖掉
+            next_warm(a, index);
+            for (size_t k = count; k > 0; k--) {
+                obj *p = (obj *) (block + (k - 1) * n);
+                set_next(p, a.free_list[index]);
+                a.free_list[index] = p;
+            }
+        }
+    }
+
+    void alloc::split_leftover (arena &a, char *p, size_t bytes) {
+        while (bytes > 0) {
+            // 每次申请的内存总是ALIGN的倍数，每次取得空间也是ALIGN的倍数，所以剩下的空间一定是ALIGN的倍数
+            // size class不再是等距的，剩余空间不一定正好是某个class的大小
+            // 找不超过剩余空间、对齐也满足的最大class，放进去，剩下的继续拆，最小的class是ALIGN，一定能拆完
+            size_t index = freelist_index(bytes);
+            if (size_classes.size[index] > bytes) {
+                index--;
+            }
+            while (((uintptr_t) p & (size_classes.align[index] - 1)) != 0) {
+                index--;
+            }
+            obj **my_free_list = a.free_list + index;
+            set_next((obj *) p, *my_free_list); // 头插法，把剩余空间给最接近的区块的freelist
+            *my_free_list = (obj *) p;
+            p += size_classes.size[index];
+            bytes -= size_classes.size[index];
+            a.free_bytes += size_classes.size[index];
+        }
+    }
+
+    char *alloc::chunk_alloc (arena &a, size_t size, size_t &nobjs) {
+        // size已经上调至size class的大小
+        // page_source要按class分chunk时用这个class自己的内存池，否则所有class共用一个
+        size_t index = freelist_index(size);
+        bool own = page_source::current()->per_class();
+        char *&start_free = own ? a.class_start[index] : a.start_free;
+        char *&end_free = own ? a.class_end[index] : a.end_free;
+        chunk_header *&current_chunk = own ? a.class_chunk[index] : a.current_chunk;
         char *result;
-        size_t total_bytes = size * nobjs;   
+        size_t total_bytes = size * nobjs;
         size_t bytes_left = end_free - start_free; // 内存池剩余空间
-        if (bytes_left >= total_bytes) {
+        // 先把start_free挪到这个class的自然对齐上，16、32、64字节的区块才能对齐，跳过的零头拆给小的class
+        size_t align = size_classes.align[index];
+        size_t pad = (align - ((uintptr_t) start_free & (align - 1))) & (align - 1);
+        if (pad != 0 && bytes_left >= pad + size) {
+            if (!own) {
+                split_leftover(a, start_free, pad);
+            }
+            start_free += pad;
+            bytes_left -= pad;
+            pad = 0;
+        }
+        if (pad == 0 && bytes_left >= total_bytes) {
             // 内存池剩余空间完全满足需求
             result = start_free;
             start_free += total_bytes;
             return result;
-        } else if (bytes_left >= size) {
+        } else if (pad == 0 && bytes_left >= size) {
             // 内存池剩余空间不能完全满足需求，但至少能满足一个
             nobjs = bytes_left / size; // 内存池剩余空间能满足多少个区块
             total_bytes = size * nobjs;
@@ -142,80 +895,1070 @@ namespace tinystl
             start_free += total_bytes;
             return result;
         } else {
-            // 内存池剩余空间一个区块都满足不了
-            size_t bytes_to_get = 2 * total_bytes + round_up(heap_size >> 4); // 计算出一个合适的空间大小（2*此时我们需要的空间+一些额外空间）
-            if (bytes_left > 0) {
-                // 内存池还有一些空间
-                obj *my_free_list = free_list[freelist_index(bytes_left)]; // 这是和剩余空间最接近的区块的freelist
-                ((obj *)start_free)->free_list_link = my_free_list; // 头插法，把剩余空间给最接近的区块的freelist
-                my_free_list = (obj *) start_free;
-
-                // 这里有个疑问
-                // 假设 bytes_left = 6，会把这6个字节放到放到freelist[0]处
-                // 一个obj*大小是8，((obj *)start_free)->free_list_link不能放在这里，这样会造成问题
-                // 并且freelist[0]应该返回一个 8 * n 大小的空间
-
-                // 解决：size_t bytes_to_get = 2 * total_bytes + round_up(heap_size >> 4);
-                // 每次申请的内存总是8的倍数，每次取得空间也是8得倍数
-                // 所以剩下的空间一定是8的倍数。这里是reelist_index(bytes_left)而不是reelist_index(round_up(bytes_left))也说明了这个问题
-            }
-            start_free = (char *)malloc(bytes_to_get);
-            if (0 == start_free) {
+            // 内存池剩余空间一个区块都满足不了，还有零头的话拆给小的class
+            // 按class分chunk时零头不拆，免得别的class的区块混进这一段，最多浪费不到一个区块
+            if (!own) {
+                split_leftover(a, start_free, bytes_left);
+            }
+            start_free = end_free;
+            // 原来按 2 * total_bytes + heap_size / 16 向malloc要，大小不固定，没法从区块地址找回chunk
+            // 现在每次要一个固定大小、按自身大小对齐的chunk，区块地址取整就是chunk头
+            current_chunk = new_chunk(a, own ? (int) index : -1);
+            if (nullptr == current_chunk) {
                 // heap空间不足，检查我们的freelist
-                int i;
-                obj *my_free_list, *p;
-                for (int i = size; i <= MAX_BYTES; i += ALIGN) {
-                    // 再次注意，size已经上调至8的倍数
+                obj **my_free_list, *p, *prev;
+                for (size_t i = index; i < NFREELISTS; i++) {
+                    // 再次注意，size已经上调至size class的大小
                     // 从当前size在的freelist往右数，找到第一块可用的区块返回(只给一块就够了！)
-                    my_free_list = free_list[freelist_index(i)];
-                    p = my_free_list;
+                    // 区块地址挪到这个class的对齐上以后还得放得下size，放不下的跳过，不然放回内存池又切不出来，一直递归下去
+                    spill_warm(a, i);
+                    my_free_list = a.free_list + i;
+                    prev = nullptr;
+                    p = *my_free_list;
+                    while (p != nullptr && ((align - ((uintptr_t) p & (align - 1))) & (align - 1)) + size > size_classes.size[i]) {
+                        prev = p;
+                        p = next_of(p);
+                    }
                     if (p != nullptr) {
-                        my_free_list = p->free_list_link;
+                        if (prev == nullptr) {
+                            *my_free_list = next_of(p);
+                        } else {
+                            set_next(prev, next_of(p));
+                        }
+                        a.free_bytes -= size_classes.size[i];
+                        TINYSTL_STAT(a.st.steal_fallbacks++);
+                        current_chunk = chunk_of(p);
                         start_free = (char *) p;
-                        end_free = start_free + i;
-                        return chunk_alloc(size, nobjs);
+                        end_free = start_free + size_classes.size[i];
+                        return chunk_alloc(a, size, nobjs);
                     }
                 }
-                end_free = nullptr; // 没有空间了，一点都没了
-                std::cout << "没有空间了！" << std::endl;
+                start_free = end_free = nullptr; // 没有空间了，一点都没了
+                TINYSTL_STAT(a.st.oom_failures++);
                 throw std::bad_alloc();
             }
-            heap_size += bytes_to_get;
-            end_free = start_free + bytes_to_get;
-            return chunk_alloc(size, nobjs);
+            start_free = (char *) current_chunk + CHUNK_HEADER_BYTES;
+            end_free = (char *) current_chunk + CHUNK_BYTES;
+            return chunk_alloc(a, size, nobjs);
         }
-        
+
     }
 
-    void *alloc::allocate (size_t n) {
-        obj *my_free_list;
+    alloc::chunk_header *alloc::new_chunk (arena &a, int size_class) {
+        page_source *src = page_source::current();
+        chunk_header *chunk = nullptr;
+        if (a.reserve != nullptr && size_class < 0) {
+            // 先用warm_up预留的，用完了就不再管它，发出去的chunk照样记着它，还回去时由它决定什么时候整段还给上游
+            chunk = (chunk_header *) a.reserve->allocate_chunk(CHUNK_BYTES, CHUNK_BYTES);
+            if (chunk != nullptr) {
+                src = a.reserve;
+            } else {
+                a.reserve->close();
+                a.reserve = nullptr;
+            }
+        }
+        if (chunk == nullptr) {
+            chunk = (chunk_header *) (size_class < 0 ? src->allocate_chunk(CHUNK_BYTES, CHUNK_BYTES)
+                                                     : src->allocate_class_chunk(CHUNK_BYTES, CHUNK_BYTES, (size_t) size_class));
+        }
+        if (chunk == nullptr) {
+            return nullptr;
+        }
+        int node = numa::current_node();
+        if (node_arenas.load(std::memory_order_relaxed)) {
+            // 写chunk头之前绑，mmap_page_source给的页还没碰过，第一次写就落在绑定的节点上
+            numa::bind(chunk, CHUNK_BYTES, node);
+        }
+        chunk->live = 0;
+        chunk->source = src;
+        chunk->home = (uint32_t) (&a - arenas);
+        if (chunk->home != 0 && !multi_arena.load(std::memory_order_relaxed)) {
+            multi_arena.store(true, std::memory_order_relaxed);
+        }
+        chunk->node = node;
+        chunk->prev = nullptr;
+        chunk->next = a.chunks;
+        if (a.chunks != nullptr) {
+            a.chunks->prev = chunk;
+        }
+        a.chunks = chunk;
+        a.heap_size += CHUNK_BYTES;
+        TINYSTL_STAT(a.st.chunks_acquired++);
+        return chunk;
+    }
+
+    void alloc::release_chunk (arena &a, chunk_header *chunk) {
+        if (chunk->prev != nullptr) {
+            chunk->prev->next = chunk->next;
+        } else {
+            a.chunks = chunk->next;
+        }
+        if (chunk->next != nullptr) {
+            chunk->next->prev = chunk->prev;
+        }
+        a.heap_size -= CHUNK_BYTES;
+        TINYSTL_STAT(a.st.chunks_released++);
+        chunk->source->release_chunk(chunk, CHUNK_BYTES);
+    }
+
+    void *alloc::fetch_from_central (thread_cache &tc, size_t n) {
+        size_t index = freelist_index(n);
+        arena &a = local_arena();
+        std::unique_lock<std::mutex> guard(a.lock);
+        obj **my_free_list = a.free_list + index;
+        obj *result = *my_free_list;
+        if (result == nullptr && a.warm_start[index] != nullptr) {
+            // warm_up切好的段按地址取一批，不用顺着链表一个个读冷的区块
+            size_t nobjs = size_classes.batch[index];
+            char *block = take_warm(a, index, nobjs);
+            chunk_of(block)->live += nobjs;
+            note_fetched(a, index, nobjs);
+            TINYSTL_STAT(a.st.fetched[index] += nobjs);
+            guard.unlock();
+            // 这一批已经归这个线程了，链接在锁外写：写冷的cache line不用等，解锁的内存屏障也不会卡在这些写上
+            for (size_t k = nobjs - 1; k > 0; k--) {
+                obj *p = (obj *) (block + k * n);
+                set_next(p, tc.free_list[index]);
+                tc.free_list[index] = p;
+            }
+            tc.length[index] += nobjs - 1;
+            return block;
+        }
+        if (result == nullptr) {
+            // 中心池也空了，由refill向内存池要一批，多出来的挂在中心池上
+            result = (obj *) refill(a, n);
+        } else {
+            *my_free_list = next_of(result);
+            a.free_bytes -= n;
+        }
+        chunk_of(result)->live++;
+        // 再从中心池摘一批给线程缓存
+        obj *first = *my_free_list;
+        obj *last = nullptr;
+        size_t count = 0;
+        size_t batch = size_classes.batch[index];
+        for (obj *p = first; p != nullptr && count < batch - 1; p = next_of(p)) {
+            chunk_of(p)->live++;
+            last = p;
+            count++;
+        }
+        if (count > 0) {
+            *my_free_list = next_of(last);
+            set_next(last, tc.free_list[index]);
+            tc.free_list[index] = first;
+            tc.length[index] += count;
+            a.free_bytes -= count * n;
+        }
+        note_fetched(a, index, count + 1);
+        TINYSTL_STAT(a.st.fetched[index] += count + 1);
+        return result;
+    }
+
+    void alloc::release_to_central (thread_cache &tc, size_t index, size_t count) {
+        tc.free_list[index] = release_chain(index, tc.free_list[index], count);
+        tc.length[index] -= count;
+    }
+
+    obj *alloc::release_chain (size_t index, obj *first, size_t count) {
+        // 只用过arenas[0]时（单节点机器总是这样）不用读chunk头，直接在锁里走一趟，和原来一样快
+        bool multi = MAX_NUMA_NODES > 1 && multi_arena.load(std::memory_order_relaxed);
+        if (!multi) {
+            return release_run(arenas[0], index, first, count);
+        }
+        // 在锁外看看这一段是不是都属于同一个arena
+        size_t home = chunk_of(first)->home;
+        bool mixed = false;
+        obj *last = first;
+        for (size_t i = 1; i < count; i++) {
+            last = next_of(last);
+            mixed |= chunk_of(last)->home != home;
+        }
+        if (!mixed) {
+            return release_run(arenas[home], index, first, count);
+        }
+        obj *rest = next_of(last);
+        release_scattered(index, first, count);
+        return rest;
+    }
+
+    void alloc::release_scattered (size_t index, obj *first, size_t count) {
+        // 线程缓存里混着别的节点的区块（跨节点释放的），按arena拆成几条链，顺序不变
+        obj *head[MAX_NUMA_NODES] = {};
+        obj *tail[MAX_NUMA_NODES] = {};
+        size_t length[MAX_NUMA_NODES] = {};
+        obj *p = first;
+        for (size_t i = 0; i < count; i++) {
+            obj *next = next_of(p);
+            size_t k = chunk_of(p)->home;
+            if (head[k] == nullptr) {
+                head[k] = p;
+            } else {
+                set_next(tail[k], p);
+            }
+            tail[k] = p;
+            length[k]++;
+            p = next;
+        }
+        for (size_t k = 0; k < (size_t) MAX_NUMA_NODES; k++) {
+            if (length[k] != 0) {
+                release_run(arenas[k], index, head[k], length[k]);
+            }
+        }
+    }
+
+    obj *alloc::release_run (arena &a, size_t index, obj *first, size_t count) {
+        std::lock_guard<std::mutex> guard(a.lock);
+        obj *last = first;
+        for (size_t i = 1; ; i++) {
+            chunk_of(last)->live--;
+            if (i == count) {
+                break;
+            }
+            last = next_of(last);
+        }
+        obj *rest = next_of(last);
+        set_next(last, a.free_list[index]);
+        a.free_list[index] = first;
+        note_returned_locked(a, index, count);
+        return rest;
+    }
+
+    void alloc::release_array (size_t index, void **ptrs, size_t count) {
+        bool multi = MAX_NUMA_NODES > 1 && multi_arena.load(std::memory_order_relaxed);
+        size_t home = multi ? chunk_of(ptrs[0])->home : 0;
+        for (size_t i = 1; multi && i < count; i++) {
+            if (chunk_of(ptrs[i])->home != home) {
+                // 混着别的节点的区块，串成链按arena拆开
+                for (size_t k = 1; k < count; k++) {
+                    set_next((obj *) ptrs[k - 1], (obj *) ptrs[k]);
+                }
+                release_scattered(index, (obj *) ptrs[0], count);
+                return;
+            }
+        }
+        arena &a = arenas[home];
+        std::lock_guard<std::mutex> guard(a.lock);
+        obj *next = a.free_list[index];
+        for (size_t i = count; i > 0; i--) {
+            obj *p = (obj *) ptrs[i - 1];
+            chunk_of(p)->live--;
+            set_next(p, next);
+            next = p;
+        }
+        a.free_list[index] = next;
+        note_returned_locked(a, index, count);
+    }
+
+    void alloc::note_returned_locked (arena &a, size_t index, size_t count) {
+        a.free_bytes += count * size_classes.size[index];
+        a.outstanding[index] -= count;
+        TINYSTL_STAT(a.st.returned[index] += count);
+        size_t threshold = trim_threshold.load(std::memory_order_relaxed);
+        if (threshold != 0 && a.free_bytes > a.trim_mark + threshold) {
+            trim_locked(a);
+        }
+    }
+
+    size_t alloc::trim_locked (arena &a) {
+        // 预留里还没发出去的chunk也不要了
+        if (a.reserve != nullptr) {
+            a.reserve->close();
+            a.reserve = nullptr;
+        }
+        // 正在切的chunk如果已经全空闲，连同没切完的部分一起放弃；还在切的chunk上总有拿出去的区块，下面不会还掉它
+        if (a.current_chunk != nullptr && a.current_chunk->live == 0) {
+            a.start_free = a.end_free = nullptr;
+            a.current_chunk = nullptr;
+        }
+        for (size_t i = 0; i < NFREELISTS; i++) {
+            if (a.class_chunk[i] != nullptr && a.class_chunk[i]->live == 0) {
+                a.class_start[i] = a.class_end[i] = nullptr;
+                a.class_chunk[i] = nullptr;
+            }
+        }
+        // 把属于全空闲chunk的区块从arena摘掉
+        for (size_t i = 0; i < NFREELISTS; i++) {
+            if (a.warm_start[i] != nullptr) {
+                chunk_header *chunk = chunk_of(a.warm_start[i]);
+                if (chunk->live == 0 && chunk != a.current_chunk) {
+                    a.free_bytes -= a.warm_end[i] - a.warm_start[i];
+                    a.warm_start[i] = a.warm_end[i] = nullptr;
+                }
+            }
+            warm_run **link = a.warm_runs + i;
+            while (*link != nullptr) {
+                warm_run *run = *link;
+                chunk_header *chunk = chunk_of(run);
+                if (chunk->live == 0 && chunk != a.current_chunk) {
+                    a.free_bytes -= run->end - (char *) run;
+                    *link = run->next;
+                } else {
+                    link = &run->next;
+                }
+            }
+            if (a.warm_start[i] == nullptr) {
+                next_warm(a, i);
+            }
+            obj *prev = nullptr;
+            obj *p = a.free_list[i];
+            while (p != nullptr) {
+                obj *next = next_of(p);
+                chunk_header *chunk = chunk_of(p);
+                if (chunk->live == 0 && chunk != a.current_chunk) {
+                    if (prev != nullptr) {
+                        set_next(prev, next);
+                    } else {
+                        a.free_list[i] = next;
+                    }
+                    a.free_bytes -= size_classes.size[i];
+                } else {
+                    prev = p;
+                }
+                p = next;
+            }
+        }
+        size_t released = 0;
+        chunk_header *chunk = a.chunks;
+        while (chunk != nullptr) {
+            chunk_header *next = chunk->next;
+            if (chunk->live == 0 && chunk != a.current_chunk) {
+                release_chunk(a, chunk);
+                released += CHUNK_BYTES;
+            }
+            chunk = next;
+        }
+        a.trim_mark = a.free_bytes;
+        // 刚还过内存，所有class的refill批量从头慢启动
+        for (size_t i = 0; i < NFREELISTS; i++) {
+            a.refill_ctl[i].batch = 0;
+        }
+        return released;
+    }
+
+    size_t alloc::trim () {
+        thread_cache &tc = tcache;
+        if (!tc.dead) {
+#ifdef TINYSTL_ALLOC_HARDENED
+            while (tc.quarantine_count > 0) {
+                evict_quarantine(tc);
+            }
+#endif
+            for (size_t i = 0; i < NFREELISTS; i++) {
+                if (tc.length[i] > 0) {
+                    release_to_central(tc, i, tc.length[i]);
+                }
+            }
+        }
+        size_t released = 0;
+        for (arena &a : arenas) {
+            std::lock_guard<std::mutex> guard(a.lock);
+            released += trim_locked(a);
+        }
+        released += page_heap::trim();
+        page_source::current()->flush();
+        return released;
+    }
+
+    void alloc::set_trim_threshold (size_t bytes) {
+        trim_threshold.store(bytes, std::memory_order_relaxed);
+        page_heap::set_trim_threshold(bytes);
+    }
+
+    void alloc::set_refill_limits (size_t bytes, size_t min_objs, size_t max_objs) {
+        if (bytes > (size_t) MAX_BYTES) {
+            return;
+        }
+        if (max_objs != 0 && max_objs < min_objs) {
+            max_objs = min_objs;
+        }
+        size_t first = bytes == 0 ? 0 : freelist_index(bytes);
+        size_t last = bytes == 0 ? (size_t) NFREELISTS : first + 1;
+        for (arena &a : arenas) {
+            std::lock_guard<std::mutex> guard(a.lock);
+            for (size_t i = first; i < last; i++) {
+                a.refill_ctl[i].min = min_objs;
+                a.refill_ctl[i].max = max_objs;
+                a.refill_ctl[i].batch = 0;
+            }
+        }
+    }
+
+    void alloc::set_page_source (page_source *src) {
+        page_source::set_current(src);
+    }
+
+    void alloc::set_node_arenas (bool enabled) {
+        node_arenas.store(enabled, std::memory_order_relaxed);
+    }
+
+    int alloc::node_of (void *p, size_t n) {
+        // 硬化模式下用户指针前面还有区块头，后面有canary，按底层区块的大小判断是不是小区块
+        size_t bytes = ALLOC_HARDENED ? n + HARDEN_HEADER_BYTES + HARDEN_TRAILER_BYTES : n;
+        if (p == nullptr || bytes > (size_t) MAX_BYTES) {
+            return -1;
+        }
+        return chunk_of(p)->node;
+    }
+
+    void *alloc::raw_allocate (size_t n) {
+        obj **my_free_list;
         obj *result;
         if (n > (size_t) MAX_BYTES) {
-            return malloc(n);
+            if (n > (size_t) MAX_PAGE_BYTES) {
+                void *r = malloc(n);
+                if (r == nullptr) {
+                    throw std::bad_alloc();
+                }
+                TINYSTL_STAT(cstats.large_allocs.fetch_add(1, std::memory_order_relaxed));
+                return r;
+            }
+            return page_heap::allocate_pages(page_heap::pages(n));
+        }
+        thread_cache &tc = tcache;
+        if (tc.dead) {
+            // 线程正在退出，线程缓存已经析构，直接找中心池要
+            TINYSTL_STAT(std::lock_guard<std::mutex> guard(stats_lock); cstats.retired_allocs[freelist_index(n)]++);
+            arena &a = local_arena();
+            std::lock_guard<std::mutex> guard(a.lock);
+            my_free_list = a.free_list + freelist_index(n);
+            result = *my_free_list;
+            if (result == nullptr) {
+                result = (obj *) refill(a, round_up(n));
+            } else {
+                *my_free_list = next_of(result);
+                a.free_bytes -= round_up(n);
+            }
+            chunk_of(result)->live++;
+            note_fetched(a, freelist_index(n), 1);
+            TINYSTL_STAT(a.st.fetched[freelist_index(n)]++);
+            return result;
         }
         // 找到合适的freelist
-        my_free_list = free_list[freelist_index(n)];
-        result = my_free_list;
+        size_t index = freelist_index(n);
+        TINYSTL_STAT(if (!tc.registered) register_cache(tc); tc.allocs[index].add(1));
+        my_free_list = tc.free_list + index;
+        result = *my_free_list;
         if (result == nullptr) {
-            void *r = refill(round_up(n));
+            void *r = fetch_from_central(tc, round_up(n));
             return r;
         }
-        my_free_list = result->free_list_link;
+        *my_free_list = next_of(result);
+        tc.length[index]--;
         return result;
     }
 
-    void alloc::deallocate (void *p, size_t n) {
+#ifdef TINYSTL_ALLOC_STATS
+    void alloc::register_cache (thread_cache &tc) {
+        std::lock_guard<std::mutex> guard(stats_lock);
+        tc.next_cache = cstats.caches;
+        if (cstats.caches != nullptr) {
+            cstats.caches->prev_cache = &tc;
+        }
+        cstats.caches = &tc;
+        tc.registered = true;
+    }
+#endif
+
+    alloc_stats alloc::stats () {
+        alloc_stats s = {};
+#ifdef TINYSTL_ALLOC_STATS
+        arena_stats sum = {};
+#endif
+        for (size_t i = 0; i < NFREELISTS; i++) {
+            s.classes[i].size = size_classes.size[i];
+        }
+        // 各arena依次加锁汇总，不同时拿着两把锁
+        for (arena &a : arenas) {
+            std::lock_guard<std::mutex> guard(a.lock);
+            for (size_t i = 0; i < NFREELISTS; i++) {
+                alloc_class_stats &c = s.classes[i];
+                // 按节点分池时各arena的批量各自变化，报最大的那个
+                if (a.refill_ctl[i].batch > c.refill_batch) {
+                    c.refill_batch = a.refill_ctl[i].batch;
+                }
+                c.high_water += a.high_water[i];
+                for (obj *p = a.free_list[i]; p != nullptr; p = next_of(p)) {
+                    c.central_free++;
+                }
+                c.central_free += (a.warm_end[i] - a.warm_start[i]) / size_classes.size[i];
+                for (warm_run *run = a.warm_runs[i]; run != nullptr; run = run->next) {
+                    c.central_free += (run->end - (char *) run) / size_classes.size[i];
+                }
+#ifdef TINYSTL_ALLOC_STATS
+                sum.fetched[i] += a.st.fetched[i];
+                sum.returned[i] += a.st.returned[i];
+                sum.refills[i] += a.st.refills[i];
+#endif
+            }
+            s.heap_bytes += a.heap_size;
+            s.central_free_bytes += a.free_bytes;
+#ifdef TINYSTL_ALLOC_STATS
+            sum.chunks_acquired += a.st.chunks_acquired;
+            sum.chunks_released += a.st.chunks_released;
+            sum.steal_fallbacks += a.st.steal_fallbacks;
+            sum.oom_failures += a.st.oom_failures;
+#endif
+        }
+#ifdef TINYSTL_ALLOC_STATS
+        {
+            std::lock_guard<std::mutex> guard(stats_lock);
+            s.enabled = true;
+            for (size_t i = 0; i < NFREELISTS; i++) {
+                alloc_class_stats &c = s.classes[i];
+                c.allocs = cstats.retired_allocs[i];
+                c.frees = cstats.retired_frees[i];
+                for (thread_cache *tc = cstats.caches; tc != nullptr; tc = tc->next_cache) {
+                    c.allocs += tc->allocs[i].get();
+                    c.frees += tc->frees[i].get();
+                }
+                // 别的线程的计数是各自读的，快照里可能差一点，不让它变成负数
+                c.live = c.allocs > c.frees ? c.allocs - c.frees : 0;
+                uint64_t out = sum.fetched[i] - sum.returned[i];
+                c.cached = out > c.live ? out - c.live : 0;
+                c.refills = sum.refills[i];
+                s.in_use_bytes += c.live * c.size;
+                s.cached_bytes += c.cached * c.size;
+            }
+            s.chunks_acquired = sum.chunks_acquired;
+            s.chunks_released = sum.chunks_released;
+            s.steal_fallbacks = sum.steal_fallbacks;
+            s.oom_failures = sum.oom_failures;
+            s.large_allocs = cstats.large_allocs.load(std::memory_order_relaxed);
+            s.large_frees = cstats.large_frees.load(std::memory_order_relaxed);
+        }
+#endif
+        page_heap::usage(s.page_heap_bytes, s.page_in_use_bytes, s.page_free_bytes);
+        return s;
+    }
+
+    pool_profile alloc::high_water () {
+        pool_profile p = {};
+        for (arena &a : arenas) {
+            std::lock_guard<std::mutex> guard(a.lock);
+            for (size_t i = 0; i < NFREELISTS; i++) {
+                p.depth[i] += a.high_water[i];
+            }
+        }
+        p.pages = page_heap::high_water();
+        return p;
+    }
+
+    void alloc::reset_high_water () {
+        for (arena &a : arenas) {
+            std::lock_guard<std::mutex> guard(a.lock);
+            for (size_t i = 0; i < NFREELISTS; i++) {
+                a.high_water[i] = a.outstanding[i];
+            }
+        }
+        page_heap::reset_high_water();
+    }
+
+    size_t alloc::warm_up (const pool_profile &profile) {
+        if (profile.pages >= SIZE_MAX / 4 / PAGE_SIZE) {
+            return 0;
+        }
+        // 每个class对齐时跳过的不到一个区块，加上每个chunk末尾切不下的不到一个最大区块，按这个多留一点
+        size_t bytes = 0;
+        for (size_t i = 0; i < NFREELISTS; i++) {
+            if (profile.depth[i] >= SIZE_MAX / 4 / size_classes.size[i]) {
+                return 0;   // 文件坏了，不要去申请天文数字的内存
+            }
+            if (profile.depth[i] != 0) {
+                bytes += (profile.depth[i] + 1) * size_classes.size[i];
+            }
+        }
+        // 页级区块在page_heap里，和arena不共用锁
+        size_t warmed = page_heap::warm_up(profile.pages);
+        if (bytes == 0) {
+            return warmed;
+        }
+        size_t usable = (size_t) CHUNK_BYTES - CHUNK_HEADER_BYTES - MAX_BYTES;
+        arena &a = local_arena();
+        std::lock_guard<std::mutex> guard(a.lock);
+        if (a.reserve != nullptr) {
+            a.reserve->close();
+        }
+        // 要不到一整段时reserve是nullptr，下面照常一个一个要chunk
+        // page_source按class分chunk时每个class本来就在自己那一段里，不再另外预留
+        if (!page_source::current()->per_class()) {
+            a.reserve = reserved_page_source::create(page_source::current(), CHUNK_BYTES, (bytes + usable - 1) / usable);
+        }
+        try {
+            // 从大的class切起，对齐跳过的零头和chunk末尾的零头拆给小的class
+            for (size_t i = NFREELISTS; i > 0; i--) {
+                size_t index = i - 1;
+                size_t n = size_classes.size[index];
+                size_t left = profile.depth[index];
+                while (left > 0) {
+                    size_t nobjs = left;
+                    char *first = chunk_alloc(a, n, nobjs);
+                    char *end = first + nobjs * n;
+                    // 每页写一下，缺页在这里发生，不留给启动后第一次取
+                    for (char *p = first; p < end; p = (char *) (((uintptr_t) p + PAGE_SIZE) & ~(uintptr_t) (PAGE_SIZE - 1))) {
+                        *(volatile char *) p = 0;
+                    }
+                    // 不串成freelist：串好的链表等真正用到时早就不在cache里了，取一批要一个个读，比冷启动现切还慢
+                    // 挂成一段，中心池按地址往后取
+                    add_warm(a, index, first, end);
+                    a.free_bytes += nobjs * n;
+                    warmed += nobjs * n;
+                    left -= nobjs;
+                }
+            }
+        } catch (const std::bad_alloc &) {
+            // page_source给不了更多了，已经切好的留着
+        }
+        // 预热的区块不算自动trim要还的那部分
+        a.trim_mark = a.free_bytes;
+        return warmed;
+    }
+
+    bool alloc::resize_in_place (void *p, size_t old_sz, size_t new_sz) {
+        if (old_sz <= (size_t) MAX_BYTES && new_sz <= (size_t) MAX_BYTES) {
+            return freelist_index(old_sz) == freelist_index(new_sz);
+        }
+        if (old_sz > (size_t) MAX_BYTES && new_sz > (size_t) MAX_BYTES
+            && old_sz <= (size_t) MAX_PAGE_BYTES && new_sz <= (size_t) MAX_PAGE_BYTES) {
+            size_t old_pages = page_heap::pages(old_sz);
+            size_t new_pages = page_heap::pages(new_sz);
+            if (new_pages == old_pages) {
+                return true;
+            }
+            if (new_pages < old_pages) {
+                // 缩小：尾部多出来的页直接还回去
+                page_heap::shrink_pages(p, old_pages, new_pages);
+                return true;
+            }
+            // 变大：后面紧跟着空闲页或者页池时原地接上，不用拷贝
+            return page_heap::grow_pages(p, old_pages, new_pages);
+        }
+        return false;
+    }
+
+    void *alloc::reallocate (void *p, size_t old_sz, size_t new_sz) {
+        if (p == nullptr || old_sz == 0) {
+            return allocate(new_sz);
+        }
+#ifndef TINYSTL_ALLOC_HARDENED
+        // 加了头尾canary的区块不能原地调整，硬化模式下一律走最后的重新分配，顺便检查旧区块
+        // 不走allocate/deallocate的路径要自己调采样钩子，按新大小重新采样
+        if (old_sz > (size_t) MAX_PAGE_BYTES && new_sz > (size_t) MAX_PAGE_BYTES) {
+            // realloc可能把p还掉，别的线程马上又拿到它，所以先摘样本
+            TINYSTL_PROFILE(alloc_profiler::on_deallocate(p));
+            void *r = realloc(p, new_sz);
+            if (r == nullptr) {
+                TINYSTL_PROFILE(alloc_profiler::on_allocate(p, old_sz));
+                throw std::bad_alloc();
+            }
+            TINYSTL_PROFILE(alloc_profiler::on_allocate(r, new_sz));
+            return r;
+        }
+        if (resize_in_place(p, old_sz, new_sz)) {
+            TINYSTL_PROFILE(alloc_profiler::on_deallocate(p); alloc_profiler::on_allocate(p, new_sz));
+            return p;
+        }
+#endif
+        // 跨层级或者原地扩不了的页级区块，只能重新分配再拷贝，allocate和deallocate里会调采样钩子
+        void *r = allocate(new_sz);
+        memcpy(r, p, old_sz < new_sz ? old_sz : new_sz);
+        deallocate(p, old_sz);
+        return r;
+    }
+
+    void alloc::raw_deallocate (void *p, size_t n) {
         if (n > (size_t) MAX_BYTES) {
-            free(p);
+            if (n > (size_t) MAX_PAGE_BYTES) {
+                free(p);
+                TINYSTL_STAT(cstats.large_frees.fetch_add(1, std::memory_order_relaxed));
+            } else {
+                page_heap::deallocate_pages(p, page_heap::pages(n));
+            }
             return;
         }
         obj *q = (obj *) p;
-        obj *my_free_list;
-        my_free_list = free_list[freelist_index(n)];
-        q->free_list_link = my_free_list; // 头插
-        my_free_list = q;
+        obj **my_free_list;
+        size_t index = freelist_index(n);
+        thread_cache &tc = tcache;
+        if (tc.dead) {
+            TINYSTL_STAT(std::lock_guard<std::mutex> guard(stats_lock); cstats.retired_frees[index]++);
+            set_next(q, nullptr);
+            release_chain(index, q, 1);
+            return;
+        }
+        TINYSTL_STAT(if (!tc.registered) register_cache(tc); tc.frees[index].add(1));
+        my_free_list = tc.free_list + index;
+        set_next(q, *my_free_list); // 头插
+        *my_free_list = q;
+        // 线程缓存攒得太多（比如生产者/消费者模式下只释放不申请），还一批给中心池
+        if (++tc.length[index] > 2 * size_classes.batch[index]) {
+            release_to_central(tc, index, size_classes.batch[index]);
+        }
+    }
+
+    inline size_t alloc::aligned_size (size_t n, size_t alignment) {
+        if (alignment <= (size_t) ALIGN) {
+            return n;
+        }
+        if (n <= (size_t) MAX_BYTES && alignment <= (size_t) CACHE_LINE) {
+            // 往上找第一个自然对齐够的class，大小是CACHE_LINE倍数的class一定满足
+            size_t index = freelist_index(n == 0 ? 1 : n);
+            while (size_classes.align[index] < alignment) {
+                index++;
+            }
+            return size_classes.size[index];
+        }
+        // 页级区块按页对齐，小请求也提到页级，按整页算，raw_allocate_aligned直接找page_heap要，不会被当成小区块
+        return n == 0 ? (size_t) PAGE_SIZE : (n + PAGE_SIZE - 1) & ~(size_t) (PAGE_SIZE - 1);
+    }
+
+    void *alloc::raw_allocate_aligned (size_t n, size_t alignment) {
+        if ((alignment & (alignment - 1)) != 0 || alignment > (size_t) PAGE_SIZE) {
+            throw std::bad_alloc();
+        }
+        size_t sz = aligned_size(n, alignment);
+        if (sz > (size_t) MAX_PAGE_BYTES && alignment > alignof(max_align_t)) {
+            // malloc只保证max_align_t，大块用aligned_alloc，回收时一样是free
+            void *r = aligned_alloc(alignment, (sz + alignment - 1) & ~(alignment - 1));
+            if (r == nullptr) {
+                throw std::bad_alloc();
+            }
+            TINYSTL_STAT(cstats.large_allocs.fetch_add(1, std::memory_order_relaxed));
+            return r;
+        }
+        if (alignment > (size_t) CACHE_LINE && sz <= (size_t) MAX_PAGE_BYTES) {
+            // 64字节的小请求要128字节对齐时，sz是一页，不能按大小交给raw_allocate，否则会被当成小区块
+            return page_heap::allocate_pages(page_heap::pages(sz));
+        }
+        return raw_allocate(sz);
+    }
+
+    void alloc::raw_deallocate_aligned (void *p, size_t n, size_t alignment) {
+        size_t sz = aligned_size(n, alignment);
+        if (alignment > (size_t) CACHE_LINE && sz <= (size_t) MAX_PAGE_BYTES) {
+            page_heap::deallocate_pages(p, page_heap::pages(sz));
+            return;
+        }
+        raw_deallocate(p, sz);
+    }
+
+    void *alloc::allocate (size_t n) {
+#ifdef TINYSTL_ALLOC_HARDENED
+        void *p = hardened_allocate(n, ALIGN);
+#else
+        void *p = raw_allocate(n);
+#endif
+        TINYSTL_PROFILE(alloc_profiler::on_allocate(p, n));
+        return p;
+    }
+
+    void alloc::deallocate (void *p, size_t n) {
+        TINYSTL_PROFILE(alloc_profiler::on_deallocate(p));
+#ifdef TINYSTL_ALLOC_HARDENED
+        hardened_deallocate(p, n, ALIGN);
+#else
+        raw_deallocate(p, n);
+#endif
+    }
+
+    void *alloc::allocate_aligned (size_t n, size_t alignment) {
+#ifdef TINYSTL_ALLOC_HARDENED
+        void *p = hardened_allocate(n, alignment);
+#else
+        void *p = raw_allocate_aligned(n, alignment);
+#endif
+        TINYSTL_PROFILE(alloc_profiler::on_allocate(p, n));
+        return p;
+    }
+
+    void alloc::deallocate_aligned (void *p, size_t n, size_t alignment) {
+        TINYSTL_PROFILE(alloc_profiler::on_deallocate(p));
+#ifdef TINYSTL_ALLOC_HARDENED
+        hardened_deallocate(p, n, alignment);
+#else
+        raw_deallocate_aligned(p, n, alignment);
+#endif
+    }
+
+#ifdef TINYSTL_ALLOC_HARDENED
+    inline uint64_t alloc::secret () {
+        return ((uint64_t) (uintptr_t) &arenas * 0x9e3779b97f4a7c15ull) ^ 0x2545f4914f6cdd1dull;
+    }
+
+    inline size_t alloc::class_key (size_t bytes) {
+        if (bytes <= (size_t) MAX_BYTES) {
+            return freelist_index(bytes);
+        }
+        if (bytes <= (size_t) MAX_PAGE_BYTES) {
+            return NFREELISTS + page_heap::pages(bytes);
+        }
+        return 0xffff;
+    }
+
+    inline size_t alloc::header_pad (size_t alignment) {
+        return alignment > (size_t) HARDEN_HEADER_BYTES ? alignment : (size_t) HARDEN_HEADER_BYTES;
+    }
+
+    void *alloc::hardened_allocate (size_t n, size_t alignment) {
+        size_t pad = header_pad(alignment);
+        if (n >= ((uint64_t) 1 << 48) - pad - HARDEN_TRAILER_BYTES) {
+            throw std::bad_alloc();
+        }
+        size_t bytes = pad + n + HARDEN_TRAILER_BYTES;
+        char *user = (char *) raw_allocate_aligned(bytes, alignment) + pad;
+        block_header *h = (block_header *) user - 1;
+        h->requested = n;
+        h->size_class = class_key(aligned_size(bytes, alignment));
+        h->canary = secret() ^ (uintptr_t) h;
+        // 尾部不一定对齐，用memcpy写
+        uint64_t tail = secret() ^ (uintptr_t) user;
+        memcpy(user + n, &tail, sizeof(tail));
+        return user;
+    }
+
+    void alloc::hardened_deallocate (void *p, size_t n, size_t alignment) {
+        if (p == nullptr) {
+            report_corruption("deallocate of null pointer", p);
+        }
+        char *user = (char *) p;
+        block_header *h = (block_header *) user - 1;
+        uint64_t live = secret() ^ (uintptr_t) h;
+        if (h->canary == ~live) {
+            report_corruption("double free", p);
+        }
+        if (h->canary != live) {
+            report_corruption("header canary overwritten (buffer underflow, or pointer not from alloc)", p);
+        }
+        size_t pad = header_pad(alignment);
+        if (h->size_class != class_key(aligned_size(pad + n + HARDEN_TRAILER_BYTES, alignment))) {
+            report_corruption("deallocate size does not match the size class it was allocated with", p);
+        }
+        size_t requested = h->requested;
+        uint64_t tail;
+        memcpy(&tail, user + requested, sizeof(tail));
+        if (tail != (secret() ^ (uintptr_t) user)) {
+            report_corruption("trailer canary overwritten (buffer overflow)", p);
+        }
+        h->canary = ~live;
+        memset(user, POISON_VALUE, requested < (size_t) POISON_BYTES ? requested : (size_t) POISON_BYTES);
+        quarantine_entry e = {user, requested, alignment};
+        thread_cache &tc = tcache;
+        if (tc.dead || requested > (size_t) QUARANTINE_BYTES) {
+            release_quarantined(e);
+            return;
+        }
+        if (tc.quarantine_count == (size_t) QUARANTINE_BLOCKS) {
+            evict_quarantine(tc);
+        }
+        tc.quarantine[(tc.quarantine_head + tc.quarantine_count) % QUARANTINE_BLOCKS] = e;
+        tc.quarantine_count++;
+        tc.quarantine_bytes += requested;
+        while (tc.quarantine_bytes > (size_t) QUARANTINE_BYTES) {
+            evict_quarantine(tc);
+        }
+    }
+
+    void alloc::evict_quarantine (thread_cache &tc) {
+        quarantine_entry e = tc.quarantine[tc.quarantine_head];
+        tc.quarantine_head = (tc.quarantine_head + 1) % QUARANTINE_BLOCKS;
+        tc.quarantine_count--;
+        tc.quarantine_bytes -= e.size;
+        release_quarantined(e);
+    }
+
+    void alloc::release_quarantined (const quarantine_entry &e) {
+        block_header *h = (block_header *) e.user - 1;
+        if (h->canary != ~(secret() ^ (uintptr_t) h)) {
+            report_corruption("header written after free", e.user);
+        }
+        size_t poisoned = e.size < (size_t) POISON_BYTES ? e.size : (size_t) POISON_BYTES;
+        // 按8字节一组比较，最后不满8字节的逐个比
+        const uint64_t word = 0x0101010101010101ull * (unsigned char) POISON_VALUE;
+        size_t i = 0;
+        for (; i + sizeof(word) <= poisoned; i += sizeof(word)) {
+            uint64_t v;
+            memcpy(&v, e.user + i, sizeof(v));
+            if (v != word) {
+                report_corruption("block written after free", e.user + i);
+            }
+        }
+        for (; i < poisoned; i++) {
+            if ((unsigned char) e.user[i] != (unsigned char) POISON_VALUE) {
+                report_corruption("block written after free", e.user + i);
+            }
+        }
+        size_t pad = header_pad(e.alignment);
+        raw_deallocate_aligned(e.user - pad, pad + e.size + HARDEN_TRAILER_BYTES, e.alignment);
+    }
+
+    void alloc::report_corruption (const char *what, const void *p) {
+        fprintf(stderr, "tinystl::alloc: %s at %p\n", what, p);
+        abort();
+    }
+#endif
+
+    size_t alloc::fetch_batch_locked (arena &a, size_t n, void **out, size_t count) {
+        size_t index = freelist_index(n);
+        obj **my_free_list = a.free_list + index;
+        size_t got = 0;
+        obj *p = *my_free_list;
+        for (; p != nullptr && got < count; p = next_of(p)) {
+            chunk_of(p)->live++;
+            out[got++] = p;
+        }
+        // 摘下来的是开头一整段，剩下的接回去
+        *my_free_list = p;
+        a.free_bytes -= got * n;
+        while (got < count && a.warm_start[index] != nullptr) {
+            size_t nobjs = count - got;
+            char *block = take_warm(a, index, nobjs);
+            chunk_of(block)->live += nobjs;
+            for (size_t i = 0; i < nobjs; i++, block += n) {
+                out[got++] = block;
+            }
+        }
+        // 剩下的直接从内存池切，一段里的区块都在同一个chunk上
+        try {
+            while (got < count) {
+                size_t nobjs = count - got;
+                char *block = chunk_alloc(a, n, nobjs);
+                TINYSTL_STAT(a.st.refills[index]++);
+                chunk_of(block)->live += nobjs;
+                for (size_t i = 0; i < nobjs; i++, block += n) {
+                    out[got++] = block;
+                }
+            }
+        } catch (const std::bad_alloc &) {
+            // 要不到chunk，已经拿到的照样算发出去了，由调用者还回来
+        }
+        note_fetched(a, index, got);
+        TINYSTL_STAT(a.st.fetched[index] += got);
+        return got;
+    }
+
+    void alloc::allocate_batch (size_t n, void **out, size_t count) {
+        if (count == 0) {
+            return;
+        }
+        // 硬化模式下每个区块都要单独加头尾、进隔离区，和页级区块一样逐个处理
+        if (ALLOC_HARDENED || n > (size_t) MAX_BYTES) {
+            size_t i = 0;
+            try {
+                for (; i < count; i++) {
+                    out[i] = allocate(n);
+                }
+            } catch (...) {
+                deallocate_batch(out, i, n);
+                throw;
+            }
+            return;
+        }
+        size_t index = freelist_index(n);
+        size_t got = 0;
+        thread_cache &tc = tcache;
+        if (!tc.dead) {
+            obj *p = tc.free_list[index];
+            for (; p != nullptr && got < count; p = next_of(p)) {
+                out[got++] = p;
+            }
+            tc.free_list[index] = p;
+            tc.length[index] -= got;
+        }
+        if (got < count) {
+            arena &a = local_arena();
+            std::lock_guard<std::mutex> guard(a.lock);
+            got += fetch_batch_locked(a, round_up(n), out + got, count - got);
+        }
+        // 按实际发出去的数记，要不到的时候下面还回去，释放也会记上
+        if (!tc.dead) {
+            TINYSTL_STAT(if (!tc.registered) register_cache(tc); tc.allocs[index].add(got));
+        } else {
+            TINYSTL_STAT(std::lock_guard<std::mutex> guard(stats_lock); cstats.retired_allocs[index] += got);
+        }
+        if (got < count) {
+            // 只有内存池要不到chunk时才会不够，已经拿到的还回去
+            deallocate_batch(out, got, n);
+            throw std::bad_alloc();
+        }
+        TINYSTL_PROFILE(for (size_t i = 0; i < count; i++) alloc_profiler::on_allocate(out[i], n));
+    }
+
+    void alloc::deallocate_batch (void **ptrs, size_t count, size_t n) {
+        if (count == 0) {
+            return;
+        }
+        if (ALLOC_HARDENED || n > (size_t) MAX_BYTES) {
+            for (size_t i = 0; i < count; i++) {
+                deallocate(ptrs[i], n);
+            }
+            return;
+        }
+        TINYSTL_PROFILE(for (size_t i = 0; i < count; i++) alloc_profiler::on_deallocate(ptrs[i]));
+        size_t index = freelist_index(n);
+        thread_cache &tc = tcache;
+        if (tc.dead) {
+            TINYSTL_STAT(std::lock_guard<std::mutex> guard(stats_lock); cstats.retired_frees[index] += count);
+            release_array(index, ptrs, count);
+            return;
+        }
+        TINYSTL_STAT(if (!tc.registered) register_cache(tc); tc.frees[index].add(count));
+        // 线程缓存最多留一批，多出来的不经过线程缓存，加一次锁直接从数组挂到中心池上
+        size_t batch = size_classes.batch[index];
+        size_t keep = count;
+        if (tc.length[index] + count > 2 * batch) {
+            keep = tc.length[index] < batch ? batch - tc.length[index] : 0;
+        }
+        if (keep > 0) {
+            obj *next = tc.free_list[index];
+            for (size_t i = keep; i > 0; i--) {
+                set_next((obj *) ptrs[i - 1], next);
+                next = (obj *) ptrs[i - 1];
+            }
+            tc.free_list[index] = next;
+            tc.length[index] += keep;
+        }
+        if (keep < count) {
+            release_array(index, ptrs + keep, count - keep);
+        }
     }
+
+    /**
+     * @description: 每个区块都按cache line对齐、大小补齐到cache line的整数倍，不会和别的区块共用一条cache line
+     *               给各线程频繁写的计数器、状态这种热对象用，接口和alloc一样，simple_alloc<T, cacheline_alloc>即可
+     */
+    class cacheline_alloc {
+        public:
+            static void *allocate (size_t n) {
+                return alloc::allocate_aligned(padded(n), CACHE_LINE);
+            }
+            static void deallocate (void *p, size_t n) {
+                alloc::deallocate_aligned(p, padded(n), CACHE_LINE);
+            }
+            static void allocate_batch (size_t n, void **out, size_t count) {
+                size_t sz = padded(n);
+                if (ALLOC_HARDENED || sz > (size_t) MAX_PAGE_BYTES) {
+                    for (size_t i = 0; i < count; i++) {
+                        out[i] = alloc::allocate_aligned(sz, CACHE_LINE);
+                    }
+                    return;
+                }
+                // 补齐后是CACHE_LINE的倍数，所在class的自然对齐就是CACHE_LINE，页级区块按页对齐，直接批量拿
+                alloc::allocate_batch(sz, out, count);
+            }
+            static void deallocate_batch (void **ptrs, size_t count, size_t n) {
+                if (ALLOC_HARDENED || padded(n) > (size_t) MAX_PAGE_BYTES) {
+                    for (size_t i = 0; i < count; i++) {
+                        alloc::deallocate_aligned(ptrs[i], padded(n), CACHE_LINE);
+                    }
+                    return;
+                }
+                alloc::deallocate_batch(ptrs, count, padded(n));
+            }
+        private:
+            static constexpr size_t padded (size_t n) {
+                return n == 0 ? (size_t) CACHE_LINE : (n + CACHE_LINE - 1) & ~(size_t) (CACHE_LINE - 1);
+            }
+    };
 } // namespace tinystl
 
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,498 @@
+/*
+ * @Author: suzy HideSue@github.com
+ * @Date: 2026-10-18 23:52:07
+ * @LastEditors: suzy HideSue@github.com
+ * @LastEditTime: 2026-10-19 14:40:18
+ * @FilePath: /tinystl/alloc_policy.h
+ * @Description: 编译期组合配置器的积木，每个都是和alloc一样的静态接口，可以互相嵌套，最后交给simple_alloc<T, Policy>
+ *               fallback_alloc        先用Primary，失败（返回nullptr）时用Fallback；Primary必须有owns，alloc这种失败时抛异常、
+ *                                     认不出自己区块的不能当Primary，编译时static_assert
+ *               segregator_alloc      不超过Threshold字节的走Small，更大的走Large
+ *               stack_buffer_alloc    线程自己的一块固定缓冲区，挪指针分配，满了返回nullptr，配合fallback_alloc用
+ *               stats_alloc           给Parent计数：次数、字节数、在用字节的峰值、按大小的直方图
+ *               freelist_alloc        [MinSize, MaxSize]之间的请求都按MaxSize向Parent要，释放的留在线程的链表里复用
+ *               全是模板和静态内联函数，没有虚函数；simple_alloc按sizeof(T)调用时大小是常量，segregator_alloc的分支编译期就定了
+ *               例：节点不超过256字节时先用4K缓冲区，用完走alloc，更大的直接走alloc
+ *                   typedef segregator_alloc<256, fallback_alloc<stack_buffer_alloc<4096>, alloc>, alloc> node_alloc;
+ *                   simple_alloc<node, node_alloc>::allocate();
+ *
+ * Copyright (c) 2023 by ${suzy HideSue@github.com}, All Rights Reserved.
+ */
+#ifndef ALLOC_POLICY_H
+#define ALLOC_POLICY_H
+
+#include<atomic>
+#include<cstddef>
+#include<cstdint>
+#include<ostream>
+#include<type_traits>
+#include "alloc.h"
+#include "type_traits.h"
+
+namespace tinystl
+{
+    /**
+     * @description: 配置器有没有allocate_batch/deallocate_batch，没有时批量接口退回一个一个来
+     */
+    template<class Alloc, class = void>
+    struct __has_batch : false_type {};
+    template<class Alloc>
+    struct __has_batch<Alloc, std::void_t<decltype(Alloc::allocate_batch((size_t) 0, (void **) nullptr, (size_t) 0)),
+                                          decltype(Alloc::deallocate_batch((void **) nullptr, (size_t) 0, (size_t) 0))>> : true_type {};
+
+    /**
+     * @description: 配置器有没有owns，能不能认出一个指针是不是自己给的；组合出来的配置器只在各部分都有owns时才有
+     */
+    template<class Alloc, class = void>
+    struct __has_owns : false_type {};
+    template<class Alloc>
+    struct __has_owns<Alloc, std::void_t<decltype(Alloc::owns((const void *) nullptr))>> : true_type {};
+
+    template<class Alloc>
+    inline void __allocate_batch (size_t n, void **out, size_t count) {
+        if constexpr (__has_batch<Alloc>::value) {
+            Alloc::allocate_batch(n, out, count);
+        } else {
+            for (size_t i = 0; i < count; i++) {
+                out[i] = Alloc::allocate(n);
+            }
+        }
+    }
+
+    template<class Alloc>
+    inline void __deallocate_batch (void **ptrs, size_t count, size_t n) {
+        if constexpr (__has_batch<Alloc>::value) {
+            Alloc::deallocate_batch(ptrs, count, n);
+        } else {
+            for (size_t i = 0; i < count; i++) {
+                Alloc::deallocate(ptrs[i], n);
+            }
+        }
+    }
+
+    /**
+     * @description: 先用Primary，Primary返回nullptr时用Fallback；释放时Primary::owns(p)决定还给谁
+     *               Primary要有owns，并且空间不够时返回nullptr而不是抛异常（比如stack_buffer_alloc）
+     */
+    template<class Primary, class Fallback>
+    class fallback_alloc {
+        static_assert(__has_owns<Primary>::value,
+                      "fallback_alloc的Primary必须有owns(p)并且失败时返回nullptr，比如stack_buffer_alloc；alloc失败时抛异常，不能当Primary");
+        public:
+            static void *allocate (size_t n) {
+                void *p = Primary::allocate(n);
+                return p != nullptr ? p : Fallback::allocate(n);
+            }
+            static void deallocate (void *p, size_t n) {
+                if (Primary::owns(p)) {
+                    Primary::deallocate(p, n);
+                } else {
+                    Fallback::deallocate(p, n);
+                }
+            }
+            template<class F = Fallback, class = std::enable_if_t<__has_owns<F>::value>>
+            static bool owns (const void *p) {
+                return Primary::owns(p) || F::owns(p);
+            }
+            /**
+             * @description: Primary给到给不出为止，剩下的一次交给Fallback批量要
+             * @param {size_t} n
+             * @param {void} **out
+             * @param {size_t} count
+             * @return {*}
+             */
+            static void allocate_batch (size_t n, void **out, size_t count) {
+                size_t i = 0;
+                for (; i < count; i++) {
+                    out[i] = Primary::allocate(n);
+                    if (out[i] == nullptr) {
+                        break;
+                    }
+                }
+                if (i < count) {
+                    __allocate_batch<Fallback>(n, out + i, count - i);
+                }
+            }
+            /**
+             * @description: Primary的逐个还，其余的挪到数组前面一次还给Fallback，会改动ptrs的内容
+             * @param {void} **ptrs
+             * @param {size_t} count
+             * @param {size_t} n
+             * @return {*}
+             */
+            static void deallocate_batch (void **ptrs, size_t count, size_t n) {
+                size_t rest = 0;
+                for (size_t i = 0; i < count; i++) {
+                    if (Primary::owns(ptrs[i])) {
+                        Primary::deallocate(ptrs[i], n);
+                    } else {
+                        ptrs[rest++] = ptrs[i];
+                    }
+                }
+                if (rest > 0) {
+                    __deallocate_batch<Fallback>(ptrs, rest, n);
+                }
+            }
+    };
+
+    /**
+     * @description: 按请求大小分流，n <= Threshold走Small，否则走Large；释放时按同样的n分流，所以n必须和申请时一样
+     */
+    template<size_t Threshold, class Small, class Large>
+    class segregator_alloc {
+        public:
+            static void *allocate (size_t n) {
+                return n <= Threshold ? Small::allocate(n) : Large::allocate(n);
+            }
+            static void deallocate (void *p, size_t n) {
+                if (n <= Threshold) {
+                    Small::deallocate(p, n);
+                } else {
+                    Large::deallocate(p, n);
+                }
+            }
+            template<class S = Small, class = std::enable_if_t<__has_owns<S>::value && __has_owns<Large>::value>>
+            static bool owns (const void *p) {
+                return S::owns(p) || Large::owns(p);
+            }
+            static void allocate_batch (size_t n, void **out, size_t count) {
+                if (n <= Threshold) {
+                    __allocate_batch<Small>(n, out, count);
+                } else {
+                    __allocate_batch<Large>(n, out, count);
+                }
+            }
+            static void deallocate_batch (void **ptrs, size_t count, size_t n) {
+                if (n <= Threshold) {
+                    __deallocate_batch<Small>(ptrs, count, n);
+                } else {
+                    __deallocate_batch<Large>(ptrs, count, n);
+                }
+            }
+    };
+
+    /**
+     * @description: 每个线程一块Bytes大小的缓冲区（放在线程存储里，和栈一样随线程走），挪指针分配，放不下返回nullptr
+     *               释放最后分配的那块时指针退回去，其他的只记数，缓冲区里的块全部释放后从头再用
+     *               和arena_scope一样，块要在分配它的线程上释放，也不能活得比线程久；Tag用来让同样大小的两个缓冲区分开
+     */
+    template<size_t Bytes, class Tag = void>
+    class stack_buffer_alloc {
+        private:
+            enum {BLOCK_ALIGN = alignof(std::max_align_t) > (size_t) ALIGN ? alignof(std::max_align_t) : (size_t) ALIGN};
+            enum {BUFFER_BYTES = (Bytes + BLOCK_ALIGN - 1) & ~(size_t) (BLOCK_ALIGN - 1)};
+            static_assert(Bytes > 0, "缓冲区不能是空的");
+            static_assert((size_t) BUFFER_BYTES <= 256 * 1024, "缓冲区在每个线程的静态TLS里，太大的用monotonic_arena");
+
+            struct buffer {
+                alignas(CACHE_LINE) char data[BUFFER_BYTES];
+                size_t used;        // 用下标而不是指针，整个结构全零初始化，线程第一次用不需要构造
+                size_t live;
+            };
+            static thread_local buffer buf;
+
+            static constexpr size_t round_up (size_t n) {
+                return n == 0 ? (size_t) BLOCK_ALIGN : (n + BLOCK_ALIGN - 1) & ~(size_t) (BLOCK_ALIGN - 1);
+            }
+        public:
+            static void *allocate (size_t n) {
+                buffer &b = buf;
+                size_t sz = round_up(n);
+                if (sz > (size_t) BUFFER_BYTES - b.used) {
+                    return nullptr;
+                }
+                void *p = b.data + b.used;
+                b.used += sz;
+                b.live++;
+                return p;
+            }
+            static void deallocate (void *p, size_t n) {
+                buffer &b = buf;
+                if ((char *) p + round_up(n) == b.data + b.used) {
+                    b.used -= round_up(n);
+                }
+                if (--b.live == 0) {
+                    b.used = 0;
+                }
+            }
+            /**
+             * @description: p是不是当前线程缓冲区里的
+             * @param {void} *p
+             * @return {*}
+             */
+            static bool owns (const void *p) {
+                const char *c = (const char *) p;
+                return c >= buf.data && c < buf.data + BUFFER_BYTES;
+            }
+    };
+
+    template<size_t Bytes, class Tag> thread_local typename stack_buffer_alloc<Bytes, Tag>::buffer stack_buffer_alloc<Bytes, Tag>::buf;
+
+    /**
+     * @description: stats_alloc的快照，size_histogram[i]是大小落在(8 << (i - 1), 8 << i]的申请次数，第0格是8字节以内，最后一格是更大的
+     */
+    struct policy_stats {
+        enum {HISTOGRAM_BUCKETS = 16};
+
+        uint64_t allocs;
+        uint64_t frees;
+        uint64_t bytes_allocated;
+        uint64_t bytes_freed;
+        uint64_t live_bytes;
+        uint64_t peak_bytes;
+        uint64_t size_histogram[HISTOGRAM_BUCKETS];
+
+        /**
+         * @description: 每行一项，直方图只输出非零的格子
+         * @param {ostream} &os
+         * @return {*}
+         */
+        void write_text (std::ostream &os) const {
+            os << "allocs " << allocs << "\nfrees " << frees
+               << "\nbytes_allocated " << bytes_allocated << "\nbytes_freed " << bytes_freed
+               << "\nlive_bytes " << live_bytes << "\npeak_bytes " << peak_bytes << '\n';
+            for (size_t i = 0; i < (size_t) HISTOGRAM_BUCKETS; i++) {
+                if (size_histogram[i] == 0) {
+                    continue;
+                }
+                if (i + 1 == (size_t) HISTOGRAM_BUCKETS) {
+                    os << "size >" << ((size_t) 8 << (i - 1));
+                } else {
+                    os << "size <=" << ((size_t) 8 << i);
+                }
+                os << ' ' << size_histogram[i] << '\n';
+            }
+        }
+    };
+
+    /**
+     * @description: 给Parent计数，看一个容器实际的大小分布，好挑segregator_alloc的阈值和freelist_alloc的区间
+     *               计数是原子的，每次申请多几次原子加，只在调优时套上；Tag用来让同一个Parent的两份计数分开
+     */
+    template<class Parent, class Tag = void>
+    class stats_alloc {
+        private:
+            struct alignas(CACHE_LINE) counters {
+                std::atomic<uint64_t> frees;
+                std::atomic<uint64_t> bytes_allocated;
+                std::atomic<uint64_t> bytes_freed;
+                std::atomic<uint64_t> live_bytes;
+                std::atomic<uint64_t> peak_bytes;
+                std::atomic<uint64_t> size_histogram[policy_stats::HISTOGRAM_BUCKETS];
+            };
+            static counters c;
+
+            static size_t bucket (size_t n) {
+                if (n <= 8) {
+                    return 0;
+                }
+                size_t b = (size_t) (64 - __builtin_clzll((unsigned long long) (n - 1))) - 3;
+                return b < (size_t) policy_stats::HISTOGRAM_BUCKETS ? b : (size_t) policy_stats::HISTOGRAM_BUCKETS - 1;
+            }
+            static void record_allocate (size_t n, size_t count) {
+                c.size_histogram[bucket(n)].fetch_add(count, std::memory_order_relaxed);
+                c.bytes_allocated.fetch_add((uint64_t) n * count, std::memory_order_relaxed);
+                uint64_t live = c.live_bytes.fetch_add((uint64_t) n * count, std::memory_order_relaxed) + (uint64_t) n * count;
+                uint64_t peak = c.peak_bytes.load(std::memory_order_relaxed);
+                while (live > peak && !c.peak_bytes.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {
+                }
+            }
+            static void record_deallocate (size_t n, size_t count) {
+                c.frees.fetch_add(count, std::memory_order_relaxed);
+                c.bytes_freed.fetch_add((uint64_t) n * count, std::memory_order_relaxed);
+                c.live_bytes.fetch_sub((uint64_t) n * count, std::memory_order_relaxed);
+            }
+        public:
+            static void *allocate (size_t n) {
+                void *p = Parent::allocate(n);
+                if (p != nullptr) {
+                    record_allocate(n, 1);
+                }
+                return p;
+            }
+            static void deallocate (void *p, size_t n) {
+                record_deallocate(n, 1);
+                Parent::deallocate(p, n);
+            }
+            template<class P = Parent, class = std::enable_if_t<__has_owns<P>::value>>
+            static bool owns (const void *p) {
+                return P::owns(p);
+            }
+            static void allocate_batch (size_t n, void **out, size_t count) {
+                __allocate_batch<Parent>(n, out, count);
+                record_allocate(n, count);
+            }
+            static void deallocate_batch (void **ptrs, size_t count, size_t n) {
+                record_deallocate(n, count);
+                __deallocate_batch<Parent>(ptrs, count, n);
+            }
+            /**
+             * @description: 拿一份快照，各项分别读，并发申请释放时彼此之间不严格一致
+             * @return {*}
+             */
+            static policy_stats stats () {
+                policy_stats s;
+                s.allocs = 0;
+                for (size_t i = 0; i < (size_t) policy_stats::HISTOGRAM_BUCKETS; i++) {
+                    s.size_histogram[i] = c.size_histogram[i].load(std::memory_order_relaxed);
+                    s.allocs += s.size_histogram[i];
+                }
+                s.frees = c.frees.load(std::memory_order_relaxed);
+                s.bytes_allocated = c.bytes_allocated.load(std::memory_order_relaxed);
+                s.bytes_freed = c.bytes_freed.load(std::memory_order_relaxed);
+                s.live_bytes = c.live_bytes.load(std::memory_order_relaxed);
+                s.peak_bytes = c.peak_bytes.load(std::memory_order_relaxed);
+                return s;
+            }
+            /**
+             * @description: 计数清零，峰值从当前在用的字节数重新算
+             * @return {*}
+             */
+            static void reset_stats () {
+                for (size_t i = 0; i < (size_t) policy_stats::HISTOGRAM_BUCKETS; i++) {
+                    c.size_histogram[i].store(0, std::memory_order_relaxed);
+                }
+                c.frees.store(0, std::memory_order_relaxed);
+                c.bytes_allocated.store(0, std::memory_order_relaxed);
+                c.bytes_freed.store(0, std::memory_order_relaxed);
+                c.peak_bytes.store(c.live_bytes.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            }
+    };
+
+    template<class Parent, class Tag> typename stats_alloc<Parent, Tag>::counters stats_alloc<Parent, Tag>::c;
+
+    /**
+     * @description: 大小在[MinSize, MaxSize]之间的请求都按MaxSize向Parent要，释放后留在线程的链表里，下次同区间的请求直接拿
+     *               链表最多留MaxCount块，多的还给Parent；线程退出时全部还给Parent
+     *               适合大小不固定但范围很窄的对象（比如17到32字节的字符串），或者Parent本身没有缓存（比如只套了stats_alloc的malloc）
+     */
+    template<class Parent, size_t MinSize, size_t MaxSize, size_t MaxCount = 64>
+    class freelist_alloc {
+        private:
+            static_assert(MinSize <= MaxSize, "MinSize不能大于MaxSize");
+            static_assert(MaxSize >= sizeof(void *), "空闲块要能放下一个指针");
+            static_assert(MaxCount > 0, "MaxCount是0时直接用Parent");
+
+            struct node {
+                node *next;
+            };
+            struct thread_cache {
+                node *head;
+                size_t count;
+                bool dead;
+
+                constexpr thread_cache () : head(nullptr), count(0), dead(false) {}
+                ~thread_cache ();               // 线程退出时缓存的块还给Parent
+            };
+            static thread_local thread_cache tcache;
+
+            static constexpr bool in_range (size_t n) {
+                // 无符号减法，一次比较同时检查两头
+                return n - MinSize <= MaxSize - MinSize;
+            }
+        public:
+            static void *allocate (size_t n) {
+                if (!in_range(n)) {
+                    return Parent::allocate(n);
+                }
+                thread_cache &tc = tcache;
+                node *p = tc.head;
+                if (p != nullptr) {
+                    tc.head = p->next;
+                    tc.count--;
+                    return p;
+                }
+                return Parent::allocate(MaxSize);
+            }
+            static void deallocate (void *p, size_t n) {
+                if (!in_range(n)) {
+                    Parent::deallocate(p, n);
+                    return;
+                }
+                thread_cache &tc = tcache;
+                if (tc.count < MaxCount && !tc.dead) {
+                    node *q = (node *) p;
+                    q->next = tc.head;
+                    tc.head = q;
+                    tc.count++;
+                    return;
+                }
+                Parent::deallocate(p, MaxSize);
+            }
+            template<class P = Parent, class = std::enable_if_t<__has_owns<P>::value>>
+            static bool owns (const void *p) {
+                return P::owns(p);
+            }
+            /**
+             * @description: 先从链表拿，不够的按MaxSize一次向Parent批量要
+             * @param {size_t} n
+             * @param {void} **out
+             * @param {size_t} count
+             * @return {*}
+             */
+            static void allocate_batch (size_t n, void **out, size_t count) {
+                if (!in_range(n)) {
+                    __allocate_batch<Parent>(n, out, count);
+                    return;
+                }
+                thread_cache &tc = tcache;
+                size_t i = 0;
+                for (; i < count && tc.head != nullptr; i++) {
+                    out[i] = tc.head;
+                    tc.head = tc.head->next;
+                    tc.count--;
+                }
+                if (i < count) {
+                    __allocate_batch<Parent>(MaxSize, out + i, count - i);
+                }
+            }
+            static void deallocate_batch (void **ptrs, size_t count, size_t n) {
+                if (!in_range(n)) {
+                    __deallocate_batch<Parent>(ptrs, count, n);
+                    return;
+                }
+                thread_cache &tc = tcache;
+                size_t i = 0;
+                for (; i < count && tc.count < MaxCount && !tc.dead; i++) {
+                    node *q = (node *) ptrs[i];
+                    q->next = tc.head;
+                    tc.head = q;
+                    tc.count++;
+                }
+                if (i < count) {
+                    __deallocate_batch<Parent>(ptrs + i, count - i, MaxSize);
+                }
+            }
+            /**
+             * @description: 把当前线程链表里的块还给Parent
+             * @return {*} 还回去的字节数
+             */
+            static size_t trim () {
+                thread_cache &tc = tcache;
+                size_t bytes = tc.count * MaxSize;
+                while (tc.head != nullptr) {
+                    node *p = tc.head;
+                    tc.head = p->next;
+                    Parent::deallocate(p, MaxSize);
+                }
+                tc.count = 0;
+                return bytes;
+            }
+    };
+
+    template<class Parent, size_t MinSize, size_t MaxSize, size_t MaxCount>
+    thread_local typename freelist_alloc<Parent, MinSize, MaxSize, MaxCount>::thread_cache freelist_alloc<Parent, MinSize, MaxSize, MaxCount>::tcache;
+
+    template<class Parent, size_t MinSize, size_t MaxSize, size_t MaxCount>
+    freelist_alloc<Parent, MinSize, MaxSize, MaxCount>::thread_cache::~thread_cache () {
+        dead = true;
+        while (head != nullptr) {
+            node *p = head;
+            head = p->next;
+            Parent::deallocate(p, MaxSize);
+        }
+        count = 0;
+    }
+} // namespace tinystl
+
+#endif
@@ -0,0 +1,419 @@
+/*
+ * @Author: suzy HideSue@github.com
+ * @Date: 2026-10-18 23:05:52
+ * @LastEditors: suzy HideSue@github.com
+ * @LastEditTime: 2026-10-18 23:05:52
+ * @FilePath: /tinystl/alloc_profile.h
+ * @Description: alloc的采样堆剖析，编译时定义TINYSTL_ALLOC_PROFILE才有，不定义时钩子全部去掉
+ *               每个线程按字节计数，间隔服从均值为采样率的指数分布（几何采样），大的分配更容易被采到，每字节被采到的概率一样
+ *               采到的分配抓一次调用栈（unwinder可以换），记在活样本表里，deallocate时先查一个计数过滤表，命中了才加锁删
+ *               活着的样本可以导出成折叠栈格式（flamegraph.pl）或者pprof认的旧版heap profile文本格式
+ *
+ * Copyright (c) 2023 by ${suzy HideSue@github.com}, All Rights Reserved.
+ */
+#ifndef ALLOC_PROFILE_H
+#define ALLOC_PROFILE_H
+
+#ifdef TINYSTL_ALLOC_PROFILE
+#define TINYSTL_PROFILE(stmt) do { stmt; } while (0)
+#else
+#define TINYSTL_PROFILE(stmt) do {} while (0)
+#endif
+
+namespace tinystl
+{
+#ifdef TINYSTL_ALLOC_PROFILE
+    enum {ALLOC_PROFILED = 1};
+#else
+    enum {ALLOC_PROFILED = 0};
+#endif
+} // namespace tinystl
+
+#ifdef TINYSTL_ALLOC_PROFILE
+#include<atomic>
+#include<cmath>
+#include<cstddef>
+#include<cstdint>
+#include<cstdio>
+#include<cstdlib>
+#include<cstring>
+#include<fstream>
+#include<map>
+#include<mutex>
+#include<ostream>
+#include<string>
+#include<unordered_map>
+#include<vector>
+#if defined(__GLIBC__)
+#include<execinfo.h>
+#endif
+#if defined(__GNUC__) && defined(__linux__)
+#include<cxxabi.h>
+#include<dlfcn.h>
+#endif
+
+#ifndef TINYSTL_ALLOC_SAMPLE_BYTES
+#define TINYSTL_ALLOC_SAMPLE_BYTES (512 * 1024)     // 默认平均每分配这么多字节采一个样
+#endif
+
+namespace tinystl
+{
+    /**
+     * @description: 抓调用栈的函数，把返回地址从最内层开始写进frames，返回写了几个，和glibc的backtrace签名一样
+     */
+    typedef int (*alloc_unwinder) (void **frames, int max_frames);
+
+    class alloc_profiler {
+        private:
+            enum {MAX_FRAMES = 32};
+            enum {SKIP_FRAMES = 1};                 // 跳过sample_slow自己，栈顶是alloc::allocate
+            enum {FILTER_SLOTS = 16384};
+            /**
+             * @description: 每个线程的采样状态，都是平凡类型，thread_local不需要构造和析构
+             */
+            struct sampler {
+                int64_t countdown;                  // 还差多少字节采下一个样
+                uint64_t rng;
+                bool initialized;
+                bool busy;                          // 正在抓栈，unwinder里再分配不再采样
+            };
+            struct sample {
+                size_t size;                        // 这次分配的字节数
+                double weight;                      // 按采样概率折算的字节数，size / (1 - e^(-size / rate))
+                size_t rate;                        // 采样时的采样率
+                int depth;
+                void *frames[MAX_FRAMES];
+            };
+            struct table {
+                std::mutex lock;
+                std::unordered_map<const void *, sample> live;
+            };
+        private:
+            static std::atomic<size_t> rate;
+            static std::atomic<alloc_unwinder> unwinder;
+            static std::atomic<uint16_t> filter[FILTER_SLOTS];  // 每个槽上有几个活样本，为0的槽对应的指针一定没被采样
+            static thread_local sampler tsampler;
+        private:
+            /**
+             * @description: 活样本表，第一次用时构造，静态初始化期间的分配也能安全采样
+             * @return {*}
+             */
+            static table &samples ();
+            static size_t slot (const void *p);
+            /**
+             * @description: 抽下一个采样间隔，指数分布，均值是rate
+             * @param {sampler} &s
+             * @param {size_t} r
+             * @return {*}
+             */
+            static int64_t next_interval (sampler &s, size_t r);
+            /**
+             * @description: countdown减到负数时调用，抓栈、记样本、抽下一个间隔
+             * @param {void} *p
+             * @param {size_t} n
+             * @return {*}
+             */
+            static void sample_slow (const void *p, size_t n);
+            /**
+             * @description: 过滤表命中时调用，加锁把p从活样本表删掉
+             * @param {void} *p
+             * @return {*}
+             */
+            static void remove_slow (const void *p);
+            /**
+             * @description: 把地址翻成函数名，找不到符号时输出 模块+偏移 或者十六进制地址
+             * @param {void} *addr
+             * @return {*}
+             */
+            static std::string symbolize (void *addr);
+            static int default_unwinder (void **frames, int max_frames);
+        public:
+            /**
+             * @description: 分配钩子，快速路径只减一次计数
+             * @param {void} *p
+             * @param {size_t} n
+             * @return {*}
+             */
+            static void on_allocate (const void *p, size_t n) {
+                sampler &s = tsampler;
+                s.countdown -= (int64_t) n;
+                if (s.countdown < 0) {
+                    sample_slow(p, n);
+                }
+            }
+            /**
+             * @description: 回收钩子，快速路径只读一次过滤表
+             * @param {void} *p
+             * @return {*}
+             */
+            static void on_deallocate (const void *p) {
+                if (filter[slot(p)].load(std::memory_order_relaxed) != 0) {
+                    remove_slow(p);
+                }
+            }
+            /**
+             * @description: 设置平均采样间隔（字节），0表示不再采样，已有的样本保留
+             * @param {size_t} bytes
+             * @return {*}
+             */
+            static void set_sample_rate (size_t bytes);
+            static size_t sample_rate ();
+            /**
+             * @description: 换一个抓栈的函数，比如基于帧指针或libunwind的，nullptr恢复默认（glibc的backtrace）
+             * @param {alloc_unwinder} fn
+             * @return {*}
+             */
+            static void set_unwinder (alloc_unwinder fn);
+            /**
+             * @description: 活样本数和按采样率折算出来的活着的字节数
+             * @param {size_t} &count
+             * @param {double} &bytes
+             * @return {*}
+             */
+            static void live (size_t &count, double &bytes);
+            /**
+             * @description: 折叠栈格式，每行 最外层;...;最内层 折算字节数，可以直接喂给flamegraph.pl
+             * @param {ostream} &os
+             * @return {*}
+             */
+            static void write_collapsed (std::ostream &os);
+            /**
+             * @description: pprof认的旧版heap profile文本格式（heap_v2），带上/proc/self/maps，用 pprof 程序 文件 离线看
+             * @param {ostream} &os
+             * @return {*}
+             */
+            static void write_pprof (std::ostream &os);
+            /**
+             * @description: 丢掉所有活样本
+             * @return {*}
+             */
+            static void clear ();
+    };
+
+    std::atomic<size_t> alloc_profiler::rate(TINYSTL_ALLOC_SAMPLE_BYTES);
+    std::atomic<alloc_unwinder> alloc_profiler::unwinder(nullptr);
+    std::atomic<uint16_t> alloc_profiler::filter[FILTER_SLOTS] = {};
+    thread_local alloc_profiler::sampler alloc_profiler::tsampler = {0, 0, false, false};
+
+    inline alloc_profiler::table &alloc_profiler::samples () {
+        static table *t = new table();  // 不析构，进程退出时别的线程的free还可能来查
+        return *t;
+    }
+
+    inline size_t alloc_profiler::slot (const void *p) {
+        return (size_t) (((uint64_t) (uintptr_t) p >> 3) * 0x9e3779b97f4a7c15ull >> 50) & (FILTER_SLOTS - 1);
+    }
+
+    inline int64_t alloc_profiler::next_interval (sampler &s, size_t r) {
+        s.rng ^= s.rng << 13;
+        s.rng ^= s.rng >> 7;
+        s.rng ^= s.rng << 17;
+        // 取高53位做(0, 1]上的均匀分布，-ln(u) * rate就是均值为rate的指数分布
+        double u = ((s.rng >> 11) + 1) * (1.0 / 9007199254740992.0);
+        double v = -std::log(u) * (double) r;
+        return v > 4e18 ? (int64_t) 4e18 : (int64_t) v;
+    }
+
+    inline int alloc_profiler::default_unwinder (void **frames, int max_frames) {
+#if defined(__GLIBC__)
+        return backtrace(frames, max_frames);
+#else
+        (void) frames;
+        (void) max_frames;
+        return 0;
+#endif
+    }
+
+    __attribute__((noinline)) void alloc_profiler::sample_slow (const void *p, size_t n) {
+        sampler &s = tsampler;
+        size_t r = rate.load(std::memory_order_relaxed);
+        if (r == 0) {
+            s.countdown = INT64_MAX;
+            s.initialized = false;
+            return;
+        }
+        if (!s.initialized) {
+            // 第一次分配或者重新打开采样，只抽间隔不采样
+            s.rng = (uint64_t) (uintptr_t) &s * 0x9e3779b97f4a7c15ull ^ (uint64_t) (uintptr_t) p;
+            s.rng |= 1;
+            s.initialized = true;
+            s.countdown = next_interval(s, r);
+            return;
+        }
+        s.countdown = next_interval(s, r);
+        if (s.busy) {
+            return;
+        }
+        s.busy = true;
+        sample smp;
+        smp.size = n;
+        smp.weight = (double) n / (1.0 - std::exp(-(double) n / (double) r));
+        smp.rate = r;
+        void *frames[MAX_FRAMES + SKIP_FRAMES];
+        alloc_unwinder fn = unwinder.load(std::memory_order_relaxed);
+        int depth = (fn != nullptr ? fn : default_unwinder)(frames, MAX_FRAMES + SKIP_FRAMES);
+        smp.depth = depth > SKIP_FRAMES ? depth - SKIP_FRAMES : 0;
+        memcpy(smp.frames, frames + (depth > SKIP_FRAMES ? SKIP_FRAMES : 0), smp.depth * sizeof(void *));
+        {
+            table &t = samples();
+            std::lock_guard<std::mutex> guard(t.lock);
+            // 地址被释放后又分配出来之前，free一定清掉了旧样本；这里还有说明那次free没经过钩子，覆盖掉
+            if (t.live.insert_or_assign(p, smp).second) {
+                filter[slot(p)].fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+        s.busy = false;
+    }
+
+    void alloc_profiler::remove_slow (const void *p) {
+        table &t = samples();
+        std::lock_guard<std::mutex> guard(t.lock);
+        if (t.live.erase(p) != 0) {
+            filter[slot(p)].fetch_sub(1, std::memory_order_relaxed);
+        }
+    }
+
+    void alloc_profiler::set_sample_rate (size_t bytes) {
+        rate.store(bytes, std::memory_order_relaxed);
+    }
+
+    size_t alloc_profiler::sample_rate () {
+        return rate.load(std::memory_order_relaxed);
+    }
+
+    void alloc_profiler::set_unwinder (alloc_unwinder fn) {
+        unwinder.store(fn, std::memory_order_relaxed);
+    }
+
+    void alloc_profiler::live (size_t &count, double &bytes) {
+        table &t = samples();
+        std::lock_guard<std::mutex> guard(t.lock);
+        count = t.live.size();
+        bytes = 0;
+        for (const auto &kv : t.live) {
+            bytes += kv.second.weight;
+        }
+    }
+
+    std::string alloc_profiler::symbolize (void *addr) {
+        char buf[64];
+#if defined(__GNUC__) && defined(__linux__)
+        Dl_info info;
+        // 返回地址指向call的下一条指令，减1才落在调用它的函数里
+        if (dladdr((char *) addr - 1, &info) != 0) {
+            if (info.dli_sname != nullptr) {
+                int status = 0;
+                char *demangled = abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status);
+                std::string name = status == 0 && demangled != nullptr ? demangled : info.dli_sname;
+                free(demangled);
+                return name;
+            }
+            if (info.dli_fname != nullptr) {
+                const char *base = strrchr(info.dli_fname, '/');
+                snprintf(buf, sizeof(buf), "+0x%zx", (size_t) ((char *) addr - (char *) info.dli_fbase));
+                return std::string(base != nullptr ? base + 1 : info.dli_fname) + buf;
+            }
+        }
+#endif
+        snprintf(buf, sizeof(buf), "%p", addr);
+        return buf;
+    }
+
+    void alloc_profiler::write_collapsed (std::ostream &os) {
+        // 先在锁里把栈和字节数拷出来，符号化在锁外做
+        std::map<std::vector<void *>, double> stacks;
+        {
+            table &t = samples();
+            std::lock_guard<std::mutex> guard(t.lock);
+            for (const auto &kv : t.live) {
+                const sample &smp = kv.second;
+                stacks[std::vector<void *>(smp.frames, smp.frames + smp.depth)] += smp.weight;
+            }
+        }
+        std::unordered_map<void *, std::string> names;
+        for (const auto &kv : stacks) {
+            const std::vector<void *> &frames = kv.first;
+            std::string line;
+            for (size_t i = frames.size(); i > 0; i--) {
+                void *addr = frames[i - 1];
+                auto it = names.find(addr);
+                if (it == names.end()) {
+                    std::string name = symbolize(addr);
+                    // 折叠栈格式里分号和空格有特殊含义
+                    for (char &c : name) {
+                        if (c == ';' || c == ' ') {
+                            c = '_';
+                        }
+                    }
+                    it = names.emplace(addr, name).first;
+                }
+                if (!line.empty()) {
+                    line += ';';
+                }
+                line += it->second;
+            }
+            if (line.empty()) {
+                line = "[unknown]";
+            }
+            os << line << ' ' << (uint64_t) (kv.second + 0.5) << '\n';
+        }
+    }
+
+    void alloc_profiler::write_pprof (std::ostream &os) {
+        struct bucket {
+            uint64_t count;
+            uint64_t bytes;
+        };
+        std::map<std::vector<void *>, bucket> stacks;
+        uint64_t total_count = 0, total_bytes = 0;
+        size_t r = rate.load(std::memory_order_relaxed);
+        {
+            table &t = samples();
+            std::lock_guard<std::mutex> guard(t.lock);
+            for (const auto &kv : t.live) {
+                const sample &smp = kv.second;
+                bucket &b = stacks[std::vector<void *>(smp.frames, smp.frames + smp.depth)];
+                b.count++;
+                b.bytes += smp.size;
+                total_count++;
+                total_bytes += smp.size;
+                r = smp.rate;
+            }
+        }
+        // heap_v2里是采到的原始计数，pprof自己按采样率折算；只记活着的，分配总量一栏填一样的数
+        char line[128];
+        snprintf(line, sizeof(line), "heap profile: %6llu: %8llu [%6llu: %8llu] @ heap_v2/%zu\n",
+                 (unsigned long long) total_count, (unsigned long long) total_bytes,
+                 (unsigned long long) total_count, (unsigned long long) total_bytes, r);
+        os << line;
+        for (const auto &kv : stacks) {
+            snprintf(line, sizeof(line), "%6llu: %8llu [%6llu: %8llu] @",
+                     (unsigned long long) kv.second.count, (unsigned long long) kv.second.bytes,
+                     (unsigned long long) kv.second.count, (unsigned long long) kv.second.bytes);
+            os << line;
+            for (void *addr : kv.first) {
+                snprintf(line, sizeof(line), " %p", addr);
+                os << line;
+            }
+            os << '\n';
+        }
+        os << "\nMAPPED_LIBRARIES:\n";
+        std::ifstream maps("/proc/self/maps");
+        if (maps) {
+            os << maps.rdbuf();
+        }
+    }
+
+    void alloc_profiler::clear () {
+        table &t = samples();
+        std::lock_guard<std::mutex> guard(t.lock);
+        for (const auto &kv : t.live) {
+            filter[slot(kv.first)].fetch_sub(1, std::memory_order_relaxed);
+        }
+        t.live.clear();
+    }
+} // namespace tinystl
+
+#endif // TINYSTL_ALLOC_PROFILE
+
+#endif
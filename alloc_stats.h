@@ -0,0 +1,147 @@
+/*
+ * @Author: suzy HideSue@github.com
+ * @Date: 2026-10-18 17:02:33
+ * @LastEditors: suzy HideSue@github.com
+ * @LastEditTime: 2026-10-18 23:58:40
+ * @FilePath: /tinystl/alloc_stats.h
+ * @Description: 内存池的统计信息，编译时定义TINYSTL_ALLOC_STATS才会计数，不定义时计数代码全部去掉，快速路径和原来一样
+ *               alloc::stats()拿一份快照，可以按JSON或文本输出
+ *
+ * Copyright (c) 2023 by ${suzy HideSue@github.com}, All Rights Reserved.
+ */
+#ifndef ALLOC_STATS_H
+#define ALLOC_STATS_H
+
+#include<atomic>
+#include<cstddef>
+#include<cstdint>
+#include<ostream>
+#include "size_class.h"
+
+#ifdef TINYSTL_ALLOC_STATS
+#define TINYSTL_STAT(stmt) do { stmt; } while (0)
+#else
+#define TINYSTL_STAT(stmt) do {} while (0)
+#endif
+
+namespace tinystl
+{
+    /**
+     * @description: 只有一个线程写、别的线程偶尔读的计数器，写的时候不用带lock前缀的原子指令
+     */
+    struct stat_counter {
+        std::atomic<uint64_t> value;
+
+        constexpr stat_counter () : value(0) {}
+        void add (uint64_t n) {
+            value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+        }
+        uint64_t get () const {
+            return value.load(std::memory_order_relaxed);
+        }
+    };
+
+    struct alloc_class_stats {
+        size_t size;                // 区块大小
+        uint64_t allocs;            // allocate次数
+        uint64_t frees;             // deallocate次数
+        uint64_t live;              // 在用户手里的区块数
+        uint64_t cached;            // 在各线程缓存里的区块数
+        uint64_t central_free;      // 在中心池freelist上的区块数
+        uint64_t refills;           // 中心池为这个class调用refill的次数
+        size_t refill_batch;        // 下一次refill打算切的区块数（自适应的当前值）
+        size_t high_water;          // 同时从中心池拿出去的区块数的最大值，不开计数也有
+    };
+
+    struct alloc_stats {
+        bool enabled;                           // 编译时是否打开了计数，没打开时只有字节数是有效的
+        alloc_class_stats classes[NFREELISTS];
+        size_t heap_bytes;                      // 小型区块的chunk总字节数
+        size_t in_use_bytes;                    // 小型区块在用户手里的字节数
+        size_t cached_bytes;                    // 小型区块在线程缓存里的字节数
+        size_t central_free_bytes;              // 小型区块在中心池里的字节数
+        size_t page_heap_bytes;                 // 页级区块的chunk总字节数
+        size_t page_in_use_bytes;               // 页级区块在用户手里的字节数
+        size_t page_free_bytes;                 // 页级区块空闲的字节数
+        uint64_t large_allocs;                  // 超过MAX_PAGE_BYTES直接malloc的次数
+        uint64_t large_frees;
+        uint64_t chunks_acquired;               // 向page_source要chunk的次数
+        uint64_t chunks_released;               // 还给page_source的chunk数
+        uint64_t steal_fallbacks;               // 要不到chunk，从更大的freelist里借区块的次数
+        uint64_t oom_failures;                  // 什么都要不到，抛bad_alloc的次数
+
+        /**
+         * @description: 按JSON输出
+         * @param {ostream} &os
+         * @return {*}
+         */
+        void write_json (std::ostream &os) const;
+        /**
+         * @description: 按文本表格输出
+         * @param {ostream} &os
+         * @return {*}
+         */
+        void write_text (std::ostream &os) const;
+    };
+
+    inline void alloc_stats::write_json (std::ostream &os) const {
+        os << "{\"enabled\":" << (enabled ? "true" : "false")
+           << ",\"heap_bytes\":" << heap_bytes
+           << ",\"in_use_bytes\":" << in_use_bytes
+           << ",\"cached_bytes\":" << cached_bytes
+           << ",\"central_free_bytes\":" << central_free_bytes
+           << ",\"page_heap_bytes\":" << page_heap_bytes
+           << ",\"page_in_use_bytes\":" << page_in_use_bytes
+           << ",\"page_free_bytes\":" << page_free_bytes
+           << ",\"large_allocs\":" << large_allocs
+           << ",\"large_frees\":" << large_frees
+           << ",\"chunks_acquired\":" << chunks_acquired
+           << ",\"chunks_released\":" << chunks_released
+           << ",\"steal_fallbacks\":" << steal_fallbacks
+           << ",\"oom_failures\":" << oom_failures
+           << ",\"classes\":[";
+        for (size_t i = 0; i < NFREELISTS; i++) {
+            const alloc_class_stats &c = classes[i];
+            os << (i == 0 ? "" : ",")
+               << "{\"size\":" << c.size
+               << ",\"allocs\":" << c.allocs
+               << ",\"frees\":" << c.frees
+               << ",\"live\":" << c.live
+               << ",\"cached\":" << c.cached
+               << ",\"central_free\":" << c.central_free
+               << ",\"refills\":" << c.refills
+               << ",\"refill_batch\":" << c.refill_batch
+               << ",\"high_water\":" << c.high_water << "}";
+        }
+        os << "]}";
+    }
+
+    inline void alloc_stats::write_text (std::ostream &os) const {
+        os << "tinystl::alloc stats" << (enabled ? "" : " (counters disabled, build with TINYSTL_ALLOC_STATS)") << "\n"
+           << "  small: heap " << heap_bytes << "  in use " << in_use_bytes << "  cached " << cached_bytes
+           << "  central free " << central_free_bytes << "\n"
+           << "  page:  heap " << page_heap_bytes << "  in use " << page_in_use_bytes << "  free " << page_free_bytes << "\n"
+           << "  large: allocs " << large_allocs << "  frees " << large_frees << "\n"
+           << "  chunks acquired " << chunks_acquired << "  released " << chunks_released
+           << "  steal fallbacks " << steal_fallbacks << "  oom " << oom_failures << "\n"
+           << "  size      allocs       frees        live      cached     central     refills   batch  high water\n";
+        for (size_t i = 0; i < NFREELISTS; i++) {
+            const alloc_class_stats &c = classes[i];
+            if (c.allocs == 0 && c.central_free == 0 && c.cached == 0 && c.high_water == 0) {
+                continue;
+            }
+            os.width(6);  os << c.size;
+            os.width(12); os << c.allocs;
+            os.width(12); os << c.frees;
+            os.width(12); os << c.live;
+            os.width(12); os << c.cached;
+            os.width(12); os << c.central_free;
+            os.width(12); os << c.refills;
+            os.width(8);  os << c.refill_batch;
+            os.width(12); os << c.high_water;
+            os << "\n";
+        }
+    }
+} // namespace tinystl
+
+#endif
@@ -0,0 +1,917 @@
+/*
+ * @Author: suzy HideSue@github.com
+ * @Date: 2026-10-18 18:20:41
+ * @LastEditors: suzy HideSue@github.com
+ * @LastEditTime: 2026-10-19 18:05:12
+ * @FilePath: /tinystl/benchmark/alloc_bench.cpp
+ * @Description: tinystl::alloc和malloc、std::allocator的对比测试
+ *               每个用例输出 ns/op、结束时的RSS，以及perf_event_open能用时的cache miss数
+ *               用法：alloc_bench [用例名子串...] [--quick]
+ *
+ * Copyright (c) 2023 by ${suzy HideSue@github.com}, All Rights Reserved.
+ */
+#include<algorithm>
+#include<atomic>
+#include<chrono>
+#include<cstdint>
+#include<cstdio>
+#include<cstdlib>
+#include<cstring>
+#include<fstream>
+#include<iostream>
+#include<list>
+#include<map>
+#include<memory>
+#include<mutex>
+#include<sstream>
+#include<string>
+#include<thread>
+#include<unordered_map>
+#include<vector>
+#if defined(__linux__)
+#include<linux/perf_event.h>
+#include<sys/ioctl.h>
+#include<sys/syscall.h>
+#include<unistd.h>
+#endif
+
+#include "alloc.h"
+#include "alloc_policy.h"
+#include "numa.h"
+#include "object_pool.h"
+#include "parallel.h"
+#include "pool_allocator.h"
+#include "simple_alloc.h"
+#include "uninitialized.h"
+
+namespace
+{
+    // 三种配置器包成同样的静态接口
+    struct tinystl_policy {
+        static const char *name () {
+            return tinystl::ALLOC_HARDENED ? "tinystl(hardened)" : tinystl::ALLOC_PROFILED ? "tinystl(profiled)" : "tinystl::alloc";
+        }
+        static void *allocate (size_t n) { return tinystl::alloc::allocate(n); }
+        static void deallocate (void *p, size_t n) { tinystl::alloc::deallocate(p, n); }
+        static void *reallocate (void *p, size_t old_sz, size_t new_sz) { return tinystl::alloc::reallocate(p, old_sz, new_sz); }
+    };
+
+    struct malloc_policy {
+        static const char *name () { return "malloc"; }
+        static void *allocate (size_t n) { return malloc(n); }
+        static void deallocate (void *p, size_t) { free(p); }
+        static void *reallocate (void *p, size_t, size_t new_sz) { return realloc(p, new_sz); }
+    };
+
+    struct std_policy {
+        static const char *name () { return "std::allocator"; }
+        static void *allocate (size_t n) { return std::allocator<char>().allocate(n); }
+        static void deallocate (void *p, size_t n) { std::allocator<char>().deallocate((char *) p, n); }
+        static void *reallocate (void *p, size_t old_sz, size_t new_sz) {
+            void *r = allocate(new_sz);
+            memcpy(r, p, old_sz < new_sz ? old_sz : new_sz);
+            deallocate(p, old_sz);
+            return r;
+        }
+    };
+
+    /**
+     * @description: 硬件cache miss计数，容器里或者没权限时打不开，输出n/a
+     */
+    class perf_counter {
+        private:
+            int fd;
+        public:
+            perf_counter () : fd(-1) {
+#if defined(__linux__)
+                perf_event_attr attr;
+                memset(&attr, 0, sizeof(attr));
+                attr.type = PERF_TYPE_HARDWARE;
+                attr.size = sizeof(attr);
+                attr.config = PERF_COUNT_HW_CACHE_MISSES;
+                attr.disabled = 1;
+                attr.inherit = 1;           // 把用例里新建的线程也算进来
+                attr.exclude_kernel = 1;
+                attr.exclude_hv = 1;
+                fd = (int) syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+#endif
+            }
+            ~perf_counter () {
+#if defined(__linux__)
+                if (fd >= 0) {
+                    close(fd);
+                }
+#endif
+            }
+            bool available () const { return fd >= 0; }
+            void start () {
+#if defined(__linux__)
+                if (fd >= 0) {
+                    ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+                    ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+                }
+#endif
+            }
+            long long stop () {
+                long long value = -1;
+#if defined(__linux__)
+                if (fd >= 0) {
+                    ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+                    if (read(fd, &value, sizeof(value)) != (ssize_t) sizeof(value)) {
+                        value = -1;
+                    }
+                }
+#endif
+                return value;
+            }
+    };
+
+    long rss_kb () {
+        std::ifstream statm("/proc/self/statm");
+        long pages = 0, resident = 0;
+        if (!(statm >> pages >> resident)) {
+            return -1;
+        }
+#if defined(__linux__)
+        return resident * (sysconf(_SC_PAGESIZE) / 1024);
+#else
+        return resident * 4;
+#endif
+    }
+
+    struct xorshift {
+        uint64_t s;
+        explicit xorshift (uint64_t seed) : s(seed) {}
+        uint64_t next () {
+            s ^= s << 13;
+            s ^= s >> 7;
+            s ^= s << 17;
+            return s;
+        }
+    };
+
+    bool quick = false;
+    std::vector<std::string> filters;
+    perf_counter *cache_misses = nullptr;
+
+    size_t scaled (size_t n) {
+        return quick ? n / 20 + 1 : n;
+    }
+
+    bool selected (const std::string &name) {
+        if (filters.empty()) {
+            return true;
+        }
+        for (const std::string &f : filters) {
+            if (name.find(f) != std::string::npos) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * @description: 跑一个用例，body返回操作次数
+     */
+    template<class Body>
+    void run (const std::string &name, const char *allocator, Body body) {
+        if (!selected(name)) {
+            return;
+        }
+        cache_misses->start();
+        auto t0 = std::chrono::steady_clock::now();
+        size_t ops = body();
+        auto t1 = std::chrono::steady_clock::now();
+        long long misses = cache_misses->stop();
+        double ns = std::chrono::duration<double, std::nano>(t1 - t0).count();
+        char miss_buf[32];
+        if (misses >= 0) {
+            snprintf(miss_buf, sizeof(miss_buf), "%lld", misses);
+        } else {
+            snprintf(miss_buf, sizeof(miss_buf), "n/a");
+        }
+        printf("%-36s %-16s %10.2f ns/op %10ld KB rss %14s cache-misses\n",
+               name.c_str(), allocator, ops ? ns / ops : 0.0, rss_kb(), miss_buf);
+        fflush(stdout);
+    }
+
+    // ---------------- 单线程按size class反复申请释放 ----------------
+    template<class Policy>
+    void bench_churn (size_t size) {
+        enum {BATCH = 64};
+        run("churn/" + std::to_string(size), Policy::name(), [size] {
+            size_t rounds = scaled(200000) * 64 / (size < 64 ? 64 : size) + 100;
+            void *ptrs[BATCH];
+            for (size_t r = 0; r < rounds; r++) {
+                for (size_t i = 0; i < BATCH; i++) {
+                    ptrs[i] = Policy::allocate(size);
+                    *(volatile char *) ptrs[i] = (char) i;
+                }
+                for (size_t i = BATCH; i > 0; i--) {
+                    Policy::deallocate(ptrs[i - 1], size);
+                }
+            }
+            return rounds * BATCH * 2;
+        });
+    }
+
+    // ---------------- 生产者申请、消费者释放 ----------------
+    template<class Policy>
+    void bench_producer_consumer (size_t size) {
+        run("producer-consumer/" + std::to_string(size), Policy::name(), [size] {
+            enum {RING = 1024};
+            size_t total = scaled(2000000);
+            std::vector<std::atomic<void *>> ring(RING);
+            for (auto &slot : ring) {
+                slot.store(nullptr, std::memory_order_relaxed);
+            }
+            std::thread consumer([&] {
+                for (size_t i = 0; i < total; i++) {
+                    std::atomic<void *> &slot = ring[i % RING];
+                    void *p;
+                    while ((p = slot.load(std::memory_order_acquire)) == nullptr) {
+                        std::this_thread::yield();
+                    }
+                    slot.store(nullptr, std::memory_order_relaxed);
+                    Policy::deallocate(p, size);
+                }
+            });
+            for (size_t i = 0; i < total; i++) {
+                void *p = Policy::allocate(size);
+                std::atomic<void *> &slot = ring[i % RING];
+                while (slot.load(std::memory_order_acquire) != nullptr) {
+                    std::this_thread::yield();
+                }
+                slot.store(p, std::memory_order_release);
+            }
+            consumer.join();
+            return total * 2;
+        });
+    }
+
+    // ---------------- 随机大小、随机顺序释放 ----------------
+    size_t random_size (xorshift &rng) {
+        uint64_t r = rng.next();
+        switch (r % 16) {
+            case 0:  return 4096 + r % 60000;   // 偶尔来个中型的
+            case 1:
+            case 2:  return 129 + r % 900;      // 树节点、带负载的哈希桶
+            default: return 8 + r % 120;        // 大部分是小对象
+        }
+    }
+
+    template<class Policy>
+    void bench_random_mix () {
+        run("random-mix", Policy::name(), [] {
+            enum {SLOTS = 8192};
+            std::vector<std::pair<void *, size_t>> slots(SLOTS, std::make_pair((void *) nullptr, (size_t) 0));
+            xorshift rng(42);
+            size_t ops = scaled(3000000);
+            for (size_t i = 0; i < ops; i++) {
+                std::pair<void *, size_t> &slot = slots[rng.next() % SLOTS];
+                if (slot.first != nullptr) {
+                    Policy::deallocate(slot.first, slot.second);
+                }
+                slot.second = random_size(rng);
+                slot.first = Policy::allocate(slot.second);
+                *(volatile char *) slot.first = 1;
+            }
+            for (auto &slot : slots) {
+                if (slot.first != nullptr) {
+                    Policy::deallocate(slot.first, slot.second);
+                }
+            }
+            return ops;
+        });
+    }
+
+    // ---------------- 容器式的几何增长 ----------------
+    template<class Policy>
+    void bench_growth () {
+        run("growth/copy", Policy::name(), [] {
+            size_t rounds = scaled(2000);
+            size_t ops = 0;
+            for (size_t r = 0; r < rounds; r++) {
+                size_t cap = 4;
+                int *buf = (int *) Policy::allocate(cap * sizeof(int));
+                for (size_t n = 0; n < 65536; n++, ops++) {
+                    if (n == cap) {
+                        int *grown = (int *) Policy::allocate(cap * 2 * sizeof(int));
+                        tinystl::uninitialized_copy(buf, buf + n, grown);
+                        Policy::deallocate(buf, cap * sizeof(int));
+                        buf = grown;
+                        cap *= 2;
+                    }
+                    buf[n] = (int) n;
+                }
+                Policy::deallocate(buf, cap * sizeof(int));
+            }
+            return ops;
+        });
+        run("growth/reallocate", Policy::name(), [] {
+            size_t rounds = scaled(2000);
+            size_t ops = 0;
+            for (size_t r = 0; r < rounds; r++) {
+                size_t cap = 4;
+                int *buf = (int *) Policy::allocate(cap * sizeof(int));
+                for (size_t n = 0; n < 65536; n++, ops++) {
+                    if (n == cap) {
+                        buf = (int *) Policy::reallocate(buf, cap * sizeof(int), cap * 2 * sizeof(int));
+                        cap *= 2;
+                    }
+                    buf[n] = (int) n;
+                }
+                Policy::deallocate(buf, cap * sizeof(int));
+            }
+            return ops;
+        });
+        run("growth/node-list", Policy::name(), [] {
+            struct node {
+                node *next;
+                long payload[3];
+            };
+            size_t n = scaled(1000000);
+            node *head = nullptr;
+            for (size_t i = 0; i < n; i++) {
+                node *p = (node *) Policy::allocate(sizeof(node));
+                p->next = head;
+                p->payload[0] = (long) i;
+                head = p;
+            }
+            while (head != nullptr) {
+                node *next = head->next;
+                Policy::deallocate(head, sizeof(node));
+                head = next;
+            }
+            return n * 2;
+        });
+    }
+
+    // ---------------- 工作集反复涨落，对比固定refill批量和自适应批量 ----------------
+    void bench_refill () {
+        size_t n = scaled(200000);
+        std::vector<void *> live(n);
+        const size_t sizes[] = {16, 48, 96, 640};
+        for (size_t size : sizes) {
+            size_t index = tinystl::size_classes.index[(size + tinystl::ALIGN - 1) / tinystl::ALIGN];
+            for (int adaptive = 0; adaptive < 2; adaptive++) {
+                std::string name = std::string(adaptive ? "refill/adaptive/" : "refill/fixed/") + std::to_string(size);
+                if (!selected(name)) {
+                    continue;
+                }
+                // 固定批量就是改之前的行为：上下限都等于线程缓存的搬运批量
+                size_t fixed = tinystl::size_classes.batch[index];
+                tinystl::alloc::set_refill_limits(size, adaptive ? 0 : fixed, adaptive ? 0 : fixed);
+                tinystl::alloc::trim();
+                uint64_t before = tinystl::alloc::stats().classes[index].refills;
+                run(name, tinystl_policy::name(), [&] {
+                    for (size_t r = 0; r < 10; r++) {
+                        for (size_t i = 0; i < n; i++) {
+                            live[i] = tinystl::alloc::allocate(size);
+                        }
+                        for (size_t i = 0; i < n; i++) {
+                            tinystl::alloc::deallocate(live[i], size);
+                        }
+                    }
+                    return n * 20;
+                });
+                tinystl::alloc_class_stats c = tinystl::alloc::stats().classes[index];
+                if (c.refills != before) {
+                    printf("#   %llu refills, batch now %zu\n", (unsigned long long) (c.refills - before), c.refill_batch);
+                }
+            }
+            tinystl::alloc::set_refill_limits(size, 0, 0);
+        }
+    }
+
+    // ---------------- 各节点的线程拿到的区块有多少在别的节点上：一个中心池和按节点分池 ----------------
+    void bench_numa () {
+        enum {WORKING_SET = 4096, SIZE = 64, SAMPLE_STRIDE = 64};
+        // 单节点机器上模拟两个节点，线程按编号指到各节点，区块在哪个节点看chunk头里记的；真的多节点时用move_pages查页
+        bool simulated = tinystl::numa::nodes() < 2;
+        if (simulated) {
+            tinystl::numa::simulate(2);
+        }
+        size_t nodes = tinystl::numa::nodes();
+        size_t threads = 2 * nodes;
+        size_t rounds = scaled(200);
+        for (int per_node = 0; per_node < 2; per_node++) {
+            std::string name = std::string(per_node ? "numa/per-node-pool/" : "numa/single-pool/")
+                + std::to_string(nodes) + (simulated ? "-simulated-nodes" : "-nodes");
+            if (!selected(name)) {
+                continue;
+            }
+            tinystl::alloc::set_node_arenas(per_node != 0);
+            tinystl::alloc::trim();
+            std::atomic<size_t> remote(0), sampled(0);
+            run(name, tinystl_policy::name(), [&] {
+                std::vector<std::thread> workers;
+                for (size_t t = 0; t < threads; t++) {
+                    workers.emplace_back([&, t] {
+                        if (simulated) {
+                            tinystl::numa::set_thread_node((int) (t % nodes));
+                        }
+                        std::vector<void *> live(WORKING_SET);
+                        size_t my_remote = 0, my_sampled = 0;
+                        for (size_t r = 0; r < rounds; r++) {
+                            for (void *&p : live) {
+                                p = tinystl::alloc::allocate(SIZE);
+                                memset(p, (int) t, SIZE);
+                            }
+                            int node = tinystl::numa::current_node();
+                            for (size_t i = 0; i < (size_t) WORKING_SET; i += SAMPLE_STRIDE) {
+                                int home = simulated ? tinystl::alloc::node_of(live[i], SIZE) : tinystl::numa::page_node(live[i]);
+                                if (home >= 0) {
+                                    my_sampled++;
+                                    my_remote += home != node;
+                                }
+                            }
+                            for (void *p : live) {
+                                tinystl::alloc::deallocate(p, SIZE);
+                            }
+                        }
+                        remote += my_remote;
+                        sampled += my_sampled;
+                    });
+                }
+                for (std::thread &w : workers) {
+                    w.join();
+                }
+                return threads * rounds * WORKING_SET * 2;
+            });
+            if (sampled.load() != 0) {
+                printf("#   %.1f%% of sampled blocks on a remote node (%zu samples)\n", 100.0 * remote.load() / sampled.load(), sampled.load());
+            }
+        }
+        tinystl::alloc::set_node_arenas(true);
+        if (simulated) {
+            tinystl::numa::simulate(0);
+        }
+    }
+
+    // ---------------- 启动阶段的延迟：冷启动、按上次的高水位warm_up、稳定运行 ----------------
+    /**
+     * @description: 新线程里一口气建起一个大小混杂的工作集，像服务刚启动时那样，每次allocate单独计时
+     *               六十四分之一是页级区块
+     */
+    std::vector<uint32_t> startup_latencies (size_t n) {
+        const size_t sizes[] = {16, 32, 48, 64, 96, 128, 256, 512, 1024};
+        const size_t page_sizes[] = {6000, 12000, 20000};
+        std::vector<uint32_t> ns(n);
+        std::thread worker([&] {
+            std::vector<void *> live(n);
+            std::vector<size_t> size(n);
+            xorshift rng(42);
+            for (size_t i = 0; i < n; i++) {
+                size[i] = sizes[rng.next() % (sizeof(sizes) / sizeof(sizes[0]))];
+                if (rng.next() % 64 == 0) {
+                    size[i] = page_sizes[rng.next() % (sizeof(page_sizes) / sizeof(page_sizes[0]))];
+                }
+            }
+            for (size_t i = 0; i < n; i++) {
+                auto t0 = std::chrono::steady_clock::now();
+                live[i] = tinystl::alloc::allocate(size[i]);
+                auto t1 = std::chrono::steady_clock::now();
+                *(volatile char *) live[i] = 1;
+                ns[i] = (uint32_t) std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count();
+            }
+            for (size_t i = 0; i < n; i++) {
+                tinystl::alloc::deallocate(live[i], size[i]);
+            }
+        });
+        worker.join();
+        return ns;
+    }
+
+    void bench_warmup () {
+        size_t n = scaled(200000);
+        const char *names[] = {"warmup/cold-start", "warmup/warm-start", "warmup/steady-state"};
+        tinystl::pool_profile profile = {};
+        for (int phase = 0; phase < 3; phase++) {
+            if (!selected(names[phase])) {
+                continue;
+            }
+            if (phase < 2) {
+                // 全部还回去，回到刚启动时中心池空着的状态
+                tinystl::alloc::trim();
+            }
+            if (phase == 1) {
+                tinystl::alloc::warm_up(profile);
+            }
+            tinystl::alloc::reset_high_water();
+            std::vector<uint32_t> ns;
+            run(names[phase], tinystl_policy::name(), [&] {
+                ns = startup_latencies(n);
+                return n;
+            });
+            if (phase == 0) {
+                // 和save/load写文件是同一个格式
+                std::stringstream file;
+                tinystl::alloc::high_water().write_text(file);
+                profile.read_text(file);
+                printf("#   profile: %zu KB\n", profile.bytes() / 1024);
+            }
+            std::sort(ns.begin(), ns.end());
+            printf("#   allocate p50 %u ns, p95 %u ns, p99 %u ns, p99.9 %u ns, max %u ns\n",
+                   ns[ns.size() / 2], ns[ns.size() * 95 / 100], ns[ns.size() * 99 / 100], ns[ns.size() * 999 / 1000], ns.back());
+        }
+    }
+
+    // ---------------- 批量建节点：逐个allocate和allocate_batch ----------------
+    void bench_batch () {
+        struct node {
+            node *next;
+            long payload[3];
+        };
+        size_t n = scaled(1000000);
+        std::vector<node *> nodes(n);
+        run("batch/node-list-single", tinystl_policy::name(), [&] {
+            for (size_t i = 0; i < n; i++) {
+                nodes[i] = tinystl::simple_alloc<node>::allocate();
+                nodes[i]->next = i > 0 ? nodes[i - 1] : nullptr;
+            }
+            for (size_t i = 0; i < n; i++) {
+                tinystl::simple_alloc<node>::deallocate(nodes[i]);
+            }
+            return n * 2;
+        });
+        run("batch/node-list-batch", tinystl_policy::name(), [&] {
+            tinystl::simple_alloc<node>::allocate_batch(nodes.data(), n);
+            for (size_t i = 0; i < n; i++) {
+                nodes[i]->next = i > 0 ? nodes[i - 1] : nullptr;
+            }
+            tinystl::simple_alloc<node>::deallocate_batch(nodes.data(), n);
+            return n * 2;
+        });
+    }
+
+    // ---------------- 每个线程一个计数器：紧挨着分配和按cache line分配 ----------------
+    template<class Alloc>
+    void bench_false_sharing (const char *allocator) {
+        struct counter {
+            volatile long value;
+        };
+        run("false-sharing/4-threads", allocator, [] {
+            enum {THREADS = 4};
+            size_t n = scaled(20000000);
+            counter *counters[THREADS];
+            for (size_t t = 0; t < THREADS; t++) {
+                counters[t] = tinystl::simple_alloc<counter, Alloc>::allocate();
+                counters[t]->value = 0;
+            }
+            std::vector<std::thread> threads;
+            for (size_t t = 0; t < THREADS; t++) {
+                threads.emplace_back([c = counters[t], n] {
+                    for (size_t i = 0; i < n; i++) {
+                        c->value = c->value + 1;
+                    }
+                });
+            }
+            for (std::thread &t : threads) {
+                t.join();
+            }
+            for (size_t t = 0; t < THREADS; t++) {
+                tinystl::simple_alloc<counter, Alloc>::deallocate(counters[t]);
+            }
+            return n * THREADS;
+        });
+    }
+
+    // ---------------- 构造很贵的对象：每次构造析构和object_pool缓存 ----------------
+    struct session {
+        std::mutex lock;
+        std::vector<char> buffer;
+        session () { buffer.reserve(4096); }
+    };
+
+    void bench_object_pool () {
+        enum {LIVE = 64};
+        size_t rounds = scaled(20000);
+        session *live[LIVE];
+        run("object-pool/construct-destroy", "simple_alloc", [&] {
+            for (size_t r = 0; r < rounds; r++) {
+                for (size_t i = 0; i < LIVE; i++) {
+                    live[i] = tinystl::simple_alloc<session>::allocate();
+                    tinystl::construct(live[i]);
+                    live[i]->buffer.push_back((char) i);
+                }
+                for (size_t i = 0; i < LIVE; i++) {
+                    tinystl::destroy(live[i]);
+                    tinystl::simple_alloc<session>::deallocate(live[i]);
+                }
+            }
+            return rounds * LIVE * 2;
+        });
+        tinystl::object_pool<session>::set_reset_hook([] (session &s) { s.buffer.clear(); });
+        run("object-pool/acquire-release", "object_pool", [&] {
+            for (size_t r = 0; r < rounds; r++) {
+                for (size_t i = 0; i < LIVE; i++) {
+                    live[i] = tinystl::object_pool<session>::acquire();
+                    live[i]->buffer.push_back((char) i);
+                }
+                for (size_t i = 0; i < LIVE; i++) {
+                    tinystl::object_pool<session>::release(live[i]);
+                }
+            }
+            return rounds * LIVE * 2;
+        });
+        tinystl::object_pool<session>::trim();
+    }
+
+    // ---------------- simple_alloc换成编译期组合的策略 ----------------
+    struct list_node {
+        list_node *next;
+        long value[3];
+    };
+
+    /**
+     * @description: 每轮建一个LIVE个节点的链表再从头拆掉，像函数里临时用一下的小容器
+     */
+    template<class Alloc>
+    void bench_policy (const char *policy) {
+        enum {LIVE = 64};
+        typedef tinystl::simple_alloc<list_node, Alloc> node_alloc;
+        size_t rounds = scaled(100000);
+        run("policy/node-churn", policy, [rounds] {
+            for (size_t r = 0; r < rounds; r++) {
+                list_node *head = nullptr;
+                for (size_t i = 0; i < LIVE; i++) {
+                    list_node *n = node_alloc::allocate();
+                    n->next = head;
+                    n->value[0] = (long) i;
+                    head = n;
+                }
+                while (head != nullptr) {
+                    list_node *n = head;
+                    head = n->next;
+                    node_alloc::deallocate(n);
+                }
+            }
+            return rounds * LIVE * 2;
+        });
+    }
+
+    void bench_policies () {
+        using namespace tinystl;
+        bench_policy<alloc>("alloc");
+        // 阈值比节点大，分支编译期定下来，应该和直接用alloc一样快
+        bench_policy<segregator_alloc<256, alloc, alloc>>("segregator");
+        bench_policy<fallback_alloc<stack_buffer_alloc<4096>, alloc>>("stack+fallback");
+        bench_policy<freelist_alloc<alloc, 17, 32>>("freelist");
+        bench_policy<stats_alloc<alloc>>("stats");
+    }
+
+    // ---------------- 标准库容器换成pool_allocator ----------------
+    template<template<class> class Allocator>
+    void bench_std_containers (const char *allocator) {
+        size_t n = scaled(500000);
+        run("std::list/push-pop", allocator, [n] {
+            std::list<long, Allocator<long>> l;
+            for (size_t r = 0; r < 4; r++) {
+                for (size_t i = 0; i < n; i++) {
+                    l.push_back((long) i);
+                }
+                while (!l.empty()) {
+                    l.pop_front();
+                }
+            }
+            return n * 8;
+        });
+        run("std::map/insert-erase", allocator, [n] {
+            std::map<long, long, std::less<long>, Allocator<std::pair<const long, long>>> m;
+            xorshift rng(7);
+            for (size_t i = 0; i < n; i++) {
+                m[(long) (rng.next() % (n * 4))] = (long) i;
+            }
+            for (size_t i = 0; i < n; i++) {
+                m.erase((long) (rng.next() % (n * 4)));
+            }
+            return n * 2;
+        });
+        run("std::unordered_map/insert-erase", allocator, [n] {
+            std::unordered_map<long, long, std::hash<long>, std::equal_to<long>, Allocator<std::pair<const long, long>>> m;
+            xorshift rng(11);
+            for (size_t i = 0; i < n; i++) {
+                m[(long) (rng.next() % (n * 4))] = (long) i;
+            }
+            for (size_t i = 0; i < n; i++) {
+                m.erase((long) (rng.next() % (n * 4)));
+            }
+            return n * 2;
+        });
+        run("std::vector/push-back", allocator, [n] {
+            size_t ops = 0;
+            for (size_t r = 0; r < 20; r++) {
+                std::vector<int, Allocator<int>> v;
+                for (size_t i = 0; i < n; i++, ops++) {
+                    v.push_back((int) i);
+                }
+            }
+            return ops;
+        });
+    }
+
+    template<class T>
+    using pool_allocator = tinystl::pool_allocator<T>;
+
+    // ---------------- uninitialized_copy / uninitialized_fill_n 吞吐 ----------------
+    struct pod_record {
+        int id;
+        double x, y, z;
+    };
+
+    // 有非平凡拷贝构造，type_traits里是false_type，走逐个construct
+    struct non_pod_record {
+        int id;
+        double x, y, z;
+        non_pod_record () : id(0), x(0), y(0), z(0) {}
+        non_pod_record (const non_pod_record &o) : id(o.id), x(o.x), y(o.y), z(o.z) {}
+    };
+
+    template<class T>
+    void bench_uninitialized (const char *type_name, const T &value) {
+        size_t count = 1 << 20;  // 每次处理的元素个数
+        size_t rounds = scaled(200);
+        std::string suffix = std::string("/") + type_name;
+        T *src = (T *) malloc(count * sizeof(T));
+        T *dst = (T *) malloc(count * sizeof(T));
+        for (size_t i = 0; i < count; i++) {
+            new (src + i) T(value);
+        }
+        run("uninitialized_copy" + suffix, "ns/element", [&] {
+            for (size_t r = 0; r < rounds; r++) {
+                tinystl::uninitialized_copy(src, src + count, dst);
+                tinystl::destroy(dst, dst + count);
+            }
+            return rounds * count;
+        });
+        run("uninitialized_fill_n" + suffix, "ns/element", [&] {
+            for (size_t r = 0; r < rounds; r++) {
+                tinystl::uninitialized_fill_n(dst, count, value);
+                tinystl::destroy(dst, dst + count);
+            }
+            return rounds * count;
+        });
+        tinystl::destroy(src, src + count);
+        free(src);
+        free(dst);
+    }
+
+    // ---------------- 扩容时把元素搬到新缓冲区：复制、移动、relocate ----------------
+    // 只有一个堆指针的类型，标记成trivially relocatable，relocate整段memcpy
+    struct boxed {
+        int *p;
+        explicit boxed (int v) : p(new int(v)) {}
+        boxed (const boxed &o) : p(new int(*o.p)) {}
+        boxed (boxed &&o) noexcept : p(o.p) { o.p = nullptr; }
+        ~boxed () { delete p; }
+    };
+} // namespace
+
+namespace tinystl
+{
+    template<>
+    struct type_traits<boxed> {
+        typedef false_type has_trivial_default_constructor;
+        typedef false_type has_trivial_copy_constructor;
+        typedef false_type has_trivial_assignment_constructor;
+        typedef false_type has_trivial_destructor;
+        typedef false_type is_POD_type;
+        typedef true_type is_trivially_relocatable;
+    };
+} // namespace tinystl
+
+namespace
+{
+    template<class T>
+    void bench_relocate (const char *type_name, const T &value) {
+        size_t count = 1 << 16;
+        size_t rounds = scaled(100);
+        std::string suffix = std::string("/") + type_name;
+        T *a = (T *) malloc(count * sizeof(T));
+        T *b = (T *) malloc(count * sizeof(T));
+        tinystl::uninitialized_fill_n(a, count, value);
+        // 每轮把a的元素搬到b再搬回来，和vector扩容时一样旧元素不再用
+        run("relocate-by-copy" + suffix, "ns/element", [&] {
+            for (size_t r = 0; r < rounds; r++) {
+                tinystl::uninitialized_copy(a, a + count, b);
+                tinystl::destroy(a, a + count);
+                std::swap(a, b);
+            }
+            return rounds * count;
+        });
+        run("relocate-by-move" + suffix, "ns/element", [&] {
+            for (size_t r = 0; r < rounds; r++) {
+                tinystl::uninitialized_move(a, a + count, b);
+                tinystl::destroy(a, a + count);
+                std::swap(a, b);
+            }
+            return rounds * count;
+        });
+        run("relocate" + suffix, "ns/element", [&] {
+            for (size_t r = 0; r < rounds; r++) {
+                tinystl::uninitialized_relocate(a, a + count, b);
+                std::swap(a, b);
+            }
+            return rounds * count;
+        });
+        tinystl::destroy(a, a + count);
+        free(a);
+        free(b);
+    }
+
+    // ---------------- 大缓冲区初始化：串行和par ----------------
+    void bench_parallel () {
+        size_t n = scaled(256 * 1024 * 1024) / sizeof(long);
+        std::string suffix = "/" + std::to_string(tinystl::thread_pool::instance().concurrency()) + "-threads";
+        // 每次都是刚malloc的缓冲区，页还没碰过，初始化的时间里包括缺页
+        auto fresh = [n] { return (long *) malloc(n * sizeof(long)); };
+        run("parallel/fill_n-serial" + suffix, "ns/element", [&] {
+            long *a = fresh();
+            tinystl::uninitialized_fill_n(a, n, 0x5a5a5a5a1L);
+            free(a);
+            return n;
+        });
+        run("parallel/fill_n-par" + suffix, "ns/element", [&] {
+            long *a = fresh();
+            tinystl::uninitialized_fill_n(tinystl::par, a, n, 0x5a5a5a5a1L);
+            free(a);
+            return n;
+        });
+        long *src = fresh();
+        tinystl::uninitialized_fill_n(tinystl::par, src, n, 3L);
+        run("parallel/copy-serial" + suffix, "ns/element", [&] {
+            long *a = fresh();
+            tinystl::uninitialized_copy(src, src + n, a);
+            free(a);
+            return n;
+        });
+        run("parallel/copy-par" + suffix, "ns/element", [&] {
+            long *a = fresh();
+            tinystl::uninitialized_copy(tinystl::par, src, src + n, a);
+            free(a);
+            return n;
+        });
+        free(src);
+    }
+
+    template<class Policy>
+    void bench_allocator () {
+        const size_t sizes[] = {8, 16, 32, 64, 128, 256, 512, 1024, 2048, 4096, 16384, 65536};
+        for (size_t size : sizes) {
+            bench_churn<Policy>(size);
+        }
+        bench_producer_consumer<Policy>(64);
+        bench_producer_consumer<Policy>(512);
+        bench_random_mix<Policy>();
+        bench_growth<Policy>();
+    }
+} // namespace
+
+int main (int argc, char **argv) {
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--quick") == 0) {
+            quick = true;
+        } else {
+            filters.push_back(argv[i]);
+        }
+    }
+    perf_counter counter;
+    cache_misses = &counter;
+    if (!counter.available()) {
+        printf("# perf_event_open不可用，cache miss输出n/a\n");
+    }
+
+    bench_allocator<tinystl_policy>();
+    bench_allocator<malloc_policy>();
+    bench_allocator<std_policy>();
+    bench_batch();
+    bench_refill();
+    bench_numa();
+    bench_warmup();
+    bench_std_containers<std::allocator>("std::allocator");
+    bench_std_containers<pool_allocator>("pool_allocator");
+    bench_false_sharing<tinystl::alloc>("tinystl::alloc");
+    bench_false_sharing<tinystl::cacheline_alloc>("cacheline_alloc");
+    bench_object_pool();
+    bench_policies();
+
+    bench_uninitialized<int>("int", 7);
+    bench_uninitialized<pod_record>("pod_record", pod_record{1, 2.0, 3.0, 4.0});
+    bench_uninitialized<non_pod_record>("non_pod_record", non_pod_record());
+    bench_uninitialized<std::string>("std::string", std::string("a string that does not fit SSO"));
+
+    bench_relocate<std::string>("std::string", std::string("a string that does not fit SSO"));
+    bench_relocate<boxed>("boxed", boxed(1));
+    bench_parallel();
+
+#ifdef TINYSTL_ALLOC_STATS
+    tinystl::alloc::stats().write_text(std::cout);
+#endif
+#ifdef TINYSTL_ALLOC_PROFILE
+    printf("# live heap samples (collapsed stacks)\n");
+    fflush(stdout);
+    tinystl::alloc_profiler::write_collapsed(std::cout);
+#endif
+    return 0;
+}
@@ -2,7 +2,7 @@
  * @Author: suzy HideSue@github.com
  * @Date: 2023-11-24 15:57:51
  * @LastEditors: suzy HideSue@github.com
- * @LastEditTime: 2023-11-25 19:10:35
+ * @LastEditTime: 2026-10-18 19:14:38
  * @FilePath: /tinystl/construct.h
  * @Description: 一些全局函数，包含构造、销毁
  * 
@@ -12,13 +12,20 @@
 #define CONSTRUCT_H
 
 #include<new>
+#include<utility>
 #include "type_traits.h"
 
 namespace tinystl
 {
-    template<class T1, class T2>
-    inline void construct (T1 *p, T2 &value) {
-        new(p) T1(value); // placement new， 在p位置处构造value
+    /**
+     * @description: placement new，在p位置处用args构造一个T，参数原样转发，右值会走移动构造
+     * @param {T} *p
+     * @param {Args} &&args
+     * @return {*}
+     */
+    template<class T, class... Args>
+    inline void construct (T *p, Args &&...args) {
+        new((void *) p) T(std::forward<Args>(args)...);
     }
 
     template <class T>
@@ -0,0 +1,207 @@
+/*
+ * @Author: suzy HideSue@github.com
+ * @Date: 2026-10-18 18:34:06
+ * @LastEditors: suzy HideSue@github.com
+ * @LastEditTime: 2026-10-18 18:52:27
+ * @FilePath: /tinystl/memory_ops.h
+ * @Description: 按字节搬运、填充内存的底层函数，给uninitialized系列的POD快速路径用
+ *               小的交给memmove，特别大的不重叠的缓冲区用non-temporal store绕过cache直接写内存，
+ *               不会把源数据和cache里别的热数据挤出去，也省掉写目标之前先读一遍目标行（RFO）
+ *               填充时每个字节都一样的值用memset，否则把值铺成一个向量反复写，运行时检查CPU支不支持AVX2
+ *
+ * Copyright (c) 2023 by ${suzy HideSue@github.com}, All Rights Reserved.
+ */
+#ifndef MEMORY_OPS_H
+#define MEMORY_OPS_H
+
+#include<cstddef>
+#include<cstdint>
+#include<cstring>
+#if defined(__SSE2__)
+#include<emmintrin.h>
+#endif
+#if defined(__GNUC__) && defined(__x86_64__)
+#include<immintrin.h>
+#define TINYSTL_HAS_AVX2_DISPATCH 1
+#endif
+
+// 超过这么多字节并且源和目标不重叠时走streaming store，要明显大于L2才划算
+#ifndef TINYSTL_STREAM_COPY_BYTES
+#define TINYSTL_STREAM_COPY_BYTES (8 * 1024 * 1024)
+#endif
+
+namespace tinystl
+{
+    enum {STREAM_COPY_BYTES = TINYSTL_STREAM_COPY_BYTES};
+
+#if defined(__SSE2__)
+    /**
+     * @description: 目标先按16字节对齐，每次读64字节、用_mm_stream_si128写出去，最后sfence让写入对别的线程可见
+     * @param {void} *dst
+     * @param {void} *src
+     * @param {size_t} n
+     * @return {*}
+     */
+    inline void __stream_copy (void *dst, const void *src, size_t n) {
+        char *d = (char *) dst;
+        const char *s = (const char *) src;
+        size_t head = (16 - ((uintptr_t) d & 15)) & 15;
+        memcpy(d, s, head);
+        d += head;
+        s += head;
+        n -= head;
+        for (; n >= 64; n -= 64, d += 64, s += 64) {
+            __m128i x0 = _mm_loadu_si128((const __m128i *) s);
+            __m128i x1 = _mm_loadu_si128((const __m128i *) (s + 16));
+            __m128i x2 = _mm_loadu_si128((const __m128i *) (s + 32));
+            __m128i x3 = _mm_loadu_si128((const __m128i *) (s + 48));
+            _mm_stream_si128((__m128i *) d, x0);
+            _mm_stream_si128((__m128i *) (d + 16), x1);
+            _mm_stream_si128((__m128i *) (d + 32), x2);
+            _mm_stream_si128((__m128i *) (d + 48), x3);
+        }
+        _mm_sfence();
+        memcpy(d, s, n);
+    }
+#endif
+
+#if defined(TINYSTL_HAS_AVX2_DISPATCH)
+    /**
+     * @description: AVX2版本的__fill_pattern，只在__builtin_cpu_supports("avx2")为真时调用
+     * @param {char} *d
+     * @param {char} *pattern
+     * @param {size_t} size
+     * @param {size_t} bytes
+     * @return {*}
+     */
+    __attribute__((target("avx2")))
+    inline void __fill_pattern_avx2 (char *d, const char *pattern, size_t size, size_t bytes) {
+        size_t head = (32 - ((uintptr_t) d & 31)) & 31;
+        if (head > bytes) {
+            head = bytes;
+        }
+        memcpy(d, pattern, head);
+        d += head;
+        bytes -= head;
+        const char *p = pattern + head % size;
+        __m256i v = _mm256_loadu_si256((const __m256i *) p);
+        if (bytes >= (size_t) STREAM_COPY_BYTES) {
+            for (; bytes >= 64; bytes -= 64, d += 64) {
+                _mm256_stream_si256((__m256i *) d, v);
+                _mm256_stream_si256((__m256i *) (d + 32), v);
+            }
+            _mm_sfence();
+        } else {
+            for (; bytes >= 64; bytes -= 64, d += 64) {
+                _mm256_store_si256((__m256i *) d, v);
+                _mm256_store_si256((__m256i *) (d + 32), v);
+            }
+        }
+        memcpy(d, p, bytes);
+    }
+#endif
+
+    /**
+     * @description: 没有AVX2时用的版本，x86-64上是SSE2，别的平台每次memcpy 32字节
+     * @param {char} *d
+     * @param {char} *pattern
+     * @param {size_t} size
+     * @param {size_t} bytes
+     * @return {*}
+     */
+    inline void __fill_pattern_sse2 (char *d, const char *pattern, size_t size, size_t bytes) {
+#if defined(__SSE2__)
+        size_t head = (16 - ((uintptr_t) d & 15)) & 15;
+        if (head > bytes) {
+            head = bytes;
+        }
+        memcpy(d, pattern, head);
+        d += head;
+        bytes -= head;
+        const char *p = pattern + head % size;
+        // 元素可能有32字节，一个16字节的向量装不下一个周期，所以用两个交替写
+        __m128i v0 = _mm_loadu_si128((const __m128i *) p);
+        __m128i v1 = _mm_loadu_si128((const __m128i *) (p + 16));
+        if (bytes >= (size_t) STREAM_COPY_BYTES) {
+            for (; bytes >= 64; bytes -= 64, d += 64) {
+                _mm_stream_si128((__m128i *) d, v0);
+                _mm_stream_si128((__m128i *) (d + 16), v1);
+                _mm_stream_si128((__m128i *) (d + 32), v0);
+                _mm_stream_si128((__m128i *) (d + 48), v1);
+            }
+            _mm_sfence();
+        } else {
+            for (; bytes >= 64; bytes -= 64, d += 64) {
+                _mm_store_si128((__m128i *) d, v0);
+                _mm_store_si128((__m128i *) (d + 16), v1);
+                _mm_store_si128((__m128i *) (d + 32), v0);
+                _mm_store_si128((__m128i *) (d + 48), v1);
+            }
+        }
+        memcpy(d, p, bytes);
+#else
+        (void) size;
+        for (; bytes >= 32; bytes -= 32, d += 32) {
+            memcpy(d, pattern, 32);
+        }
+        memcpy(d, pattern, bytes);
+#endif
+    }
+
+    /**
+     * @description: 把size字节的value连续写n份到dst，size必须能整除32
+     *               每个字节都一样（0、-1、全是同一个char）时直接memset
+     * @param {void} *dst
+     * @param {void} *value
+     * @param {size_t} size
+     * @param {size_t} n
+     * @return {*}
+     */
+    inline void __memory_fill (void *dst, const void *value, size_t size, size_t n) {
+        const unsigned char *v = (const unsigned char *) value;
+        size_t bytes = size * n;
+        size_t i = 1;
+        while (i < size && v[i] == v[0]) {
+            i++;
+        }
+        if (i == size) {
+            memset(dst, v[0], bytes);
+            return;
+        }
+        // 按value铺满128字节，从任意一个元素边界内的偏移开始都能读出完整的一个向量加64字节的尾巴
+        alignas(32) char pattern[128];
+        for (i = 0; i < sizeof(pattern); i++) {
+            pattern[i] = (char) v[i % size];
+        }
+#if defined(TINYSTL_HAS_AVX2_DISPATCH)
+        static const bool has_avx2 = __builtin_cpu_supports("avx2");
+        if (has_avx2) {
+            __fill_pattern_avx2((char *) dst, pattern, size, bytes);
+            return;
+        }
+#endif
+        __fill_pattern_sse2((char *) dst, pattern, size, bytes);
+    }
+
+    /**
+     * @description: 把[src, src + n)搬到dst，允许重叠
+     * @param {void} *dst
+     * @param {void} *src
+     * @param {size_t} n
+     * @return {*}
+     */
+    inline void __memory_copy (void *dst, const void *src, size_t n) {
+#if defined(__SSE2__)
+        if (n >= (size_t) STREAM_COPY_BYTES) {
+            uintptr_t d = (uintptr_t) dst, s = (uintptr_t) src;
+            if (d + n <= s || s + n <= d) {
+                __stream_copy(dst, src, n);
+                return;
+            }
+        }
+#endif
+        memmove(dst, src, n);
+    }
+} // namespace tinystl
+
+#endif
@@ -0,0 +1,332 @@
+/*
+ * @Author: suzy HideSue@github.com
+ * @Date: 2026-10-18 16:05:12
+ * @LastEditors: suzy HideSue@github.com
+ * @LastEditTime: 2026-10-19 19:42:10
+ * @FilePath: /tinystl/monotonic_arena.h
+ * @Description: 单调（只增不减）的arena，分配就是挪指针，deallocate什么都不做，用完一次性释放
+ *               monotonic_arena是有状态的对象，可以先用栈上的缓冲区，不够再向alloc要越来越大的块串起来
+ *               arena_alloc是静态接口，和alloc一样可以给simple_alloc用，分配走当前线程arena_scope绑定的arena
+ *               增长块按整页向alloc要，每页的主人记在一张按页号索引的表里，释放时不加锁、O(1)就能认出arena分出去的指针
+ *
+ * Copyright (c) 2023 by ${suzy HideSue@github.com}, All Rights Reserved.
+ */
+#ifndef MONOTONIC_ARENA_H
+#define MONOTONIC_ARENA_H
+
+#include<atomic>
+#include<cstddef>
+#include<cstdint>
+#include<new>
+#include "alloc.h"
+
+namespace tinystl
+{
+    class monotonic_arena {
+        private:
+            /**
+             * @description: 向alloc要的增长块，按页对齐、大小是整页，块头后面就是可用空间
+             */
+            struct block {
+                block *next;
+                size_t size;    // 整个块的大小，包括块头
+            };
+            enum {BLOCK_HEADER_BYTES = (sizeof(block) + ALIGN - 1) & ~(ALIGN - 1)};
+            enum {MAX_BLOCK_BYTES = 1024 * 1024};  // 增长块翻倍到这么大就不再翻了
+            /**
+             * @description: 页主人表，页号按OWNER_BITS位一段分三层，4K页时覆盖48位地址
+             *               中间层和叶子按需分配，装上后不再拆，查一次只有三次load
+             */
+            enum {OWNER_BITS = 12, OWNER_FANOUT = 1 << OWNER_BITS};
+            struct owner_leaf {
+                std::atomic<monotonic_arena *> page[OWNER_FANOUT];
+            };
+            struct owner_mid {
+                std::atomic<owner_leaf *> leaf[OWNER_FANOUT];
+            };
+        private:
+            char *cur;                  // 当前块的可用位置
+            char *end;                  // 当前块的结束位置
+            block *blocks;              // 增长块链表，最新的在表头
+            char *initial_buffer;       // 构造时给的缓冲区，不归arena释放
+            size_t initial_size;
+            size_t next_block_size;     // 下一个增长块的大小
+            size_t first_block_size;
+        private:
+            static std::atomic<owner_mid *> owner_top[OWNER_FANOUT];
+        private:
+            /**
+             * @description: p所在页在主人表里的格子，create为false时表里还没有这一段就返回nullptr
+             * @param {void} *p
+             * @param {bool} create
+             * @return {*}
+             */
+            static std::atomic<monotonic_arena *> *owner_slot (const void *p, bool create);
+            /**
+             * @description: 把从p开始size字节（整页）的主人都记成owner，owner为nullptr就是清掉
+             * @param {void} *p
+             * @param {size_t} size
+             * @param {monotonic_arena} *owner
+             * @return {*}
+             */
+            static void set_owner (const void *p, size_t size, monotonic_arena *owner);
+            /**
+             * @description: 当前块放不下时调用，要一个新块再分配
+             * @param {size_t} n
+             * @param {size_t} align
+             * @return {*}
+             */
+            void *allocate_slow (size_t n, size_t align);
+        public:
+            /**
+             * @description: 没有初始缓冲区，第一次分配时要一个block_size大小的块
+             * @param {size_t} block_size
+             * @return {*}
+             */
+            explicit monotonic_arena (size_t block_size = 4096);
+            /**
+             * @description: 先用调用者给的缓冲区（比如栈上的数组），用完再要增长块
+             * @param {void} *buffer
+             * @param {size_t} size
+             * @return {*}
+             */
+            monotonic_arena (void *buffer, size_t size);
+            ~monotonic_arena ();
+            monotonic_arena (const monotonic_arena &) = delete;
+            monotonic_arena &operator= (const monotonic_arena &) = delete;
+
+            /**
+             * @description: 挪指针分配n字节，按align对齐
+             * @param {size_t} n
+             * @param {size_t} align 2的幂
+             * @return {*}
+             */
+            void *allocate (size_t n, size_t align = ALIGN);
+            /**
+             * @description: 什么都不做，内存等release时一起还
+             * @return {*}
+             */
+            void deallocate (void *, size_t) {}
+            /**
+             * @description: 一次性释放所有增长块，回到只有初始缓冲区的状态
+             * @return {*}
+             */
+            void release ();
+            /**
+             * @description: p是不是在构造时给的缓冲区里
+             * @param {void} *p
+             * @return {*}
+             */
+            bool in_buffer (const void *p) const {
+                return (const char *) p >= initial_buffer && (const char *) p < initial_buffer + initial_size;
+            }
+            /**
+             * @description: p是不是从这个arena分出去的，查初始缓冲区和页主人表，O(1)
+             * @param {void} *p
+             * @return {*}
+             */
+            bool owns (const void *p) const;
+            /**
+             * @description: p是不是在任意一个arena的增长块里，不管是哪个线程的、在不在它的scope里；不加锁，O(1)
+             *               别的arena的初始缓冲区不在表里，查不到
+             * @param {void} *p
+             * @return {*}
+             */
+            static bool any_owns (const void *p);
+    };
+
+    std::atomic<monotonic_arena::owner_mid *> monotonic_arena::owner_top[OWNER_FANOUT];
+
+    std::atomic<monotonic_arena *> *monotonic_arena::owner_slot (const void *p, bool create) {
+        uintptr_t page = (uintptr_t) p / PAGE_SIZE;
+        uintptr_t top = page >> (2 * OWNER_BITS);
+        if (top >= (uintptr_t) OWNER_FANOUT) {
+            return nullptr;
+        }
+        owner_mid *mid = owner_top[top].load(std::memory_order_acquire);
+        if (mid == nullptr) {
+            if (!create) {
+                return nullptr;
+            }
+            // 两个线程同时装同一格时，输的把自己的删掉用赢的
+            owner_mid *fresh = new owner_mid();
+            if (owner_top[top].compare_exchange_strong(mid, fresh, std::memory_order_acq_rel)) {
+                mid = fresh;
+            } else {
+                delete fresh;
+            }
+        }
+        std::atomic<owner_leaf *> &slot = mid->leaf[(page >> OWNER_BITS) & (OWNER_FANOUT - 1)];
+        owner_leaf *leaf = slot.load(std::memory_order_acquire);
+        if (leaf == nullptr) {
+            if (!create) {
+                return nullptr;
+            }
+            owner_leaf *fresh = new owner_leaf();
+            if (slot.compare_exchange_strong(leaf, fresh, std::memory_order_acq_rel)) {
+                leaf = fresh;
+            } else {
+                delete fresh;
+            }
+        }
+        return &leaf->page[page & (OWNER_FANOUT - 1)];
+    }
+
+    void monotonic_arena::set_owner (const void *p, size_t size, monotonic_arena *owner) {
+        for (size_t off = 0; off < size; off += PAGE_SIZE) {
+            std::atomic<monotonic_arena *> *slot = owner_slot((const char *) p + off, owner != nullptr);
+            if (slot == nullptr) {
+                if (owner == nullptr) {
+                    continue;
+                }
+                // 地址超出表能覆盖的范围，登记不了
+                throw std::bad_alloc();
+            }
+            slot->store(owner, std::memory_order_release);
+        }
+    }
+
+    bool monotonic_arena::any_owns (const void *p) {
+        std::atomic<monotonic_arena *> *slot = owner_slot(p, false);
+        return slot != nullptr && slot->load(std::memory_order_acquire) != nullptr;
+    }
+
+    monotonic_arena::monotonic_arena (size_t block_size)
+        : cur(nullptr), end(nullptr), blocks(nullptr), initial_buffer(nullptr), initial_size(0),
+          next_block_size(block_size), first_block_size(block_size) {}
+
+    monotonic_arena::monotonic_arena (void *buffer, size_t size)
+        : cur((char *) buffer), end((char *) buffer + size), blocks(nullptr), initial_buffer((char *) buffer), initial_size(size),
+          next_block_size(size < 4096 ? 4096 : size * 2), first_block_size(next_block_size) {}
+
+    monotonic_arena::~monotonic_arena () {
+        release();
+    }
+
+    inline void *monotonic_arena::allocate (size_t n, size_t align) {
+        char *p = (char *) (((uintptr_t) cur + align - 1) & ~(uintptr_t) (align - 1));
+        if (p > end || (size_t) (end - p) < n) {
+            return allocate_slow(n, align);
+        }
+        cur = p + n;
+        return p;
+    }
+
+    void *monotonic_arena::allocate_slow (size_t n, size_t align) {
+        size_t need = BLOCK_HEADER_BYTES + n + align - 1;
+        size_t size = next_block_size < need ? need : next_block_size;
+        // 按页对齐、取整页，块里的每一页都只属于这个arena，主人表按页记就不会和别人的内存混在一起
+        size = (size + PAGE_SIZE - 1) & ~(size_t) (PAGE_SIZE - 1);
+        block *b = (block *) alloc::allocate_aligned(size, PAGE_SIZE);
+        try {
+            set_owner(b, size, this);
+        } catch (...) {
+            set_owner(b, size, nullptr);
+            alloc::deallocate_aligned(b, size, PAGE_SIZE);
+            throw;
+        }
+        b->next = blocks;
+        b->size = size;
+        blocks = b;
+        cur = (char *) b + BLOCK_HEADER_BYTES;
+        end = (char *) b + size;
+        if (next_block_size < MAX_BLOCK_BYTES) {
+            next_block_size *= 2;
+        }
+        char *p = (char *) (((uintptr_t) cur + align - 1) & ~(uintptr_t) (align - 1));
+        cur = p + n;
+        return p;
+    }
+
+    void monotonic_arena::release () {
+        while (blocks != nullptr) {
+            block *next = blocks->next;
+            set_owner(blocks, blocks->size, nullptr);
+            alloc::deallocate_aligned(blocks, blocks->size, PAGE_SIZE);
+            blocks = next;
+        }
+        cur = initial_buffer;
+        end = initial_buffer + initial_size;
+        next_block_size = first_block_size;
+    }
+
+    bool monotonic_arena::owns (const void *p) const {
+        if (in_buffer(p)) {
+            return true;
+        }
+        std::atomic<monotonic_arena *> *slot = owner_slot(p, false);
+        return slot != nullptr && slot->load(std::memory_order_acquire) == this;
+    }
+
+    /**
+     * @description: 静态接口，接口和alloc一样，simple_alloc<T, arena_alloc>即可
+     *               当前线程有arena_scope时从它绑定的arena分配，没有时退回alloc
+     *               释放时先看是不是当前arena的初始缓冲区，再查页主人表，都不是才还给alloc，不加锁
+     */
+    class arena_alloc {
+        private:
+            static thread_local monotonic_arena *current;
+            friend class arena_scope;
+        public:
+            static void *allocate (size_t n) {
+                monotonic_arena *arena = current;
+                return arena != nullptr ? arena->allocate(n) : alloc::allocate(n);
+            }
+            static void deallocate (void *p, size_t n) {
+                // arena分出去的什么都不用做，不是arena分出去的（在scope外分配的）还给alloc
+                // 增长块里的不管是哪个arena的、在不在scope里都查得到；初始缓冲区只认当前arena的
+                monotonic_arena *arena = current;
+                if ((arena == nullptr || !arena->in_buffer(p)) && !monotonic_arena::any_owns(p)) {
+                    alloc::deallocate(p, n);
+                }
+            }
+            static void *allocate_aligned (size_t n, size_t alignment) {
+                monotonic_arena *arena = current;
+                return arena != nullptr ? arena->allocate(n, alignment) : alloc::allocate_aligned(n, alignment);
+            }
+            static void deallocate_aligned (void *p, size_t n, size_t alignment) {
+                monotonic_arena *arena = current;
+                if ((arena == nullptr || !arena->in_buffer(p)) && !monotonic_arena::any_owns(p)) {
+                    alloc::deallocate_aligned(p, n, alignment);
+                }
+            }
+            static void allocate_batch (size_t n, void **out, size_t count) {
+                monotonic_arena *arena = current;
+                if (arena == nullptr) {
+                    alloc::allocate_batch(n, out, count);
+                    return;
+                }
+                for (size_t i = 0; i < count; i++) {
+                    out[i] = arena->allocate(n);
+                }
+            }
+            static void deallocate_batch (void **ptrs, size_t count, size_t n) {
+                for (size_t i = 0; i < count; i++) {
+                    deallocate(ptrs[i], n);
+                }
+            }
+    };
+
+    thread_local monotonic_arena *arena_alloc::current = nullptr;
+
+    /**
+     * @description: 在作用域内把arena绑定到当前线程，可以嵌套，析构时恢复上一层
+     *               scope里用arena_alloc分配的对象不能活得比arena久；增长块里分出去的在哪个线程、哪个scope释放都行
+     *               从初始缓冲区（比如栈上的数组）分出去的只能在这个arena绑定着的时候释放，或者干脆不释放
+     */
+    class arena_scope {
+        private:
+            monotonic_arena *prev;
+        public:
+            explicit arena_scope (monotonic_arena &arena) : prev(arena_alloc::current) {
+                arena_alloc::current = &arena;
+            }
+            ~arena_scope () {
+                arena_alloc::current = prev;
+            }
+            arena_scope (const arena_scope &) = delete;
+            arena_scope &operator= (const arena_scope &) = delete;
+    };
+} // namespace tinystl
+
+#endif
@@ -0,0 +1,245 @@
+/*
+ * @Author: suzy HideSue@github.com
+ * @Date: 2026-10-18 23:38:16
+ * @LastEditors: suzy HideSue@github.com
+ * @LastEditTime: 2026-10-18 23:38:16
+ * @FilePath: /tinystl/numa.h
+ * @Description: 内存池用到的一点NUMA支持：当前线程在哪个节点（getcpu）、把一段内存放到指定节点（mbind）、查一页在哪个节点（move_pages）
+ *               不依赖libnuma，直接用系统调用，没有这些系统调用或者只有一个节点时全部退化成节点0、什么都不做
+ *               单节点机器上可以用simulate(n)模拟n个节点，再用set_thread_node把线程指到某个节点上，测试按节点分的中心池
+ *
+ * Copyright (c) 2023 by ${suzy HideSue@github.com}, All Rights Reserved.
+ */
+#ifndef NUMA_H
+#define NUMA_H
+
+#include<atomic>
+#include<cerrno>
+#include<cstddef>
+#include<cstdint>
+#include<cstdio>
+#if defined(__linux__)
+#include<sched.h>
+#include<sys/syscall.h>
+#include<unistd.h>
+#endif
+
+#ifndef TINYSTL_ALLOC_MAX_NODES
+#define TINYSTL_ALLOC_MAX_NODES 8       // 中心池最多分几个arena，节点更多时按取模合并，设成1等于关掉按节点分池
+#endif
+
+namespace tinystl
+{
+    enum {MAX_NUMA_NODES = TINYSTL_ALLOC_MAX_NODES};
+
+    static_assert(MAX_NUMA_NODES >= 1, "MAX_NUMA_NODES至少是1");
+
+    class numa {
+        private:
+            // linux/mempolicy.h里的值，不为了几个常量引内核头文件
+            enum {MPOL_PREFERRED_ = 1};
+            enum {MPOL_MF_MOVE_ = 1 << 1};
+            enum {MASK_WORDS = 16};                     // 节点掩码最多1024个节点
+        private:
+            static std::atomic<size_t> simulated_nodes; // 0表示用真实拓扑
+            static std::atomic<bool> bind_usable;       // mbind返回过ENOSYS/EPERM之后就不再试
+            static thread_local int thread_node;        // set_thread_node指定的节点，-1表示跟着所在的CPU走
+        private:
+            /**
+             * @description: 真实的节点数，第一次调用时从/sys/devices/system/node/online读，读不到算1个
+             * @return {*}
+             */
+            static size_t real_nodes ();
+            /**
+             * @description: 配置的CPU数，模拟节点时按CPU编号连续地分给各节点
+             * @return {*}
+             */
+            static size_t cpus ();
+            /**
+             * @description: 当前线程所在的CPU和节点，取不到时都是0
+             * @param {unsigned} &cpu
+             * @param {unsigned} &node
+             * @return {*}
+             */
+            static void getcpu (unsigned &cpu, unsigned &node);
+        public:
+            /**
+             * @description: 节点数，模拟时是模拟的个数
+             * @return {*}
+             */
+            static size_t nodes ();
+            /**
+             * @description: 是不是在模拟节点，模拟的节点没有真实的内存，bind什么都不做
+             * @return {*}
+             */
+            static bool simulated ();
+            /**
+             * @description: 模拟nodes个节点，CPU按编号连续地分成nodes段；0表示回到真实拓扑
+             * @param {size_t} nodes
+             * @return {*}
+             */
+            static void simulate (size_t nodes);
+            /**
+             * @description: 当前线程所在的节点，[0, nodes())；只有一个节点时不做系统调用直接返回0
+             * @return {*}
+             */
+            static int current_node ();
+            /**
+             * @description: 把当前线程固定算作node节点的，-1恢复成按所在CPU算
+             *               不改线程的CPU亲和性，只影响current_node()，给已经自己绑了核的线程和模拟测试用
+             * @param {int} node
+             * @return {*}
+             */
+            static void set_thread_node (int node);
+            /**
+             * @description: 让[p, p + bytes)的页优先放在node节点上，已经有物理页的搬过去；p按页对齐
+             *               用MPOL_PREFERRED而不是MPOL_BIND，节点内存不够时还能从别的节点要，不会被OOM杀掉
+             * @param {void} *p
+             * @param {size_t} bytes
+             * @param {int} node
+             * @return {*} 真的设置成功了返回true，模拟、单节点、没有mbind时返回false
+             */
+            static bool bind (void *p, size_t bytes, int node);
+            /**
+             * @description: 用move_pages查p所在的页现在在哪个节点，页还没分配物理内存或者查不了时返回-1
+             * @param {void} *p
+             * @return {*}
+             */
+            static int page_node (const void *p);
+    };
+
+    std::atomic<size_t> numa::simulated_nodes(0);
+    std::atomic<bool> numa::bind_usable(true);
+    thread_local int numa::thread_node = -1;
+
+    inline size_t numa::real_nodes () {
+        static const size_t n = [] {
+            size_t count = 1;
+#if defined(__linux__)
+            // 内容像"0"、"0-1"、"0,2-3"，最后一个数加一就是节点数（中间有空洞也按最大编号算）
+            FILE *f = fopen("/sys/devices/system/node/online", "r");
+            if (f != nullptr) {
+                unsigned last = 0, v;
+                int c;
+                while (fscanf(f, "%u", &v) == 1) {
+                    last = v;
+                    c = fgetc(f);
+                    if (c != ',' && c != '-') {
+                        break;
+                    }
+                }
+                fclose(f);
+                count = (size_t) last + 1;
+            }
+#endif
+            return count;
+        }();
+        return n;
+    }
+
+    inline size_t numa::cpus () {
+        static const size_t n = [] {
+#if defined(__linux__)
+            long c = sysconf(_SC_NPROCESSORS_CONF);
+            return c > 0 ? (size_t) c : (size_t) 1;
+#else
+            return (size_t) 1;
+#endif
+        }();
+        return n;
+    }
+
+    inline void numa::getcpu (unsigned &cpu, unsigned &node) {
+        cpu = node = 0;
+#if defined(__linux__)
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 29))
+        // glibc的getcpu走vDSO，不进内核
+        ::getcpu(&cpu, &node);
+#elif defined(SYS_getcpu)
+        syscall(SYS_getcpu, &cpu, &node, nullptr);
+#endif
+#endif
+    }
+
+    inline size_t numa::nodes () {
+        size_t sim = simulated_nodes.load(std::memory_order_relaxed);
+        return sim != 0 ? sim : real_nodes();
+    }
+
+    inline bool numa::simulated () {
+        return simulated_nodes.load(std::memory_order_relaxed) != 0;
+    }
+
+    inline void numa::simulate (size_t nodes) {
+        simulated_nodes.store(nodes, std::memory_order_relaxed);
+    }
+
+    inline int numa::current_node () {
+        size_t n = nodes();
+        if (thread_node >= 0) {
+            return (int) ((size_t) thread_node % n);
+        }
+        if (n == 1) {
+            return 0;
+        }
+        unsigned cpu, node;
+        getcpu(cpu, node);
+        if (simulated()) {
+            size_t c = cpu < cpus() ? (size_t) cpu : cpus() - 1;
+            return (int) (c * n / cpus());
+        }
+        return (int) ((size_t) node % n);
+    }
+
+    inline void numa::set_thread_node (int node) {
+        thread_node = node;
+    }
+
+    inline bool numa::bind (void *p, size_t bytes, int node) {
+#if defined(__linux__) && defined(SYS_mbind)
+        if (simulated() || real_nodes() <= 1 || node < 0 || (size_t) node >= (size_t) MASK_WORDS * 8 * sizeof(unsigned long)
+            || !bind_usable.load(std::memory_order_relaxed)) {
+            return false;
+        }
+        unsigned long mask[MASK_WORDS] = {};
+        const size_t bits = 8 * sizeof(unsigned long);
+        mask[node / bits] = 1UL << (node % bits);
+        int saved = errno;
+        // maxnode按内核的习惯多传一位
+        long r = syscall(SYS_mbind, p, bytes, (int) MPOL_PREFERRED_, mask, (unsigned long) (MASK_WORDS * bits + 1), (unsigned) MPOL_MF_MOVE_);
+        if (r != 0) {
+            if (errno == ENOSYS || errno == EPERM) {
+                bind_usable.store(false, std::memory_order_relaxed);
+            }
+            errno = saved;
+            return false;
+        }
+        return true;
+#else
+        (void) p;
+        (void) bytes;
+        (void) node;
+        return false;
+#endif
+    }
+
+    inline int numa::page_node (const void *p) {
+#if defined(__linux__) && defined(SYS_move_pages)
+        if (simulated()) {
+            return -1;
+        }
+        void *page = (void *) ((uintptr_t) p & ~(uintptr_t) 4095);
+        int status = -1;
+        int saved = errno;
+        // nodes传nullptr时move_pages不搬页，只把每页所在的节点写到status里
+        long r = syscall(SYS_move_pages, 0, 1UL, &page, nullptr, &status, 0);
+        errno = saved;
+        return r == 0 && status >= 0 ? status : -1;
+#else
+        (void) p;
+        return -1;
+#endif
+    }
+} // namespace tinystl
+
+#endif
@@ -0,0 +1,416 @@
+/*
+ * @Author: suzy HideSue@github.com
+ * @Date: 2026-10-18 21:48:36
+ * @LastEditors: suzy HideSue@github.com
+ * @LastEditTime: 2026-10-19 19:58:27
+ * @FilePath: /tinystl/object_pool.h
+ * @Description: 按类型的slab对象池，和内核的slab分配器一样，对象还回来时不析构，下次直接拿去用
+ *               构造很贵的对象（带缓冲区、带锁的）只在第一次从slab切出来时构造一次，还回来时可以调用reset钩子清理状态
+ *               slab从alloc要，每个新slab的起始偏移错开一条cache line（coloring），不同slab的对象落在不同的cache set上
+ *               每个线程有两个magazine（装对象指针的小数组），满了或空了才和全局的depot整个交换，快速路径不加锁
+ *
+ * Copyright (c) 2023 by ${suzy HideSue@github.com}, All Rights Reserved.
+ */
+#ifndef OBJECT_POOL_H
+#define OBJECT_POOL_H
+
+#include<atomic>
+#include<cstddef>
+#include<mutex>
+#include<new>
+#include "alloc.h"
+
+#ifndef TINYSTL_OBJECT_POOL_MAGAZINE
+#define TINYSTL_OBJECT_POOL_MAGAZINE 32     // 一个magazine装多少个对象
+#endif
+#ifndef TINYSTL_OBJECT_POOL_SLAB_BYTES
+#define TINYSTL_OBJECT_POOL_SLAB_BYTES (16 * 1024) // slab的最小字节数，对象大时会加大到至少能放8个
+#endif
+
+namespace tinystl
+{
+    /**
+     * @description: 用法 T *p = object_pool<T>::acquire(); ... object_pool<T>::release(p);
+     *               acquire拿到的对象可能是新默认构造的，也可能是之前release回来、经过reset钩子的
+     */
+    template<class T>
+    class object_pool {
+        public:
+            typedef void (*reset_hook) (T &);
+        private:
+            enum {MAGAZINE_ROUNDS = TINYSTL_OBJECT_POOL_MAGAZINE};
+            enum {OBJ_ALIGN = alignof(T) > (size_t) ALIGN ? alignof(T) : (size_t) ALIGN};
+            enum {OBJ_BYTES = (sizeof(T) + OBJ_ALIGN - 1) & ~(size_t) (OBJ_ALIGN - 1)};
+            enum {SLAB_ALIGN = (size_t) OBJ_ALIGN > (size_t) CACHE_LINE ? (size_t) OBJ_ALIGN : (size_t) CACHE_LINE};
+            enum {SLAB_HEADER_BYTES = SLAB_ALIGN};
+            enum {SLAB_MIN_BYTES = SLAB_HEADER_BYTES + 8 * OBJ_BYTES + 8 * CACHE_LINE};
+            enum {SLAB_BYTES = (((size_t) SLAB_MIN_BYTES > (size_t) TINYSTL_OBJECT_POOL_SLAB_BYTES ? (size_t) SLAB_MIN_BYTES : (size_t) TINYSTL_OBJECT_POOL_SLAB_BYTES)
+                                + PAGE_SIZE - 1) & ~(size_t) (PAGE_SIZE - 1)};
+            static_assert((size_t) SLAB_ALIGN <= (size_t) PAGE_SIZE, "object_pool不支持对齐要求超过一页的类型");
+
+            /**
+             * @description: 装对象指针的小数组，线程和depot之间整个交换
+             */
+            struct magazine {
+                magazine *next;
+                size_t count;
+                T *rounds[MAGAZINE_ROUNDS];
+            };
+            struct thread_cache {
+                magazine *loaded;               // 先从这个拿、往这个放
+                magazine *previous;             // loaded空了或满了时和它交换，来回抖动时不用碰depot
+                bool dead;
+
+                constexpr thread_cache () : loaded(nullptr), previous(nullptr), dead(false) {}
+                ~thread_cache ();               // 线程退出时两个magazine都交给depot
+            };
+            /**
+             * @description: slab头，slab串成链表，trim时一起还给alloc
+             */
+            struct slab {
+                slab *next;
+            };
+            /**
+             * @description: 没有构造过（或者已经析构）的空位
+             */
+            struct raw_slot {
+                raw_slot *next;
+            };
+        private:
+            // depot，由depot_lock保护
+            static magazine *full_magazines;    // 里面有对象的magazine（可能没装满）
+            static magazine *empty_magazines;
+            static slab *slabs;
+            static char *slab_cur;              // 当前slab还没切的位置
+            static char *slab_end;
+            static size_t color;                // 下一个slab的起始偏移
+            static raw_slot *raw_slots;
+            static size_t constructed;          // 构造了还没析构的对象数（用户手里的加上缓存着的）
+            static std::mutex depot_lock;
+            static std::atomic<reset_hook> reset;   // 不归depot_lock管，release不加锁读
+            static thread_local thread_cache tcache;
+        private:
+            /**
+             * @description: 从depot拿一个对象，没有时返回nullptr，调用者需持有depot_lock
+             * @return {*}
+             */
+            static T *depot_pop_locked ();
+            /**
+             * @description: 把一个对象放进depot里没装满的magazine，调用者需持有depot_lock
+             * @param {T} *p
+             * @return {*}
+             */
+            static void depot_push_locked (T *p);
+            /**
+             * @description: 拿一个空magazine，depot里没有就向alloc要，调用者需持有depot_lock
+             * @return {*}
+             */
+            static magazine *empty_magazine_locked ();
+            /**
+             * @description: 切一个没构造的空位，先用raw_slots，当前slab用完了再向alloc要一个，调用者需持有depot_lock
+             * @return {*}
+             */
+            static void *carve_locked ();
+            /**
+             * @description: 缓存里没有对象时调用，切一个空位并默认构造，构造抛异常时空位放回raw_slots
+             * @return {*}
+             */
+            static T *construct_new ();
+        public:
+            /**
+             * @description: 拿一个构造好的对象，先看线程的两个magazine，再和depot换一个满的，都没有时从slab切一个新的构造
+             * @return {*}
+             */
+            static T *acquire ();
+            /**
+             * @description: 还回对象，不析构，有reset钩子时先调用它，然后放进线程的magazine
+             * @param {T} *p
+             * @return {*}
+             */
+            static void release (T *p);
+            /**
+             * @description: 设置release时调用的钩子，nullptr表示不调用；设置之后开始的release都会看到新钩子
+             * @param {reset_hook} hook
+             * @return {*}
+             */
+            static void set_reset_hook (reset_hook hook);
+            /**
+             * @description: 把当前线程的magazine交给depot，析构depot里缓存的所有对象；所有对象都析构了时把slab还给alloc
+             *               其他线程magazine里的对象不动；析构在锁外做，~T里可以再release这个池的对象
+             * @return {*} 还给alloc的字节数
+             */
+            static size_t trim ();
+    };
+
+    template<class T> typename object_pool<T>::magazine *object_pool<T>::full_magazines = nullptr;
+    template<class T> typename object_pool<T>::magazine *object_pool<T>::empty_magazines = nullptr;
+    template<class T> typename object_pool<T>::slab *object_pool<T>::slabs = nullptr;
+    template<class T> char *object_pool<T>::slab_cur = nullptr;
+    template<class T> char *object_pool<T>::slab_end = nullptr;
+    template<class T> size_t object_pool<T>::color = 0;
+    template<class T> typename object_pool<T>::raw_slot *object_pool<T>::raw_slots = nullptr;
+    template<class T> size_t object_pool<T>::constructed = 0;
+    template<class T> std::mutex object_pool<T>::depot_lock;
+    template<class T> std::atomic<typename object_pool<T>::reset_hook> object_pool<T>::reset(nullptr);
+    template<class T> thread_local typename object_pool<T>::thread_cache object_pool<T>::tcache;
+
+    template<class T>
+    object_pool<T>::thread_cache::~thread_cache () {
+        dead = true;
+        std::lock_guard<std::mutex> guard(depot_lock);
+        magazine *mags[2] = {loaded, previous};
+        for (magazine *m : mags) {
+            if (m == nullptr) {
+                continue;
+            }
+            if (m->count > 0) {
+                m->next = full_magazines;
+                full_magazines = m;
+            } else {
+                m->next = empty_magazines;
+                empty_magazines = m;
+            }
+        }
+        loaded = previous = nullptr;
+    }
+
+    template<class T>
+    T *object_pool<T>::depot_pop_locked () {
+        magazine *m = full_magazines;
+        if (m == nullptr) {
+            return nullptr;
+        }
+        T *p = m->rounds[--m->count];
+        if (m->count == 0) {
+            full_magazines = m->next;
+            m->next = empty_magazines;
+            empty_magazines = m;
+        }
+        return p;
+    }
+
+    template<class T>
+    void object_pool<T>::depot_push_locked (T *p) {
+        magazine *m = full_magazines;
+        if (m == nullptr || m->count == (size_t) MAGAZINE_ROUNDS) {
+            m = empty_magazine_locked();
+            m->next = full_magazines;
+            full_magazines = m;
+        }
+        m->rounds[m->count++] = p;
+    }
+
+    template<class T>
+    typename object_pool<T>::magazine *object_pool<T>::empty_magazine_locked () {
+        magazine *m = empty_magazines;
+        if (m != nullptr) {
+            empty_magazines = m->next;
+        } else {
+            m = (magazine *) alloc::allocate(sizeof(magazine));
+        }
+        m->next = nullptr;
+        m->count = 0;
+        return m;
+    }
+
+    template<class T>
+    void *object_pool<T>::carve_locked () {
+        if (raw_slots != nullptr) {
+            raw_slot *r = raw_slots;
+            raw_slots = r->next;
+            return r;
+        }
+        if (slab_cur == nullptr || (size_t) (slab_end - slab_cur) < (size_t) OBJ_BYTES) {
+            slab *s = (slab *) alloc::allocate_aligned(SLAB_BYTES, SLAB_ALIGN);
+            s->next = slabs;
+            slabs = s;
+            // 切完对象剩下的零头用来错开起始位置，每个新slab多错开一条cache line，错到放不下时从头再来
+            size_t usable = SLAB_BYTES - SLAB_HEADER_BYTES;
+            size_t slack = usable - usable / OBJ_BYTES * OBJ_BYTES;
+            if (color > slack) {
+                color = 0;
+            }
+            slab_cur = (char *) s + SLAB_HEADER_BYTES + color;
+            slab_end = (char *) s + SLAB_BYTES;
+            color += SLAB_ALIGN;
+        }
+        void *p = slab_cur;
+        slab_cur += OBJ_BYTES;
+        return p;
+    }
+
+    template<class T>
+    T *object_pool<T>::construct_new () {
+        void *slot;
+        {
+            std::lock_guard<std::mutex> guard(depot_lock);
+            slot = carve_locked();
+            constructed++;
+        }
+        try {
+            return new(slot) T();
+        } catch (...) {
+            std::lock_guard<std::mutex> guard(depot_lock);
+            raw_slot *r = (raw_slot *) slot;
+            r->next = raw_slots;
+            raw_slots = r;
+            constructed--;
+            throw;
+        }
+    }
+
+    template<class T>
+    T *object_pool<T>::acquire () {
+        thread_cache &tc = tcache;
+        if (tc.dead) {
+            T *p;
+            {
+                std::lock_guard<std::mutex> guard(depot_lock);
+                p = depot_pop_locked();
+            }
+            return p != nullptr ? p : construct_new();
+        }
+        magazine *m = tc.loaded;
+        if (m != nullptr && m->count > 0) {
+            return m->rounds[--m->count];
+        }
+        if (tc.previous != nullptr && tc.previous->count > 0) {
+            tc.loaded = tc.previous;
+            tc.previous = m;
+            return tc.loaded->rounds[--tc.loaded->count];
+        }
+        {
+            // 两个都空了，从depot换一个有对象的magazine回来，空的留一个当previous，另一个还给depot
+            std::lock_guard<std::mutex> guard(depot_lock);
+            magazine *full = full_magazines;
+            if (full != nullptr) {
+                full_magazines = full->next;
+                if (tc.previous != nullptr) {
+                    tc.previous->next = empty_magazines;
+                    empty_magazines = tc.previous;
+                }
+                tc.previous = m;
+                tc.loaded = full;
+                return full->rounds[--full->count];
+            }
+        }
+        return construct_new();
+    }
+
+    template<class T>
+    void object_pool<T>::release (T *p) {
+        reset_hook hook = reset.load(std::memory_order_acquire);
+        if (hook != nullptr) {
+            hook(*p);
+        }
+        thread_cache &tc = tcache;
+        if (tc.dead) {
+            std::lock_guard<std::mutex> guard(depot_lock);
+            depot_push_locked(p);
+            return;
+        }
+        magazine *m = tc.loaded;
+        if (m != nullptr && m->count < (size_t) MAGAZINE_ROUNDS) {
+            m->rounds[m->count++] = p;
+            return;
+        }
+        if (m != nullptr && tc.previous != nullptr && tc.previous->count < (size_t) MAGAZINE_ROUNDS) {
+            tc.loaded = tc.previous;
+            tc.previous = m;
+            tc.loaded->rounds[tc.loaded->count++] = p;
+            return;
+        }
+        {
+            // loaded满了（或者还没有），满的previous交给depot，loaded降为previous，换一个空的来
+            std::lock_guard<std::mutex> guard(depot_lock);
+            if (tc.previous != nullptr && tc.previous->count > 0) {
+                tc.previous->next = full_magazines;
+                full_magazines = tc.previous;
+            } else if (tc.previous != nullptr) {
+                tc.previous->next = empty_magazines;
+                empty_magazines = tc.previous;
+            }
+            tc.previous = m;
+            tc.loaded = empty_magazine_locked();
+        }
+        tc.loaded->rounds[tc.loaded->count++] = p;
+    }
+
+    template<class T>
+    void object_pool<T>::set_reset_hook (reset_hook hook) {
+        reset.store(hook, std::memory_order_release);
+    }
+
+    template<class T>
+    size_t object_pool<T>::trim () {
+        thread_cache &tc = tcache;
+        magazine *detached;
+        {
+            std::lock_guard<std::mutex> guard(depot_lock);
+            if (!tc.dead) {
+                magazine *mags[2] = {tc.loaded, tc.previous};
+                for (magazine *m : mags) {
+                    if (m != nullptr && m->count > 0) {
+                        m->next = full_magazines;
+                        full_magazines = m;
+                    } else if (m != nullptr) {
+                        m->next = empty_magazines;
+                        empty_magazines = m;
+                    }
+                }
+                tc.loaded = tc.previous = nullptr;
+            }
+            detached = full_magazines;
+            full_magazines = nullptr;
+        }
+        // 缓存着的对象在锁外析构，~T里release别的对象时要拿depot_lock；空位先串在本地
+        raw_slot *freed = nullptr;
+        raw_slot *freed_tail = nullptr;
+        size_t destroyed = 0;
+        for (magazine *m = detached; m != nullptr; m = m->next) {
+            for (size_t i = 0; i < m->count; i++) {
+                m->rounds[i]->~T();
+                raw_slot *r = (raw_slot *) (void *) m->rounds[i];
+                r->next = freed;
+                if (freed == nullptr) {
+                    freed_tail = r;
+                }
+                freed = r;
+            }
+            destroyed += m->count;
+        }
+        std::lock_guard<std::mutex> guard(depot_lock);
+        // 空位留着下次用
+        if (freed != nullptr) {
+            freed_tail->next = raw_slots;
+            raw_slots = freed;
+        }
+        constructed -= destroyed;
+        while (detached != nullptr) {
+            magazine *m = detached;
+            detached = m->next;
+            alloc::deallocate(m, sizeof(magazine));
+        }
+        while (empty_magazines != nullptr) {
+            magazine *m = empty_magazines;
+            empty_magazines = m->next;
+            alloc::deallocate(m, sizeof(magazine));
+        }
+        if (constructed != 0) {
+            return 0;
+        }
+        // 没有活着的对象了，slab整个还回去
+        size_t released = 0;
+        while (slabs != nullptr) {
+            slab *s = slabs;
+            slabs = s->next;
+            alloc::deallocate_aligned(s, SLAB_BYTES, SLAB_ALIGN);
+            released += SLAB_BYTES;
+        }
+        raw_slots = nullptr;
+        slab_cur = slab_end = nullptr;
+        return released;
+    }
+} // namespace tinystl
+
+#endif
@@ -0,0 +1,545 @@
+/*
+ * @Author: suzy HideSue@github.com
+ * @Date: 2026-10-18 11:20:43
+ * @LastEditors: suzy HideSue@github.com
+ * @LastEditTime: 2026-10-19 18:05:12
+ * @FilePath: /tinystl/page_heap.h
+ * @Description: 中型区块的页级配置器，MAX_BYTES到MAX_PAGE_BYTES之间的请求按整页分配
+ *               每种页数一条空闲链表，更长的挂在最后一条上，没有合适的就切大的，再没有就从页池里切
+ *               页池按PAGE_CHUNK_BYTES对齐向page_source申请，第一页是chunk头，记录有多少页在用，全空闲的chunk可以trim还回去
+ *               chunk头里给每一页留一个边界标记，区块的首页和尾页记着它有几页、空不空闲，回收时和左右相邻的空闲区块合并，
+ *               挨着页池的直接还给页池，所以chunk里的页全空闲时就是一整段，trim能找到它
+ *               在用页数有高水位，存进pool_profile，下次启动时warm_up按它一次预留好几个备用chunk，页池用完时先换备用的
+ *
+ * Copyright (c) 2023 by ${suzy HideSue@github.com}, All Rights Reserved.
+ */
+#ifndef PAGE_HEAP_H
+#define PAGE_HEAP_H
+
+#include<cstddef>
+#include<cstdint>
+#include<cstdlib>
+#include<mutex>
+#include<new>
+#include "page_source.h"
+
+#ifndef TINYSTL_ALLOC_PAGE_SIZE
+#define TINYSTL_ALLOC_PAGE_SIZE 4096
+#endif
+#ifndef TINYSTL_ALLOC_MAX_PAGE_BYTES
+#define TINYSTL_ALLOC_MAX_PAGE_BYTES (256 * 1024)   // 页级区块的上限，再大直接malloc
+#endif
+#ifndef TINYSTL_ALLOC_PAGE_CHUNK_BYTES
+#define TINYSTL_ALLOC_PAGE_CHUNK_BYTES (1024 * 1024) // 页池每次向系统申请的大小，必须是2的幂
+#endif
+
+namespace tinystl
+{
+    enum {PAGE_SIZE = TINYSTL_ALLOC_PAGE_SIZE};
+    enum {MAX_PAGE_BYTES = TINYSTL_ALLOC_MAX_PAGE_BYTES};
+    enum {NPAGELISTS = MAX_PAGE_BYTES / PAGE_SIZE};     // 1页到NPAGELISTS页，每种一条链表
+    enum {PAGE_CHUNK_BYTES = TINYSTL_ALLOC_PAGE_CHUNK_BYTES};
+    enum {PAGES_PER_CHUNK = PAGE_CHUNK_BYTES / PAGE_SIZE};
+
+    static_assert(MAX_PAGE_BYTES % PAGE_SIZE == 0, "MAX_PAGE_BYTES必须是页大小的倍数");
+    static_assert((PAGE_CHUNK_BYTES & (PAGE_CHUNK_BYTES - 1)) == 0, "PAGE_CHUNK_BYTES必须是2的幂");
+    static_assert((size_t) PAGE_CHUNK_BYTES - PAGE_SIZE >= (size_t) MAX_PAGE_BYTES, "页池一次至少要能切出一个最大的区块");
+    static_assert(PAGES_PER_CHUNK < 0x8000, "边界标记是16位的，chunk里的页数太多了");
+
+    class page_heap {
+        private:
+            struct page_run {
+                page_run *prev;
+                page_run *next;
+            };
+            enum {FREE_TAG = 0x8000};                   // 边界标记的最高位，表示这个区块是空闲的
+            struct page_chunk {
+                page_chunk *prev;
+                page_chunk *next;
+                size_t live_pages;                      // 在用的页数，为0说明整个chunk都空闲
+                page_source *source;                    // chunk从哪来，还回哪去
+                page_chunk *next_spare;                 // warm_up备好、还没当过页池的chunk串成的栈
+                uint16_t tags[PAGES_PER_CHUNK];         // 边界标记，区块首页和尾页对应的位置记着页数 | FREE_TAG，页池里还没切的页不记
+            };
+            static_assert(sizeof(page_chunk) <= (size_t) PAGE_SIZE, "chunk头必须放在第一页里");
+        private:
+            static page_run *free_runs[NPAGELISTS + 1]; // free_runs[k]上挂的都是k+1页的空闲区块，free_runs[NPAGELISTS]挂更长的
+            static char *start_page;                    // 页池起始位置
+            static char *end_page;                      // 页池结束位置
+            static page_chunk *chunks;                  // 所有chunk串成的链表
+            static page_chunk *current_chunk;           // 页池正在切的chunk
+            static page_chunk *spare_chunks;            // warm_up备好的chunk，页池用完时先从这里换，不用再向page_source要
+            static size_t spare_count;
+            static size_t free_bytes;                   // 空闲链表上的总字节数
+            static size_t trim_threshold;               // 空闲字节比上次trim后多出这么多时自动trim，0表示不自动trim
+            static size_t trim_mark;                    // 上次trim后剩下的空闲字节
+            static size_t in_use_pages;                 // 在用的页数
+            static size_t high_water_pages;             // in_use_pages到过的最大值，warm_up的目标
+            static std::mutex lock;
+        private:
+            /**
+             * @description: 页所在的chunk
+             * @param {void} *p
+             * @return {*}
+             */
+            static page_chunk *chunk_of (void *p);
+            /**
+             * @description: 向src要一个新chunk，失败返回nullptr，调用者需持有lock
+             * @param {page_source} *src
+             * @return {*}
+             */
+            static page_chunk *new_chunk (page_source *src);
+            /**
+             * @description: 把全空闲的chunk还给系统，调用者需持有lock
+             * @return {*} 还给系统的字节数
+             */
+            static size_t trim_locked ();
+            /**
+             * @description: 区块首页或尾页的边界标记里记的页数
+             * @param {char} *p
+             * @return {*}
+             */
+            static size_t tag_pages (char *p);
+            /**
+             * @description: 在区块首尾两页记下边界标记
+             * @param {char} *p
+             * @param {size_t} npages
+             * @param {bool} free
+             * @return {*}
+             */
+            static void set_tags (char *p, size_t npages, bool free);
+            /**
+             * @description: 把[p, p + npages页)标成空闲，挂到对应的空闲链表上，不合并，调用者需持有lock
+             * @param {char} *p
+             * @param {size_t} npages
+             * @return {*}
+             */
+            static void push_run (char *p, size_t npages);
+            /**
+             * @description: 把空闲区块从它的链表上摘下来，调用者需持有lock
+             * @param {page_run} *run
+             * @param {size_t} npages
+             * @return {*}
+             */
+            static void unlink_run (page_run *run, size_t npages);
+            /**
+             * @description: 回收[p, p + npages页)，先和左右的空闲区块合并，挨着页池的还给页池，调用者需持有lock
+             * @param {char} *p
+             * @param {size_t} npages
+             * @return {*}
+             */
+            static void release_run (char *p, size_t npages);
+            /**
+             * @description: 又有npages页发出去了，顺便更新高水位，调用者需持有lock
+             * @param {size_t} npages
+             * @return {*}
+             */
+            static void note_in_use (size_t npages);
+        public:
+            /**
+             * @description: 字节数换算成页数
+             * @param {size_t} bytes
+             * @return {*}
+             */
+            static size_t pages (size_t bytes);
+            /**
+             * @description: 分配连续npages页，先找正好的，再切更大的，最后从页池切
+             * @param {size_t} npages 不超过NPAGELISTS
+             * @return {*}
+             */
+            static void *allocate_pages (size_t npages);
+            /**
+             * @description: 回收npages页，和相邻的空闲页合并后挂回空闲链表
+             * @param {void} *p
+             * @param {size_t} npages
+             * @return {*}
+             */
+            static void deallocate_pages (void *p, size_t npages);
+            /**
+             * @description: 把allocate_pages拿到的old_pages页缩成new_pages页，尾部多出来的页回收
+             * @param {void} *p
+             * @param {size_t} old_pages
+             * @param {size_t} new_pages 大于0，小于old_pages
+             * @return {*}
+             */
+            static void shrink_pages (void *p, size_t old_pages, size_t new_pages);
+            /**
+             * @description: 原地把old_pages页扩成new_pages页，后面紧跟着的是够大的空闲区块或者页池时才行
+             * @param {void} *p
+             * @param {size_t} old_pages
+             * @param {size_t} new_pages 大于old_pages，不超过NPAGELISTS
+             * @return {*} 扩不了返回false，区块不变
+             */
+            static bool grow_pages (void *p, size_t old_pages, size_t new_pages);
+            /**
+             * @description: 把全部空闲的chunk还给系统
+             * @return {*} 还给系统的字节数
+             */
+            static size_t trim ();
+            /**
+             * @description: 设置自动trim的阈值，0表示关闭
+             * @param {size_t} bytes
+             * @return {*}
+             */
+            static void set_trim_threshold (size_t bytes);
+            /**
+             * @description: 在用页数的高水位，alloc::high_water()把它放进pool_profile
+             * @return {*}
+             */
+            static size_t high_water ();
+            /**
+             * @description: 高水位从现在在用的页数重新算
+             * @return {*}
+             */
+            static void reset_high_water ();
+            /**
+             * @description: 预先准备好npages页空闲页：不够的按整chunk一次向page_source预留（reserved_page_source），
+             *               每页写一下让缺页在这里发生，备用chunk等页池用完时接上，和冷启动时一样从页池切，trim时照样还回去
+             * @param {size_t} npages
+             * @return {*} 新准备的字节数，page_source要不到内存时只准备一部分
+             */
+            static size_t warm_up (size_t npages);
+            /**
+             * @description: 当前用量，heap_bytes是所有chunk的总字节数
+             * @param {size_t} &heap_bytes
+             * @param {size_t} &in_use_bytes
+             * @param {size_t} &free_bytes
+             * @return {*}
+             */
+            static void usage (size_t &heap_bytes, size_t &in_use_bytes, size_t &free_bytes);
+    };
+
+    page_heap::page_run *page_heap::free_runs[NPAGELISTS + 1] = {};
+    char *page_heap::start_page = nullptr;
+    char *page_heap::end_page = nullptr;
+    page_heap::page_chunk *page_heap::chunks = nullptr;
+    page_heap::page_chunk *page_heap::current_chunk = nullptr;
+    page_heap::page_chunk *page_heap::spare_chunks = nullptr;
+    size_t page_heap::spare_count = 0;
+    size_t page_heap::free_bytes = 0;
+    size_t page_heap::trim_threshold = 0;
+    size_t page_heap::trim_mark = 0;
+    size_t page_heap::in_use_pages = 0;
+    size_t page_heap::high_water_pages = 0;
+    std::mutex page_heap::lock;
+
+    inline size_t page_heap::pages (size_t bytes) {
+        return (bytes + PAGE_SIZE - 1) / PAGE_SIZE;
+    }
+
+    inline page_heap::page_chunk *page_heap::chunk_of (void *p) {
+        return (page_chunk *) ((uintptr_t) p & ~(uintptr_t) (PAGE_CHUNK_BYTES - 1));
+    }
+
+    inline size_t page_heap::tag_pages (char *p) {
+        page_chunk *chunk = chunk_of(p);
+        return chunk->tags[(p - (char *) chunk) / PAGE_SIZE] & ~FREE_TAG;
+    }
+
+    inline void page_heap::set_tags (char *p, size_t npages, bool free) {
+        page_chunk *chunk = chunk_of(p);
+        size_t first = (p - (char *) chunk) / PAGE_SIZE;
+        uint16_t tag = (uint16_t) (npages | (free ? FREE_TAG : 0));
+        chunk->tags[first] = tag;
+        chunk->tags[first + npages - 1] = tag;
+    }
+
+    inline void page_heap::push_run (char *p, size_t npages) {
+        set_tags(p, npages, true);
+        page_run **head = free_runs + (npages <= NPAGELISTS ? npages - 1 : (size_t) NPAGELISTS);
+        page_run *run = (page_run *) p;
+        run->prev = nullptr;
+        run->next = *head;
+        if (*head != nullptr) {
+            (*head)->prev = run;
+        }
+        *head = run;
+        free_bytes += npages * PAGE_SIZE;
+    }
+
+    inline void page_heap::unlink_run (page_run *run, size_t npages) {
+        if (run->prev != nullptr) {
+            run->prev->next = run->next;
+        } else {
+            free_runs[npages <= NPAGELISTS ? npages - 1 : (size_t) NPAGELISTS] = run->next;
+        }
+        if (run->next != nullptr) {
+            run->next->prev = run->prev;
+        }
+        free_bytes -= npages * PAGE_SIZE;
+    }
+
+    void page_heap::release_run (char *p, size_t npages) {
+        page_chunk *chunk = chunk_of(p);
+        size_t first = (p - (char *) chunk) / PAGE_SIZE;
+        // 左边：前一页是前一个区块的尾页，第0页是chunk头
+        if (first > 1 && (chunk->tags[first - 1] & FREE_TAG)) {
+            size_t left = chunk->tags[first - 1] & ~FREE_TAG;
+            p -= left * PAGE_SIZE;
+            first -= left;
+            npages += left;
+            unlink_run((page_run *) p, left);
+        }
+        // 右边：挨着页池就还给页池，页池后面的页没有标记
+        char *end = p + npages * PAGE_SIZE;
+        if (chunk == current_chunk && end == start_page) {
+            start_page = p;
+            return;
+        }
+        size_t next = first + npages;
+        if (next < (size_t) PAGES_PER_CHUNK && (chunk->tags[next] & FREE_TAG)) {
+            size_t right = chunk->tags[next] & ~FREE_TAG;
+            unlink_run((page_run *) end, right);
+            npages += right;
+        }
+        push_run(p, npages);
+    }
+
+    inline void page_heap::note_in_use (size_t npages) {
+        in_use_pages += npages;
+        if (in_use_pages > high_water_pages) {
+            high_water_pages = in_use_pages;
+        }
+    }
+
+    page_heap::page_chunk *page_heap::new_chunk (page_source *src) {
+        page_chunk *chunk = (page_chunk *) src->allocate_chunk(PAGE_CHUNK_BYTES, PAGE_CHUNK_BYTES);
+        if (chunk == nullptr) {
+            return nullptr;
+        }
+        chunk->live_pages = 0;
+        chunk->source = src;
+        chunk->next_spare = nullptr;
+        chunk->prev = nullptr;
+        chunk->next = chunks;
+        if (chunks != nullptr) {
+            chunks->prev = chunk;
+        }
+        chunks = chunk;
+        return chunk;
+    }
+
+    size_t page_heap::trim_locked () {
+        size_t released = 0;
+        // 备用chunk一页都没切过，不在空闲链表上，先单独还掉
+        while (spare_chunks != nullptr) {
+            page_chunk *chunk = spare_chunks;
+            spare_chunks = chunk->next_spare;
+            if (chunk->prev != nullptr) {
+                chunk->prev->next = chunk->next;
+            } else {
+                chunks = chunk->next;
+            }
+            if (chunk->next != nullptr) {
+                chunk->next->prev = chunk->prev;
+            }
+            chunk->source->release_chunk(chunk, PAGE_CHUNK_BYTES);
+            released += PAGE_CHUNK_BYTES;
+        }
+        spare_count = 0;
+        // 空闲页都合并过，正在切的chunk全空闲时它的页都已经还给页池了
+        page_chunk *dropped = nullptr;
+        if (current_chunk != nullptr && current_chunk->live_pages == 0) {
+            start_page = end_page = nullptr;
+            dropped = current_chunk;
+            current_chunk = nullptr;
+        }
+        page_chunk *chunk = chunks;
+        while (chunk != nullptr) {
+            page_chunk *next = chunk->next;
+            if (chunk->live_pages == 0 && chunk != current_chunk) {
+                // 其余全空闲的chunk里只剩一整段空闲区块
+                if (chunk != dropped) {
+                    unlink_run((page_run *) ((char *) chunk + PAGE_SIZE), PAGES_PER_CHUNK - 1);
+                }
+                if (chunk->prev != nullptr) {
+                    chunk->prev->next = chunk->next;
+                } else {
+                    chunks = chunk->next;
+                }
+                if (chunk->next != nullptr) {
+                    chunk->next->prev = chunk->prev;
+                }
+                chunk->source->release_chunk(chunk, PAGE_CHUNK_BYTES);
+                released += PAGE_CHUNK_BYTES;
+            }
+            chunk = next;
+        }
+        trim_mark = free_bytes;
+        return released;
+    }
+
+    void *page_heap::allocate_pages (size_t npages) {
+        std::lock_guard<std::mutex> guard(lock);
+        for (size_t k = npages; k <= NPAGELISTS + 1; k++) {
+            page_run *run = free_runs[k - 1];
+            size_t run_pages = k;
+            if (k == NPAGELISTS + 1) {
+                // 更长的区块混在一条链表上，找第一个够长的
+                while (run != nullptr && (run_pages = tag_pages((char *) run)) < npages) {
+                    run = run->next;
+                }
+            }
+            if (run == nullptr) {
+                continue;
+            }
+            unlink_run(run, run_pages);
+            if (run_pages > npages) {
+                // 切下前npages页，剩下的挂回去；原来的区块左右都不空闲，剩下的也不用合并
+                push_run((char *) run + npages * PAGE_SIZE, run_pages - npages);
+            }
+            set_tags((char *) run, npages, false);
+            chunk_of(run)->live_pages += npages;
+            note_in_use(npages);
+            return run;
+        }
+        size_t bytes = npages * PAGE_SIZE;
+        if ((size_t) (end_page - start_page) < bytes) {
+            // 页池剩下的不够，先把零头回收，再要一块新的
+            size_t left = (end_page - start_page) / PAGE_SIZE;
+            char *rest = start_page;
+            start_page = end_page = nullptr;
+            if (left > 0) {
+                release_run(rest, left);
+            }
+            if (spare_chunks != nullptr) {
+                current_chunk = spare_chunks;
+                spare_chunks = current_chunk->next_spare;
+                spare_count--;
+            } else {
+                current_chunk = new_chunk(page_source::current());
+            }
+            if (current_chunk == nullptr) {
+                throw std::bad_alloc();
+            }
+            // 第一页留给chunk头
+            start_page = (char *) current_chunk + PAGE_SIZE;
+            end_page = (char *) current_chunk + PAGE_CHUNK_BYTES;
+        }
+        char *result = start_page;
+        start_page += bytes;
+        set_tags(result, npages, false);
+        current_chunk->live_pages += npages;
+        note_in_use(npages);
+        return result;
+    }
+
+    void page_heap::deallocate_pages (void *p, size_t npages) {
+        std::lock_guard<std::mutex> guard(lock);
+        chunk_of(p)->live_pages -= npages;
+        in_use_pages -= npages;
+        release_run((char *) p, npages);
+        if (trim_threshold != 0 && free_bytes > trim_mark + trim_threshold) {
+            trim_locked();
+        }
+    }
+
+    void page_heap::shrink_pages (void *p, size_t old_pages, size_t new_pages) {
+        std::lock_guard<std::mutex> guard(lock);
+        chunk_of(p)->live_pages -= old_pages - new_pages;
+        in_use_pages -= old_pages - new_pages;
+        set_tags((char *) p, new_pages, false);
+        release_run((char *) p + new_pages * PAGE_SIZE, old_pages - new_pages);
+        if (trim_threshold != 0 && free_bytes > trim_mark + trim_threshold) {
+            trim_locked();
+        }
+    }
+
+    bool page_heap::grow_pages (void *p, size_t old_pages, size_t new_pages) {
+        std::lock_guard<std::mutex> guard(lock);
+        page_chunk *chunk = chunk_of(p);
+        char *end = (char *) p + old_pages * PAGE_SIZE;
+        size_t more = new_pages - old_pages;
+        if (chunk == current_chunk && end == start_page) {
+            // 后面是页池，从页池接着切
+            if ((size_t) (end_page - start_page) < more * PAGE_SIZE) {
+                return false;
+            }
+            start_page += more * PAGE_SIZE;
+        } else {
+            size_t next = (end - (char *) chunk) / PAGE_SIZE;
+            if (next >= (size_t) PAGES_PER_CHUNK || !(chunk->tags[next] & FREE_TAG)) {
+                return false;
+            }
+            size_t right = chunk->tags[next] & ~FREE_TAG;
+            if (right < more) {
+                return false;
+            }
+            unlink_run((page_run *) end, right);
+            if (right > more) {
+                // 空闲区块的右边不会是空闲的，剩下的不用合并
+                push_run(end + more * PAGE_SIZE, right - more);
+            }
+        }
+        set_tags((char *) p, new_pages, false);
+        chunk->live_pages += more;
+        note_in_use(more);
+        return true;
+    }
+
+    size_t page_heap::trim () {
+        std::lock_guard<std::mutex> guard(lock);
+        return trim_locked();
+    }
+
+    void page_heap::set_trim_threshold (size_t bytes) {
+        std::lock_guard<std::mutex> guard(lock);
+        trim_threshold = bytes;
+    }
+
+    size_t page_heap::high_water () {
+        std::lock_guard<std::mutex> guard(lock);
+        return high_water_pages;
+    }
+
+    void page_heap::reset_high_water () {
+        std::lock_guard<std::mutex> guard(lock);
+        high_water_pages = in_use_pages;
+    }
+
+    size_t page_heap::warm_up (size_t npages) {
+        std::lock_guard<std::mutex> guard(lock);
+        size_t usable = (size_t) PAGES_PER_CHUNK - 1;
+        size_t have = (free_bytes + (end_page - start_page)) / PAGE_SIZE + spare_count * usable;
+        if (npages <= have) {
+            return 0;
+        }
+        size_t count = (npages - have + usable - 1) / usable;
+        // 要不到一整段时一个一个要
+        page_source *upstream = page_source::current();
+        reserved_page_source *reserve = reserved_page_source::create(upstream, PAGE_CHUNK_BYTES, count);
+        size_t warmed = 0;
+        for (size_t k = 0; k < count; k++) {
+            page_chunk *chunk = new_chunk(reserve != nullptr ? (page_source *) reserve : upstream);
+            if (chunk == nullptr) {
+                break;
+            }
+            for (char *p = (char *) chunk + PAGE_SIZE; p < (char *) chunk + PAGE_CHUNK_BYTES; p += PAGE_SIZE) {
+                *(volatile char *) p = 0;
+            }
+            // 不挂到空闲链表上：从一整段空闲区块里切要读写页里的链表指针，页早就不在cache里了
+            chunk->next_spare = spare_chunks;
+            spare_chunks = chunk;
+            spare_count++;
+            warmed += usable * PAGE_SIZE;
+        }
+        if (reserve != nullptr) {
+            // 全都发出去了，close以后等这些chunk都还回来再整段还给上游
+            reserve->close();
+        }
+        return warmed;
+    }
+
+    void page_heap::usage (size_t &heap_bytes, size_t &in_use_bytes, size_t &free_bytes) {
+        std::lock_guard<std::mutex> guard(lock);
+        heap_bytes = in_use_bytes = 0;
+        for (page_chunk *chunk = chunks; chunk != nullptr; chunk = chunk->next) {
+            heap_bytes += PAGE_CHUNK_BYTES;
+            in_use_bytes += chunk->live_pages * PAGE_SIZE;
+        }
+        // 页池里还没切的部分和备用chunk也算空闲
+        free_bytes = page_heap::free_bytes + (end_page - start_page) + spare_count * ((size_t) PAGES_PER_CHUNK - 1) * PAGE_SIZE;
+    }
+} // namespace tinystl
+
+#endif
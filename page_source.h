@@ -0,0 +1,521 @@
+/*
+ * @Author: suzy HideSue@github.com
+ * @Date: 2026-10-18 14:35:02
+ * @LastEditors: suzy HideSue@github.com
+ * @LastEditTime: 2026-10-19 09:47:05
+ * @FilePath: /tinystl/page_source.h
+ * @Description: 内存池的后备内存来源，alloc和page_heap的chunk都从这里要
+ *               默认是malloc_page_source，也可以换成mmap_page_source：预留一大段虚拟地址，按步长提交，可以用透明大页或MAP_HUGETLB
+ *               mmap_page_source带PER_CLASS时每个size class单独一段预留区，alloc也按class分chunk，每个class的区块落在自己的一段连续地址里
+ *               reserved_page_source向上游一次要一整段再按chunk发出去，alloc::warm_up用它代替一个一个地要chunk
+ *
+ * Copyright (c) 2023 by ${suzy HideSue@github.com}, All Rights Reserved.
+ */
+#ifndef PAGE_SOURCE_H
+#define PAGE_SOURCE_H
+
+#include<atomic>
+#include<cstddef>
+#include<climits>
+#include<cstdint>
+#include<cstdlib>
+#include<mutex>
+#if defined(__GLIBC__)
+#include<malloc.h>
+#endif
+#if defined(__unix__) || defined(__APPLE__)
+#include<sys/mman.h>
+#endif
+
+namespace tinystl
+{
+    class page_source {
+        private:
+            static std::atomic<page_source *> current_source;
+        public:
+            virtual ~page_source () {}
+            /**
+             * @description: 申请bytes字节，按align对齐，align是2的幂且不超过bytes，失败返回nullptr
+             * @param {size_t} bytes
+             * @param {size_t} align
+             * @return {*}
+             */
+            virtual void *allocate_chunk (size_t bytes, size_t align) = 0;
+            /**
+             * @description: 归还allocate_chunk拿到的内存
+             * @param {void} *p
+             * @param {size_t} bytes
+             * @return {*}
+             */
+            virtual void release_chunk (void *p, size_t bytes) = 0;
+            /**
+             * @description: 一轮trim结束后调用，可以在这里做批量的归还动作
+             * @return {*}
+             */
+            virtual void flush () {}
+            /**
+             * @description: 是否要alloc按size class分chunk：返回true时alloc每个class单独切自己的chunk，用allocate_class_chunk要
+             * @return {*}
+             */
+            virtual bool per_class () const { return false; }
+            /**
+             * @description: 申请一个只给第size_class个class用的chunk，默认和allocate_chunk一样，归还时还是release_chunk
+             * @param {size_t} bytes
+             * @param {size_t} align
+             * @param {size_t} size_class
+             * @return {*}
+             */
+            virtual void *allocate_class_chunk (size_t bytes, size_t align, size_t size_class) {
+                (void) size_class;
+                return allocate_chunk(bytes, align);
+            }
+
+            /**
+             * @description: 之后新申请的chunk用哪个来源，已有的chunk记着自己的来源，还是还给原来的
+             * @param {page_source} *src 生命周期由调用者保证，不能早于内存池里的chunk结束
+             * @return {*}
+             */
+            static void set_current (page_source *src);
+            static page_source *current ();
+    };
+
+    /**
+     * @description: 用aligned_alloc/free，和原来直接malloc的行为一致
+     */
+    class malloc_page_source : public page_source {
+        public:
+            void *allocate_chunk (size_t bytes, size_t align) override {
+                return aligned_alloc(align, bytes);
+            }
+            void release_chunk (void *p, size_t) override {
+                free(p);
+            }
+            void flush () override {
+#if defined(__GLIBC__)
+                // free掉的chunk可能留在glibc的堆里，让它把空闲页还给系统
+                malloc_trim(0);
+#endif
+            }
+    };
+
+    std::atomic<page_source *> page_source::current_source(nullptr);
+
+    inline void page_source::set_current (page_source *src) {
+        current_source.store(src, std::memory_order_release);
+    }
+
+    inline page_source *page_source::current () {
+        page_source *src = current_source.load(std::memory_order_acquire);
+        if (src == nullptr) {
+            // 不析构，线程退出时归还区块可能晚于静态对象析构
+            static page_source *default_source = new malloc_page_source();
+            src = default_source;
+        }
+        return src;
+    }
+
+    /**
+     * @description: 向上游一次要count个chunk连成的一大段，再一个一个发给内存池
+     *               发出去的chunk还回来时先把物理页还掉，地址要等close过、而且发出去的全还回来以后，整段一起还给上游
+     *               只能用create在堆上建，最后一个chunk还回来时自己delete自己，所以不要设成page_source::current()
+     */
+    class reserved_page_source : public page_source {
+        private:
+            page_source *upstream;
+            char *base;
+            size_t chunk_bytes;
+            size_t count;
+            size_t issued;          // 已经发出去的chunk数，下一个从base + issued * chunk_bytes开始
+            size_t outstanding;     // 发出去还没还回来的chunk数
+            bool closed;            // 不再发新的chunk
+            std::mutex lock;
+        private:
+            reserved_page_source (page_source *upstream, char *base, size_t chunk_bytes, size_t count)
+                : upstream(upstream), base(base), chunk_bytes(chunk_bytes), count(count),
+                  issued(0), outstanding(0), closed(false) {}
+            /**
+             * @description: 把[p, p + bytes)的物理页还给系统，地址留着
+             * @param {void} *p
+             * @param {size_t} bytes
+             * @return {*}
+             */
+            static void discard (void *p, size_t bytes);
+            /**
+             * @description: 整段还给上游，然后delete自己，调用时不能持有lock
+             * @return {*}
+             */
+            void destroy ();
+        public:
+            /**
+             * @description: 向upstream要count * chunk_bytes字节、按chunk_bytes对齐的一段，要不到返回nullptr
+             * @param {page_source} *upstream
+             * @param {size_t} chunk_bytes 2的幂
+             * @param {size_t} count
+             * @return {*}
+             */
+            static reserved_page_source *create (page_source *upstream, size_t chunk_bytes, size_t count);
+            /**
+             * @description: 按顺序发下一个chunk，bytes和对齐都不能超过chunk_bytes，发完了或者close过返回nullptr
+             */
+            void *allocate_chunk (size_t bytes, size_t align) override;
+            void release_chunk (void *p, size_t bytes) override;
+            /**
+             * @description: 不再发新的chunk，没发出去的部分马上还掉物理页；发出去的都已经还回来时整段还给上游并delete自己
+             * @return {*}
+             */
+            void close ();
+            /**
+             * @description: 还有几个chunk没发出去
+             * @return {*}
+             */
+            size_t remaining ();
+    };
+
+    inline void reserved_page_source::discard (void *p, size_t bytes) {
+#if defined(__unix__) || defined(__APPLE__)
+        if (bytes > 0) {
+            madvise(p, bytes, MADV_DONTNEED);
+        }
+#else
+        (void) p;
+        (void) bytes;
+#endif
+    }
+
+    inline void reserved_page_source::destroy () {
+        upstream->release_chunk(base, count * chunk_bytes);
+        delete this;
+    }
+
+    inline reserved_page_source *reserved_page_source::create (page_source *upstream, size_t chunk_bytes, size_t count) {
+        if (count == 0 || count > SIZE_MAX / chunk_bytes) {
+            return nullptr;
+        }
+        char *base = (char *) upstream->allocate_chunk(count * chunk_bytes, chunk_bytes);
+        if (base == nullptr) {
+            return nullptr;
+        }
+        return new reserved_page_source(upstream, base, chunk_bytes, count);
+    }
+
+    inline void *reserved_page_source::allocate_chunk (size_t bytes, size_t align) {
+        std::lock_guard<std::mutex> guard(lock);
+        if (closed || issued == count || bytes > chunk_bytes || align > chunk_bytes) {
+            return nullptr;
+        }
+        outstanding++;
+        return base + issued++ * chunk_bytes;
+    }
+
+    inline void reserved_page_source::release_chunk (void *p, size_t bytes) {
+        discard(p, bytes);
+        bool last;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            last = --outstanding == 0 && closed;
+        }
+        if (last) {
+            destroy();
+        }
+    }
+
+    inline void reserved_page_source::close () {
+        bool last;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            if (closed) {
+                return;
+            }
+            closed = true;
+            discard(base + issued * chunk_bytes, (count - issued) * chunk_bytes);
+            last = outstanding == 0;
+        }
+        if (last) {
+            destroy();
+        }
+    }
+
+    inline size_t reserved_page_source::remaining () {
+        std::lock_guard<std::mutex> guard(lock);
+        return closed ? 0 : count - issued;
+    }
+
+#if defined(__unix__) || defined(__APPLE__)
+    /**
+     * @description: 用mmap预留大段虚拟地址（PROT_NONE，不占物理内存），用到哪提交到哪
+     *               chunk从预留区里按顺序切，地址连续，方便看；释放的chunk用madvise还掉物理页，地址留着下次复用
+     *               带PER_CLASS时每个size class另外预留自己的区，一个class的chunk只从它自己的区里切、只复用它自己还回来的
+     *               几十个class各占一段预留区，这时reserve_bytes可以设小一点；预留区用完（MAX_REGIONS）后退回共用的区
+     */
+    class mmap_page_source : public page_source {
+        public:
+            enum {
+                USE_THP = 1,        // 提交时madvise(MADV_HUGEPAGE)，用透明大页
+                USE_HUGETLB = 2,    // 提交时用MAP_HUGETLB映射，系统大页不够时退回普通页
+                PER_CLASS = 4       // 每个size class单独一段预留区
+            };
+            enum {MAX_REGIONS = 64};
+            enum {HUGE_PAGE_SIZE = 2 * 1024 * 1024};
+
+            struct region {
+                char *base;         // 预留区起始地址
+                size_t reserved;    // 预留的字节数
+                size_t used;        // 已经切出去的字节数
+                size_t committed;   // 已经提交（可读写）的字节数
+                size_t hugetlb_end; // [base, base + hugetlb_end)是MAP_HUGETLB映射的
+                bool hugetlb_failed;// 大页要不到了，这段预留区之后都用普通页
+                int size_class;     // 专给哪个size class用，-1表示共用（不带PER_CLASS时都是共用的）
+            };
+        private:
+            struct free_slot {
+                void *p;
+                size_t bytes;
+                int size_class;     // 所在预留区的size_class，只给同一个class复用
+            };
+        private:
+            region regions[MAX_REGIONS];
+            size_t nregions;
+            free_slot *free_slots;  // 释放掉的chunk，单独mmap一块放，不往chunk里写，免得把还掉的页又碰回来
+            size_t nfree;
+            size_t max_free;
+            size_t reserve_bytes;
+            size_t commit_step;
+            int flags;
+            std::mutex lock;
+        private:
+            /**
+             * @description: 再预留一段地址给size_class用，起始地址按commit_step和align里大的那个对齐，调用者需持有lock
+             * @param {size_t} align
+             * @param {int} size_class -1表示共用
+             * @return {*}
+             */
+            bool reserve_region (size_t align, int size_class);
+            /**
+             * @description: 保证region的前bytes字节已提交，调用者需持有lock
+             * @param {region} &r
+             * @param {size_t} bytes
+             * @return {*}
+             */
+            bool commit (region &r, size_t bytes);
+            /**
+             * @description: 给size_class切一个chunk：先复用它自己还回来的，再从它最后一段预留区切，不够再预留一段，调用者需持有lock
+             * @param {size_t} bytes
+             * @param {size_t} align
+             * @param {int} size_class -1表示共用
+             * @return {*}
+             */
+            void *carve_locked (size_t bytes, size_t align, int size_class);
+        public:
+            /**
+             * @description: 构造时只记下参数，第一次申请时才预留
+             * @param {size_t} reserve_bytes 每段预留区的大小
+             * @param {size_t} commit_step 每次提交的步长
+             * @param {int} flags USE_THP / USE_HUGETLB / PER_CLASS
+             * @return {*}
+             */
+            explicit mmap_page_source (size_t reserve_bytes = (size_t) 1 << 32, size_t commit_step = HUGE_PAGE_SIZE, int flags = 0);
+            ~mmap_page_source ();
+            mmap_page_source (const mmap_page_source &) = delete;
+            mmap_page_source &operator= (const mmap_page_source &) = delete;
+
+            void *allocate_chunk (size_t bytes, size_t align) override;
+            void release_chunk (void *p, size_t bytes) override;
+            bool per_class () const override { return (flags & PER_CLASS) != 0; }
+            void *allocate_class_chunk (size_t bytes, size_t align, size_t size_class) override;
+
+            size_t region_count ();
+            region region_at (size_t i);
+    };
+
+    mmap_page_source::mmap_page_source (size_t reserve_bytes, size_t commit_step, int flags)
+        : regions(), nregions(0), free_slots(nullptr), nfree(0), max_free(0),
+          reserve_bytes(reserve_bytes), commit_step(commit_step), flags(flags) {
+        // 提交步长按大页对齐，透明大页才能整页生效
+        size_t step_align = (flags & (USE_THP | USE_HUGETLB)) ? (size_t) HUGE_PAGE_SIZE : 4096;
+        this->commit_step = (commit_step + step_align - 1) & ~(step_align - 1);
+        this->reserve_bytes = (reserve_bytes + this->commit_step - 1) / this->commit_step * this->commit_step;
+    }
+
+    mmap_page_source::~mmap_page_source () {
+        for (size_t i = 0; i < nregions; i++) {
+            munmap(regions[i].base, regions[i].reserved);
+        }
+        if (free_slots != nullptr) {
+            munmap(free_slots, max_free * sizeof(free_slot));
+        }
+    }
+
+    bool mmap_page_source::reserve_region (size_t align, int size_class) {
+        if (nregions == MAX_REGIONS) {
+            return false;
+        }
+        if (free_slots == nullptr) {
+            // 最坏情况每64KB一个chunk，按这个估计能放下所有释放掉的chunk
+            max_free = reserve_bytes / 65536 * MAX_REGIONS;
+            void *slots = mmap(nullptr, max_free * sizeof(free_slot), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (slots == MAP_FAILED) {
+                return false;
+            }
+            free_slots = (free_slot *) slots;
+        }
+        int map_flags = MAP_PRIVATE | MAP_ANONYMOUS;
+#if defined(MAP_NORESERVE)
+        map_flags |= MAP_NORESERVE;
+#endif
+        // 多预留一个对齐单位，把起始地址对齐到提交步长和chunk对齐里大的那个，第一个chunk就不用跳过一段
+        size_t base_align = align > commit_step ? align : commit_step;
+        size_t bytes = reserve_bytes + base_align;
+        char *raw = (char *) mmap(nullptr, bytes, PROT_NONE, map_flags, -1, 0);
+        if (raw == (char *) MAP_FAILED) {
+            return false;
+        }
+        char *aligned = (char *) (((uintptr_t) raw + base_align - 1) & ~(uintptr_t) (base_align - 1));
+        if (aligned > raw) {
+            munmap(raw, aligned - raw);
+        }
+        size_t tail = (raw + bytes) - (aligned + reserve_bytes);
+        if (tail > 0) {
+            munmap(aligned + reserve_bytes, tail);
+        }
+        region &r = regions[nregions];
+        r.base = aligned;
+        r.reserved = reserve_bytes;
+        r.used = 0;
+        r.committed = 0;
+        r.hugetlb_end = 0;
+        r.hugetlb_failed = false;
+        r.size_class = size_class;
+        nregions++;
+        return true;
+    }
+
+    bool mmap_page_source::commit (region &r, size_t bytes) {
+        if (bytes <= r.committed) {
+            return true;
+        }
+        size_t target = (bytes + commit_step - 1) / commit_step * commit_step;
+        if (target > r.reserved) {
+            target = r.reserved;
+        }
+        char *start = r.base + r.committed;
+        size_t len = target - r.committed;
+        bool mapped = false;
+#if defined(MAP_HUGETLB)
+        if ((flags & USE_HUGETLB) && !r.hugetlb_failed) {
+            // 不加MAP_NORESERVE，大页不够时mmap直接失败，而不是用到的时候SIGBUS
+            void *p = mmap(start, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED | MAP_HUGETLB, -1, 0);
+            if (p != MAP_FAILED) {
+                r.committed = r.hugetlb_end = target;
+                return true;
+            }
+            // MAP_FIXED失败时原来的映射可能已经被拆掉了，不能再mprotect，按普通页重新映射这一段
+            r.hugetlb_failed = true;
+            if (mmap(start, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) == MAP_FAILED) {
+                return false;
+            }
+            mapped = true;
+        }
+#endif
+        if (!mapped && mprotect(start, len, PROT_READ | PROT_WRITE) != 0) {
+            return false;
+        }
+#if defined(MADV_HUGEPAGE)
+        if (flags & USE_THP) {
+            madvise(start, len, MADV_HUGEPAGE);
+        }
+#endif
+        r.committed = target;
+        return true;
+    }
+
+    void *mmap_page_source::carve_locked (size_t bytes, size_t align, int size_class) {
+        // 先复用这个class释放掉的同样大小的chunk
+        for (size_t i = nfree; i > 0; i--) {
+            free_slot &f = free_slots[i - 1];
+            if (f.bytes == bytes && f.size_class == size_class && ((uintptr_t) f.p & (align - 1)) == 0) {
+                void *p = f.p;
+                f = free_slots[--nfree];
+                return p;
+            }
+        }
+        if (bytes > reserve_bytes) {
+            return nullptr;
+        }
+        region *r = nullptr;
+        for (size_t i = nregions; i > 0; i--) {
+            if (regions[i - 1].size_class == size_class) {
+                r = regions + i - 1;
+                break;
+            }
+        }
+        // 对齐的是绝对地址，预留区起始地址只保证按commit_step对齐，步长比align小时按偏移对齐会切出没对齐的chunk
+        size_t offset = 0;
+        if (r != nullptr) {
+            offset = (size_t) ((((uintptr_t) r->base + r->used + align - 1) & ~(uintptr_t) (align - 1)) - (uintptr_t) r->base);
+        }
+        if (r == nullptr || offset + bytes > r->reserved) {
+            if (!reserve_region(align, size_class)) {
+                return nullptr;
+            }
+            r = regions + nregions - 1;
+            offset = 0;
+        }
+        if (!commit(*r, offset + bytes)) {
+            return nullptr;
+        }
+        r->used = offset + bytes;
+        return r->base + offset;
+    }
+
+    void *mmap_page_source::allocate_chunk (size_t bytes, size_t align) {
+        std::lock_guard<std::mutex> guard(lock);
+        return carve_locked(bytes, align, -1);
+    }
+
+    void *mmap_page_source::allocate_class_chunk (size_t bytes, size_t align, size_t size_class) {
+        std::lock_guard<std::mutex> guard(lock);
+        void *p = nullptr;
+        if ((flags & PER_CLASS) && size_class < (size_t) INT_MAX) {
+            p = carve_locked(bytes, align, (int) size_class);
+        }
+        // 没开PER_CLASS，或者预留区个数用完了，从共用的区切
+        return p != nullptr ? p : carve_locked(bytes, align, -1);
+    }
+
+    void mmap_page_source::release_chunk (void *p, size_t bytes) {
+        std::lock_guard<std::mutex> guard(lock);
+        bool hugetlb = false;
+        int size_class = -1;
+        for (size_t i = 0; i < nregions; i++) {
+            if ((char *) p >= regions[i].base && (char *) p < regions[i].base + regions[i].reserved) {
+                hugetlb = (char *) p < regions[i].base + regions[i].hugetlb_end;
+                size_class = regions[i].size_class;
+                break;
+            }
+        }
+        // MAP_HUGETLB的映射只能整个大页还，chunk比大页小，就不还物理页了，只留着复用
+        // 透明大页上还一部分时内核会先把大页拆开，拆分是延后做的，RSS不一定马上降下来
+        if (!hugetlb) {
+            madvise(p, bytes, MADV_DONTNEED);
+        }
+        if (nfree < max_free) {
+            free_slots[nfree].p = p;
+            free_slots[nfree].bytes = bytes;
+            free_slots[nfree].size_class = size_class;
+            nfree++;
+        }
+    }
+
+    size_t mmap_page_source::region_count () {
+        std::lock_guard<std::mutex> guard(lock);
+        return nregions;
+    }
+
+    mmap_page_source::region mmap_page_source::region_at (size_t i) {
+        std::lock_guard<std::mutex> guard(lock);
+        return regions[i];
+    }
+#endif
+} // namespace tinystl
+
+#endif
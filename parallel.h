@@ -0,0 +1,255 @@
+/*
+ * @Author: suzy HideSue@github.com
+ * @Date: 2026-10-18 22:14:07
+ * @LastEditors: suzy HideSue@github.com
+ * @LastEditTime: 2026-10-18 22:14:07
+ * @FilePath: /tinystl/parallel.h
+ * @Description: uninitialized_copy、uninitialized_fill_n、destroy的并行版本，第一个参数传执行策略tinystl::par
+ *               随机访问区间按PARALLEL_GRAIN_BYTES切块交给thread_pool，其他迭代器和太短的区间退回串行版本
+ *               刚申请的大缓冲区页还没有分配物理内存，哪个线程先写就落在哪个NUMA节点上（first touch）
+ *               每个线程拿到连续的一段，以后用同样的切法并行访问时大多是本地内存
+ *               任何一块抛异常，等所有块结束后把已经构造好的块全部析构，再抛出第一个异常
+ *
+ * Copyright (c) 2023 by ${suzy HideSue@github.com}, All Rights Reserved.
+ */
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include<atomic>
+#include<cstddef>
+#include<iterator>
+#include<type_traits>
+#include<vector>
+#include "construct.h"
+#include "uninitialized.h"
+#include "thread_pool.h"
+
+// 每块至少这么多字节，和STREAM_COPY_BYTES一样大，每块自己的POD拷贝仍然能走streaming store
+#ifndef TINYSTL_PARALLEL_GRAIN_BYTES
+#define TINYSTL_PARALLEL_GRAIN_BYTES (8 * 1024 * 1024)
+#endif
+
+namespace tinystl
+{
+    enum {PARALLEL_GRAIN_BYTES = TINYSTL_PARALLEL_GRAIN_BYTES};
+
+    /**
+     * @description: 并行执行策略，默认用thread_pool::instance()，par.on(pool)换成自己的线程池
+     */
+    struct parallel_policy {
+        thread_pool *pool;
+
+        constexpr parallel_policy on (thread_pool &p) const { return parallel_policy{&p}; }
+        thread_pool &get_pool () const { return pool != nullptr ? *pool : thread_pool::instance(); }
+    };
+
+    inline constexpr parallel_policy par{nullptr};
+
+    /**
+     * @description: 迭代器是不是随机访问的，tinystl和std的标签都认
+     */
+    template<class Iterator>
+    struct __is_random_access : bool_constant<
+        std::is_base_of<random_access_iterator_tag, typename iterator_traits<Iterator>::iterator_category>::value
+        || std::is_base_of<std::random_access_iterator_tag, typename iterator_traits<Iterator>::iterator_category>::value> {};
+
+    /**
+     * @description: 把n个元素切成块，每块至少PARALLEL_GRAIN_BYTES，线程池只有调用线程一个人时只切一块
+     */
+    struct __chunk_plan {
+        size_t n;
+        size_t chunk;       // 每块的元素数
+        size_t chunks;
+
+        __chunk_plan (thread_pool &pool, size_t count, size_t elem_bytes) : n(count) {
+            size_t grain = ((size_t) PARALLEL_GRAIN_BYTES + elem_bytes - 1) / elem_bytes;
+            if (pool.concurrency() == 1 || count < 2 * grain) {
+                chunk = count;
+                chunks = count != 0 ? 1 : 0;
+            } else {
+                chunk = grain;
+                chunks = (count + grain - 1) / grain;
+            }
+        }
+        size_t begin (size_t i) const { return i * chunk; }
+        size_t end (size_t i) const { return i + 1 == chunks ? n : (i + 1) * chunk; }
+    };
+
+    /**
+     * @description: 每块调用body(begin, end)，成功的块在done里记1；有一块失败后还没开始的块直接跳过
+     *               所有块结束后重新抛出第一个异常
+     * @param {thread_pool} &pool
+     * @param {__chunk_plan} &plan
+     * @param {unsigned char} *done 可以是nullptr，这时不记录
+     * @param {Body} &body
+     * @return {*}
+     */
+    template<class Body>
+    void __parallel_chunks (thread_pool &pool, const __chunk_plan &plan, unsigned char *done, Body &body) {
+        struct context {
+            const __chunk_plan *plan;
+            unsigned char *done;
+            Body *body;
+            std::atomic<bool> failed;
+        } ctx{&plan, done, &body, {false}};
+        pool.parallel_for(plan.chunks, [] (void *p, size_t i) {
+            context *c = (context *) p;
+            if (c->failed.load(std::memory_order_relaxed)) {
+                return;
+            }
+            try {
+                (*c->body)(c->plan->begin(i), c->plan->end(i));
+            } catch (...) {
+                c->failed.store(true, std::memory_order_relaxed);
+                throw;
+            }
+            if (c->done != nullptr) {
+                c->done[i] = 1;
+            }
+        }, &ctx);
+    }
+
+    /**
+     * @description: 析构done里标了1的块，给异常回滚用
+     * @param {thread_pool} &pool
+     * @param {__chunk_plan} &plan
+     * @param {unsigned char} *done
+     * @param {ForwardIterator} result
+     * @return {*}
+     */
+    template<class ForwardIterator>
+    void __destroy_done_chunks (thread_pool &pool, const __chunk_plan &plan, const unsigned char *done, ForwardIterator result) {
+        auto body = [&] (size_t b, size_t e) {
+            for (size_t i = b; i < e; i++) {
+                if (done[i]) {
+                    tinystl::destroy(result + plan.begin(i), result + plan.end(i));
+                }
+            }
+        };
+        // 每个块单独作为一个任务
+        __chunk_plan per_chunk = plan;
+        per_chunk.n = plan.chunks;
+        per_chunk.chunk = 1;
+        __parallel_chunks(pool, per_chunk, nullptr, body);
+    }
+
+    /**
+     * @description: 并行的uninitialized_copy，源和目标都是随机访问迭代器时切块并行，否则走串行版本
+     * @param {parallel_policy} &policy
+     * @param {InputIterator} first
+     * @param {InputIterator} last
+     * @param {ForwardIterator} result
+     * @return {*}
+     */
+    template<class InputIterator, class ForwardIterator>
+    ForwardIterator uninitialized_copy (const parallel_policy &policy, InputIterator first, InputIterator last, ForwardIterator result) {
+        if constexpr (!__is_random_access<InputIterator>::value || !__is_random_access<ForwardIterator>::value) {
+            return tinystl::uninitialized_copy(first, last, result);
+        } else {
+            typedef typename iterator_traits<ForwardIterator>::value_type T;
+            thread_pool &pool = policy.get_pool();
+            __chunk_plan plan(pool, (size_t) (last - first), sizeof(T));
+            if (plan.chunks <= 1) {
+                return tinystl::uninitialized_copy(first, last, result);
+            }
+            std::vector<unsigned char> done(plan.chunks);
+            auto body = [&] (size_t b, size_t e) {
+                tinystl::uninitialized_copy(first + b, first + e, result + b);
+            };
+            try {
+                __parallel_chunks(pool, plan, done.data(), body);
+            } catch (...) {
+                __destroy_done_chunks(pool, plan, done.data(), result);
+                throw;
+            }
+            return result + plan.n;
+        }
+    }
+
+    /**
+     * @description: 并行的uninitialized_fill_n，适合把刚申请的大缓冲区初始化，顺便让每段页落在干活的线程所在的节点上
+     * @param {parallel_policy} &policy
+     * @param {ForwardIterator} first
+     * @param {Size} n
+     * @param {T} &x
+     * @return {*}
+     */
+    template<class ForwardIterator, class Size, class T>
+    ForwardIterator uninitialized_fill_n (const parallel_policy &policy, ForwardIterator first, Size n, const T &x) {
+        if constexpr (!__is_random_access<ForwardIterator>::value) {
+            return tinystl::uninitialized_fill_n(first, n, x);
+        } else {
+            typedef typename iterator_traits<ForwardIterator>::value_type T1;
+            if (n <= 0) {
+                return first;
+            }
+            thread_pool &pool = policy.get_pool();
+            __chunk_plan plan(pool, (size_t) n, sizeof(T1));
+            if (plan.chunks <= 1) {
+                return tinystl::uninitialized_fill_n(first, n, x);
+            }
+            std::vector<unsigned char> done(plan.chunks);
+            auto body = [&] (size_t b, size_t e) {
+                tinystl::uninitialized_fill_n(first + b, e - b, x);
+            };
+            try {
+                __parallel_chunks(pool, plan, done.data(), body);
+            } catch (...) {
+                __destroy_done_chunks(pool, plan, done.data(), first);
+                throw;
+            }
+            return first + plan.n;
+        }
+    }
+
+    /**
+     * @description: 并行析构[first, last)，析构是trivial的类型什么都不做
+     * @param {parallel_policy} &policy
+     * @param {ForwardIterator} first
+     * @param {ForwardIterator} last
+     * @return {*}
+     */
+    template<class ForwardIterator>
+    void destroy (const parallel_policy &policy, ForwardIterator first, ForwardIterator last) {
+        typedef typename iterator_traits<ForwardIterator>::value_type T;
+        if constexpr (type_traits<T>::has_trivial_destructor::value) {
+            return;
+        } else if constexpr (!__is_random_access<ForwardIterator>::value) {
+            tinystl::destroy(first, last);
+        } else {
+            thread_pool &pool = policy.get_pool();
+            __chunk_plan plan(pool, (size_t) (last - first), sizeof(T));
+            if (plan.chunks <= 1) {
+                tinystl::destroy(first, last);
+                return;
+            }
+            auto body = [&] (size_t b, size_t e) {
+                tinystl::destroy(first + b, first + e);
+            };
+            __parallel_chunks(pool, plan, nullptr, body);
+        }
+    }
+
+    /**
+     * @description: 按和上面几个函数一样的切法，每页写一个字节，让还没碰过的内存按页落在各个线程的节点上
+     *               给之后才会逐步构造、但希望先定好物理页位置的大缓冲区用
+     * @param {parallel_policy} &policy
+     * @param {void} *p
+     * @param {size_t} bytes
+     * @return {*}
+     */
+    inline void first_touch (const parallel_policy &policy, void *p, size_t bytes) {
+        enum {TOUCH_STRIDE = 4096};
+        thread_pool &pool = policy.get_pool();
+        __chunk_plan plan(pool, bytes, 1);
+        volatile char *base = (volatile char *) p;
+        auto body = [base] (size_t b, size_t e) {
+            for (size_t i = b; i < e; i += TOUCH_STRIDE) {
+                base[i] = 0;
+            }
+        };
+        __parallel_chunks(pool, plan, nullptr, body);
+    }
+} // namespace tinystl
+
+#endif
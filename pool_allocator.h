@@ -0,0 +1,93 @@
+/*
+ * @Author: suzy HideSue@github.com
+ * @Date: 2026-10-18 20:55:09
+ * @LastEditors: suzy HideSue@github.com
+ * @LastEditTime: 2026-10-18 21:22:50
+ * @FilePath: /tinystl/pool_allocator.h
+ * @Description: 满足标准库Allocator要求的适配器，std::vector、std::list、std::unordered_map等可以直接用alloc的内存池
+ *               没有状态，所有实例都相等，按n * sizeof(T)的大小走alloc的三个层级
+ *
+ * Copyright (c) 2023 by ${suzy HideSue@github.com}, All Rights Reserved.
+ */
+#ifndef POOL_ALLOCATOR_H
+#define POOL_ALLOCATOR_H
+
+#include<cstddef>
+#include<new>
+#include<type_traits>
+#include "alloc.h"
+
+namespace tinystl
+{
+    /**
+     * @description: Alloc是静态接口的配置器（alloc、arena_alloc），用法 std::list<int, pool_allocator<int>>
+     */
+    template<class T, class Alloc = alloc>
+    class pool_allocator {
+        public:
+            typedef T           value_type;
+            typedef T*          pointer;
+            typedef const T*    const_pointer;
+            typedef T&          reference;
+            typedef const T&    const_reference;
+            typedef size_t      size_type;
+            typedef ptrdiff_t   difference_type;
+
+            // 没有状态，容器拷贝、移动、交换时怎么处理配置器都一样
+            typedef std::true_type propagate_on_container_copy_assignment;
+            typedef std::true_type propagate_on_container_move_assignment;
+            typedef std::true_type propagate_on_container_swap;
+            typedef std::true_type is_always_equal;
+
+            template<class U>
+            struct rebind {
+                typedef pool_allocator<U, Alloc> other;
+            };
+
+            constexpr pool_allocator () noexcept {}
+            template<class U>
+            constexpr pool_allocator (const pool_allocator<U, Alloc> &) noexcept {}
+
+            /**
+             * @description: 申请n个T，对齐要求超过ALIGN的类型走allocate_aligned，超过一页的交给带对齐参数的operator new
+             * @param {size_type} n
+             * @return {*}
+             */
+            T *allocate (size_type n) {
+                if (n > max_size()) {
+                    throw std::bad_array_new_length();
+                }
+                if constexpr (alignof(T) > (size_t) PAGE_SIZE) {
+                    return (T *) ::operator new(n * sizeof(T), std::align_val_t(alignof(T)));
+                } else if constexpr (alignof(T) > (size_t) ALIGN) {
+                    return (T *) Alloc::allocate_aligned(n * sizeof(T), alignof(T));
+                } else {
+                    return (T *) Alloc::allocate(n * sizeof(T));
+                }
+            }
+            void deallocate (T *p, size_type n) noexcept {
+                if constexpr (alignof(T) > (size_t) PAGE_SIZE) {
+                    ::operator delete(p, std::align_val_t(alignof(T)));
+                } else if constexpr (alignof(T) > (size_t) ALIGN) {
+                    Alloc::deallocate_aligned(p, n * sizeof(T), alignof(T));
+                } else {
+                    Alloc::deallocate(p, n * sizeof(T));
+                }
+            }
+            size_type max_size () const noexcept {
+                return (size_type) -1 / sizeof(T);
+            }
+    };
+
+    template<class T, class U, class Alloc>
+    constexpr bool operator== (const pool_allocator<T, Alloc> &, const pool_allocator<U, Alloc> &) noexcept {
+        return true;
+    }
+
+    template<class T, class U, class Alloc>
+    constexpr bool operator!= (const pool_allocator<T, Alloc> &, const pool_allocator<U, Alloc> &) noexcept {
+        return false;
+    }
+} // namespace tinystl
+
+#endif
@@ -0,0 +1,143 @@
+/*
+ * @Author: suzy HideSue@github.com
+ * @Date: 2026-10-18 23:58:40
+ * @LastEditors: suzy HideSue@github.com
+ * @LastEditTime: 2026-10-19 18:05:12
+ * @FilePath: /tinystl/pool_profile.h
+ * @Description: 内存池每个size class要预热多少个区块、页级区块要预备多少页，取自上一次运行的高水位（alloc::high_water()）
+ *               存成文本文件，下次启动时读回来交给alloc::warm_up，一开始就不用在refill、chunk_alloc里慢慢攒
+ *               文件每行"区块大小 区块数"，页级区块一行"pages 页数"，#开头的是注释；size class表变了也能读，按大小重新归到现在的class
+ *
+ * Copyright (c) 2023 by ${suzy HideSue@github.com}, All Rights Reserved.
+ */
+#ifndef POOL_PROFILE_H
+#define POOL_PROFILE_H
+
+#include<cstddef>
+#include<fstream>
+#include<istream>
+#include<ostream>
+#include<sstream>
+#include<string>
+#include "size_class.h"
+#include "page_heap.h"
+
+namespace tinystl
+{
+    struct pool_profile {
+        size_t depth[NFREELISTS];       // 每个class的目标区块数
+        size_t pages;                   // 页级区块的目标页数
+
+        /**
+         * @description: 所有class加上页级区块的字节数
+         * @return {*}
+         */
+        size_t bytes () const;
+        /**
+         * @description: 只输出非零的class
+         * @param {ostream} &os
+         * @return {*}
+         */
+        void write_text (std::ostream &os) const;
+        /**
+         * @description: 读write_text的格式，先清零；同一个class出现多次时取大的，超过MAX_BYTES的行忽略，没有pages行的老文件页数是0
+         * @param {istream} &is
+         * @return {*} 有读不懂的行时返回false，已经读到的照样留着
+         */
+        bool read_text (std::istream &is);
+        /**
+         * @description: 写到文件里，写不了返回false
+         * @param {char} *path
+         * @return {*}
+         */
+        bool save (const char *path) const;
+        /**
+         * @description: 从文件读，文件不存在或者格式不对返回false
+         * @param {char} *path
+         * @return {*}
+         */
+        bool load (const char *path);
+    };
+
+    inline size_t pool_profile::bytes () const {
+        size_t total = 0;
+        for (size_t i = 0; i < NFREELISTS; i++) {
+            total += depth[i] * size_classes.size[i];
+        }
+        return total + pages * PAGE_SIZE;
+    }
+
+    inline void pool_profile::write_text (std::ostream &os) const {
+        os << "# tinystl pool profile v2\n# size depth\n";
+        for (size_t i = 0; i < NFREELISTS; i++) {
+            if (depth[i] != 0) {
+                os << size_classes.size[i] << ' ' << depth[i] << '\n';
+            }
+        }
+        if (pages != 0) {
+            os << "pages " << pages << '\n';
+        }
+    }
+
+    inline bool pool_profile::read_text (std::istream &is) {
+        for (size_t i = 0; i < NFREELISTS; i++) {
+            depth[i] = 0;
+        }
+        pages = 0;
+        bool ok = true;
+        std::string line;
+        while (std::getline(is, line)) {
+            size_t start = line.find_first_not_of(" \t\r");
+            if (start == std::string::npos || line[start] == '#') {
+                continue;
+            }
+            std::istringstream fields(line);
+            size_t size, count;
+            if (line.compare(start, 5, "pages") == 0) {
+                fields.seekg(start + 5);
+                if (!(fields >> count)) {
+                    ok = false;
+                } else if (count > pages) {
+                    pages = count;
+                }
+                continue;
+            }
+            if (!(fields >> size >> count) || size == 0) {
+                ok = false;
+                continue;
+            }
+            if (size > (size_t) MAX_BYTES) {
+                continue;
+            }
+            size_t index = size_classes.index[(size + ALIGN - 1) / ALIGN];
+            if (count > depth[index]) {
+                depth[index] = count;
+            }
+        }
+        return ok;
+    }
+
+    inline bool pool_profile::save (const char *path) const {
+        std::ofstream out(path);
+        if (!out) {
+            return false;
+        }
+        write_text(out);
+        out.flush();
+        return (bool) out;
+    }
+
+    inline bool pool_profile::load (const char *path) {
+        std::ifstream in(path);
+        if (!in) {
+            for (size_t i = 0; i < NFREELISTS; i++) {
+                depth[i] = 0;
+            }
+            pages = 0;
+            return false;
+        }
+        return read_text(in);
+    }
+} // namespace tinystl
+
+#endif
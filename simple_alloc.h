@@ -2,9 +2,10 @@
  * @Author: suzy HideSue@github.com
  * @Date: 2023-11-24 16:23:29
  * @LastEditors: suzy HideSue@github.com
- * @LastEditTime: 2023-11-25 17:21:44
+ * @LastEditTime: 2026-10-18 23:52:07
  * @FilePath: /tinystl/simple_alloc.h
  * @Description: 调用alloc，负责空间的创建和回收（又单独套了一层）
+ *               Alloc可以换成任何静态接口的配置器，包括alloc_policy.h里组合出来的策略
  * 
  * Copyright (c) 2023 by ${suzy HideSue@github.com}, All Rights Reserved. 
  */
@@ -32,6 +33,18 @@ namespace tinystl
             static void deallocate (T *p) {
                 Alloc::deallocate(p, sizeof(T));
             }
+            /**
+             * @description: 一次申请count个T，每个单独一块，给链表、树这种节点式容器批量建节点用
+             * @param {T} **out
+             * @param {size_t} count
+             * @return {*}
+             */
+            static void allocate_batch (T **out, size_t count) {
+                Alloc::allocate_batch(sizeof(T), (void **) out, count);
+            }
+            static void deallocate_batch (T **ptrs, size_t count) {
+                Alloc::deallocate_batch((void **) ptrs, count, sizeof(T));
+            }
     };
 } // namespace tinystl
 
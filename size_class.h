@@ -0,0 +1,120 @@
+/*
+ * @Author: suzy HideSue@github.com
+ * @Date: 2026-10-18 11:02:15
+ * @LastEditors: suzy HideSue@github.com
+ * @LastEditTime: 2026-10-18 21:22:50
+ * @FilePath: /tinystl/size_class.h
+ * @Description: 内存池的size class表，编译期生成
+ *               LINEAR_BYTES以内按ALIGN等距分级，之后每翻一倍再分CLASS_STEPS级，直到MAX_BYTES
+ *               内部碎片不超过 1/CLASS_STEPS，编译时可以用宏改配置
+ *               16、32、64字节这类大小是2的幂倍数的class，区块按自然对齐切出来，最多对齐到cache line
+ *
+ * Copyright (c) 2023 by ${suzy HideSue@github.com}, All Rights Reserved.
+ */
+#ifndef SIZE_CLASS_H
+#define SIZE_CLASS_H
+
+#include<cstddef>
+
+#ifndef TINYSTL_ALLOC_ALIGN
+#define TINYSTL_ALLOC_ALIGN 8           // 小型区块的上调边界
+#endif
+#ifndef TINYSTL_ALLOC_LINEAR_BYTES
+#define TINYSTL_ALLOC_LINEAR_BYTES 128  // 这以内按ALIGN等距分级
+#endif
+#ifndef TINYSTL_ALLOC_MAX_BYTES
+#define TINYSTL_ALLOC_MAX_BYTES 4096    // 小型区块的上限
+#endif
+#ifndef TINYSTL_ALLOC_CLASS_STEPS
+#define TINYSTL_ALLOC_CLASS_STEPS 4     // 每翻一倍分几级
+#endif
+#ifndef TINYSTL_ALLOC_BATCH_BYTES
+#define TINYSTL_ALLOC_BATCH_BYTES 32768 // 一次批量搬运的字节数上限，大区块一次少搬几个
+#endif
+#ifndef TINYSTL_ALLOC_CACHE_LINE
+#define TINYSTL_ALLOC_CACHE_LINE 64     // cache line大小，区块的自然对齐最多到这里
+#endif
+#ifndef TINYSTL_ALLOC_REFILL_BYTES
+#define TINYSTL_ALLOC_REFILL_BYTES 65536 // refill一次从内存池切的字节数上限，自适应批量最多涨到这么大
+#endif
+
+namespace tinystl
+{
+    enum {ALIGN = TINYSTL_ALLOC_ALIGN};
+    enum {LINEAR_BYTES = TINYSTL_ALLOC_LINEAR_BYTES};
+    enum {MAX_BYTES = TINYSTL_ALLOC_MAX_BYTES};
+    enum {CLASS_STEPS = TINYSTL_ALLOC_CLASS_STEPS};
+    enum {BATCH_OBJS = 20};                 // 线程缓存和中心池之间一次搬运的区块数（小区块）
+    enum {BATCH_BYTES = TINYSTL_ALLOC_BATCH_BYTES};
+    enum {CACHE_LINE = TINYSTL_ALLOC_CACHE_LINE};
+    enum {REFILL_BYTES = TINYSTL_ALLOC_REFILL_BYTES};
+    enum {REFILL_MIN_OBJS = 2};             // 自适应refill批量的下限，冷的class从这里起步
+    enum {REFILL_MAX_OBJS = 512};           // 自适应refill批量的上限（小区块）
+
+    static_assert((ALIGN & (ALIGN - 1)) == 0 && ALIGN >= sizeof(void *), "ALIGN必须是2的幂且放得下一个指针");
+    static_assert(LINEAR_BYTES % ALIGN == 0 && (size_t) LINEAR_BYTES <= (size_t) MAX_BYTES, "LINEAR_BYTES必须是ALIGN的倍数且不超过MAX_BYTES");
+    static_assert(MAX_BYTES % ALIGN == 0, "MAX_BYTES必须是ALIGN的倍数");
+    static_assert(CLASS_STEPS > 0, "CLASS_STEPS至少为1");
+    static_assert((CACHE_LINE & (CACHE_LINE - 1)) == 0 && (size_t) CACHE_LINE >= (size_t) ALIGN, "CACHE_LINE必须是2的幂且不小于ALIGN");
+
+    /**
+     * @description: 当前class的下一级大小
+     * @param {size_t} size
+     * @return {*}
+     */
+    constexpr size_t __next_class_size (size_t size) {
+        if (size < LINEAR_BYTES) {
+            return size + ALIGN;
+        }
+        size_t pow2 = 1;
+        while (pow2 * 2 <= size) {
+            pow2 *= 2;
+        }
+        size_t step = (pow2 / CLASS_STEPS + ALIGN - 1) & ~(size_t)(ALIGN - 1);
+        size_t next = size + step;
+        return next > MAX_BYTES ? (size_t) MAX_BYTES : next;
+    }
+
+    constexpr size_t __count_size_classes () {
+        size_t n = 1;
+        for (size_t s = ALIGN; s < MAX_BYTES; s = __next_class_size(s)) {
+            n++;
+        }
+        return n;
+    }
+
+    enum {NFREELISTS = __count_size_classes()};  // freelist个数
+    static_assert(NFREELISTS <= 255, "size class太多，index表放不下");
+
+    struct size_class_table {
+        size_t size[NFREELISTS];                        // 每个class的区块大小
+        size_t batch[NFREELISTS];                       // 每个class一次搬运的区块数
+        size_t refill_max[NFREELISTS];                  // 每个class自适应refill批量的默认上限
+        size_t align[NFREELISTS];                       // 每个class区块的自然对齐：能整除大小的最大2的幂，最多CACHE_LINE
+        unsigned char index[MAX_BYTES / ALIGN + 1];     // (bytes + ALIGN - 1) / ALIGN -> class
+
+        constexpr size_class_table () : size(), batch(), refill_max(), align(), index() {
+            size_t s = ALIGN;
+            for (size_t i = 0; i < NFREELISTS; i++, s = __next_class_size(s)) {
+                size[i] = s;
+                size_t b = BATCH_BYTES / s;
+                batch[i] = b > (size_t) BATCH_OBJS ? (size_t) BATCH_OBJS : (b < 2 ? 2 : b);
+                size_t r = REFILL_BYTES / s;
+                refill_max[i] = r > (size_t) REFILL_MAX_OBJS ? (size_t) REFILL_MAX_OBJS : (r < batch[i] ? batch[i] : r);
+                size_t a = s & (~s + 1);
+                align[i] = a > (size_t) CACHE_LINE ? (size_t) CACHE_LINE : a;
+            }
+            size_t cls = 0;
+            for (size_t k = 0; k <= MAX_BYTES / ALIGN; k++) {
+                while (size[cls] < k * ALIGN) {
+                    cls++;
+                }
+                index[k] = (unsigned char) cls;
+            }
+        }
+    };
+
+    inline constexpr size_class_table size_classes{};
+} // namespace tinystl
+
+#endif
@@ -0,0 +1,164 @@
+/*
+ * @Author: suzy HideSue@github.com
+ * @Date: 2026-10-19 16:20:15
+ * @LastEditors: suzy HideSue@github.com
+ * @LastEditTime: 2026-10-19 16:20:15
+ * @FilePath: /tinystl/tests/alloc_hardened_test.cpp
+ * @Description: 硬化模式（TINYSTL_ALLOC_HARDENED）的检查测试：查到破坏时要打印原因并abort
+ *               每个用例fork一个子进程去做破坏，父进程检查子进程是不是被SIGABRT杀掉、stderr里有没有对应的原因
+ *               用法：alloc_hardened_test 用例名
+ *
+ * Copyright (c) 2023 by ${suzy HideSue@github.com}, All Rights Reserved.
+ */
+#include<csignal>
+#include<cstdio>
+#include<cstring>
+#include<string>
+#include<vector>
+#include<sys/wait.h>
+#include<unistd.h>
+#include "alloc.h"
+
+#ifndef TINYSTL_ALLOC_HARDENED
+#error "alloc_hardened_test要定义TINYSTL_ALLOC_HARDENED编译"
+#endif
+
+namespace
+{
+    /**
+     * @description: 在子进程里跑fn，子进程必须因为SIGABRT退出，并且stderr里包含message
+     * @param {void} (*fn)
+     * @param {char} *message
+     * @return {*}
+     */
+    bool dies_with (void (*fn) (), const char *message) {
+        int fds[2];
+        if (pipe(fds) != 0) {
+            perror("pipe");
+            return false;
+        }
+        fflush(stdout);
+        fflush(stderr);
+        pid_t pid = fork();
+        if (pid < 0) {
+            perror("fork");
+            return false;
+        }
+        if (pid == 0) {
+            close(fds[0]);
+            dup2(fds[1], STDERR_FILENO);
+            fn();
+            _exit(0);
+        }
+        close(fds[1]);
+        std::string output;
+        char buf[256];
+        ssize_t got;
+        while ((got = read(fds[0], buf, sizeof(buf))) > 0) {
+            output.append(buf, (size_t) got);
+        }
+        close(fds[0]);
+        int status = 0;
+        waitpid(pid, &status, 0);
+        bool aborted = WIFSIGNALED(status) && WTERMSIG(status) == SIGABRT;
+        bool found = output.find(message) != std::string::npos;
+        if (!aborted || !found) {
+            fprintf(stderr, "expected abort with \"%s\", got %s, output: %s\n", message,
+                    aborted ? "SIGABRT" : "no abort", output.c_str());
+        }
+        return aborted && found;
+    }
+
+    void double_free () {
+        void *p = tinystl::alloc::allocate(40);
+        tinystl::alloc::deallocate(p, 40);
+        tinystl::alloc::deallocate(p, 40);
+    }
+
+    void overflow () {
+        char *p = (char *) tinystl::alloc::allocate(40);
+        p[40] = 'x';
+        tinystl::alloc::deallocate(p, 40);
+    }
+
+    void underflow () {
+        char *p = (char *) tinystl::alloc::allocate(40);
+        p[-1] = 'x';
+        tinystl::alloc::deallocate(p, 40);
+    }
+
+    void size_mismatch () {
+        void *p = tinystl::alloc::allocate(40);
+        tinystl::alloc::deallocate(p, 400);
+    }
+
+    void write_after_free () {
+        char *p = (char *) tinystl::alloc::allocate(40);
+        tinystl::alloc::deallocate(p, 40);
+        p[8] = 'x';
+        // 再释放一批把它挤出隔离区，出隔离区时检查毒值
+        for (int i = 0; i < 2 * tinystl::QUARANTINE_BLOCKS; i++) {
+            tinystl::alloc::deallocate(tinystl::alloc::allocate(40), 40);
+        }
+    }
+
+    // 正常使用不能误报
+    bool clean_run () {
+        std::vector<void *> v;
+        for (int round = 0; round < 4; round++) {
+            for (size_t i = 0; i < 5000; i++) {
+                size_t n = 1 + i * 7 % (tinystl::MAX_PAGE_BYTES + 1000);
+                void *p = tinystl::alloc::allocate(n);
+                memset(p, 0x5a, n);
+                v.push_back(p);
+            }
+            for (size_t i = 0; i < v.size(); i++) {
+                tinystl::alloc::deallocate(v[i], 1 + i * 7 % (tinystl::MAX_PAGE_BYTES + 1000));
+            }
+            v.clear();
+            void *a = tinystl::alloc::allocate_aligned(100, 256);
+            memset(a, 1, 100);
+            tinystl::alloc::deallocate_aligned(a, 100, 256);
+            void *r = tinystl::alloc::allocate(100);
+            memset(r, 1, 100);
+            r = tinystl::alloc::reallocate(r, 100, 5000);
+            memset(r, 1, 5000);
+            tinystl::alloc::deallocate(r, 5000);
+        }
+        tinystl::alloc::trim();
+        return true;
+    }
+
+    struct test_case {
+        const char *name;
+        void (*fn) ();
+        const char *message;    // nullptr表示不该abort
+    };
+
+    const test_case cases[] = {
+        {"double_free", double_free, "double free"},
+        {"overflow", overflow, "trailer canary overwritten"},
+        {"underflow", underflow, "header canary overwritten"},
+        {"size_mismatch", size_mismatch, "deallocate size does not match"},
+        {"write_after_free", write_after_free, "block written after free"},
+        {"clean_run", nullptr, nullptr},
+    };
+}
+
+int main (int argc, char **argv) {
+    int ran = 0, failures = 0;
+    for (const test_case &c : cases) {
+        if (argc > 1 && strcmp(argv[1], c.name) != 0) {
+            continue;
+        }
+        bool ok = c.fn != nullptr ? dies_with(c.fn, c.message) : clean_run();
+        failures += !ok;
+        ran++;
+        printf("%s %s\n", ok ? "ok  " : "FAIL", c.name);
+    }
+    if (ran == 0) {
+        fprintf(stderr, "unknown test %s\n", argv[1]);
+        return 2;
+    }
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,166 @@
+/*
+ * @Author: suzy HideSue@github.com
+ * @Date: 2026-10-19 16:20:15
+ * @LastEditors: suzy HideSue@github.com
+ * @LastEditTime: 2026-10-19 16:20:15
+ * @FilePath: /tinystl/tests/alloc_policy_test.cpp
+ * @Description: alloc_policy.h里各个积木的测试：fallback的路由、segregator的阈值、stack_buffer溢出、stats计数、freelist
+ *               用法：alloc_policy_test 用例名
+ *
+ * Copyright (c) 2023 by ${suzy HideSue@github.com}, All Rights Reserved.
+ */
+#include<cstring>
+#include<sstream>
+#include<string>
+#include<vector>
+#include "alloc_policy.h"
+#include "check.h"
+
+namespace
+{
+    struct small_tag {};
+    struct large_tag {};
+    struct fallback_tag {};
+
+    typedef tinystl::stack_buffer_alloc<1024> buffer;
+    typedef tinystl::stats_alloc<tinystl::alloc, fallback_tag> counted_fallback;
+    typedef tinystl::fallback_alloc<buffer, counted_fallback> buffered;
+
+    // ---------------- Primary用完以后走Fallback，释放时按owns分回去 ----------------
+    void test_fallback () {
+        std::vector<void *> ptrs;
+        for (int i = 0; i < 64; i++) {
+            void *p = buffered::allocate(32);
+            memset(p, i, 32);
+            ptrs.push_back(p);
+        }
+        // 1024字节的缓冲区放32个，之后的都是Fallback给的
+        for (int i = 0; i < 64; i++) {
+            CHECK(buffer::owns(ptrs[i]) == (i < 32));
+        }
+        CHECK(counted_fallback::stats().allocs == 32);
+        for (int i = 0; i < 64; i++) {
+            CHECK(((unsigned char *) ptrs[i])[31] == i);
+            buffered::deallocate(ptrs[i], 32);
+        }
+        CHECK(counted_fallback::stats().frees == 32);
+        CHECK(counted_fallback::stats().live_bytes == 0);
+        // 缓冲区的块都还了，又能从头用
+        void *p = buffered::allocate(1000);
+        CHECK(buffer::owns(p));
+        buffered::deallocate(p, 1000);
+
+        void *batch[40];
+        buffered::allocate_batch(32, batch, 40);
+        CHECK(buffer::owns(batch[31]) && !buffer::owns(batch[32]));
+        buffered::deallocate_batch(batch, 40, 32);
+        CHECK(counted_fallback::stats().live_bytes == 0);
+    }
+
+    // ---------------- segregator按大小分流，正好等于阈值的归Small ----------------
+    void test_segregator () {
+        typedef tinystl::stats_alloc<tinystl::alloc, small_tag> small;
+        typedef tinystl::stats_alloc<tinystl::alloc, large_tag> large;
+        typedef tinystl::segregator_alloc<256, small, large> seg;
+        void *a = seg::allocate(256);
+        void *b = seg::allocate(257);
+        CHECK(small::stats().allocs == 1 && small::stats().bytes_allocated == 256);
+        CHECK(large::stats().allocs == 1 && large::stats().bytes_allocated == 257);
+        seg::deallocate(a, 256);
+        seg::deallocate(b, 257);
+        CHECK(small::stats().frees == 1 && large::stats().frees == 1);
+        void *batch[8];
+        seg::allocate_batch(256, batch, 8);
+        CHECK(small::stats().allocs == 9);
+        seg::deallocate_batch(batch, 8, 256);
+        CHECK(small::stats().live_bytes == 0 && large::stats().live_bytes == 0);
+    }
+
+    // ---------------- stack_buffer溢出时返回nullptr，owns只认自己的缓冲区 ----------------
+    void test_stack_buffer () {
+        typedef tinystl::stack_buffer_alloc<256, small_tag> tiny;
+        void *a = tiny::allocate(200);
+        CHECK(a != nullptr && tiny::owns(a));
+        CHECK(tiny::allocate(100) == nullptr);
+        void *b = tiny::allocate(40);
+        CHECK(b != nullptr && tiny::owns(b));
+        CHECK(tiny::allocate(1) == nullptr);
+        int on_stack = 0;
+        void *heap = tinystl::alloc::allocate(16);
+        CHECK(!tiny::owns(&on_stack));
+        CHECK(!tiny::owns(heap));
+        tinystl::alloc::deallocate(heap, 16);
+        // 最后一块先还，位置退回去
+        tiny::deallocate(b, 40);
+        CHECK(tiny::allocate(40) == b);
+        tiny::deallocate(b, 40);
+        tiny::deallocate(a, 200);
+        CHECK(tiny::allocate(256) == a);
+        tiny::deallocate(a, 256);
+
+        // 溢出以后的块由Fallback给，owns分得清
+        typedef tinystl::fallback_alloc<tiny, tinystl::alloc> spill;
+        void *in = spill::allocate(256);
+        void *out = spill::allocate(8);
+        CHECK(tiny::owns(in) && !tiny::owns(out));
+        spill::deallocate(out, 8);
+        spill::deallocate(in, 256);
+    }
+
+    // ---------------- stats的计数、峰值、直方图 ----------------
+    void test_stats () {
+        typedef tinystl::stats_alloc<tinystl::alloc> stats;
+        void *a = stats::allocate(8);
+        void *b = stats::allocate(100);
+        void *c = stats::allocate(5000);
+        stats::deallocate(b, 100);
+        tinystl::policy_stats s = stats::stats();
+        CHECK(s.allocs == 3 && s.frees == 1);
+        CHECK(s.bytes_allocated == 5108 && s.bytes_freed == 100);
+        CHECK(s.live_bytes == 5008 && s.peak_bytes == 5108);
+        CHECK(s.size_histogram[0] == 1);    // <=8
+        CHECK(s.size_histogram[4] == 1);    // <=128
+        CHECK(s.size_histogram[10] == 1);   // <=8192
+        std::ostringstream os;
+        s.write_text(os);
+        CHECK(os.str().find("allocs 3\n") != std::string::npos);
+        CHECK(os.str().find("size <=128 1\n") != std::string::npos);
+        stats::reset_stats();
+        s = stats::stats();
+        CHECK(s.allocs == 0 && s.frees == 0);
+        CHECK(s.live_bytes == 5008 && s.peak_bytes == 5008);
+        stats::deallocate(a, 8);
+        stats::deallocate(c, 5000);
+        CHECK(stats::stats().live_bytes == 0);
+    }
+
+    // ---------------- freelist按MaxSize缓存，同一个线程再要拿回来 ----------------
+    void test_freelist () {
+        typedef tinystl::freelist_alloc<tinystl::alloc, 17, 32, 4> list;
+        void *p[6];
+        for (void *&q : p) {
+            q = list::allocate(20);
+            memset(q, 1, 32);
+        }
+        for (void *q : p) {
+            list::deallocate(q, 24);
+        }
+        // 只缓存了4个，后进先出
+        CHECK(list::allocate(17) == p[3]);
+        CHECK(list::trim() == 3 * 32);
+        list::deallocate(p[3], 32);
+        list::trim();
+    }
+
+    const tinystl_test::test_case cases[] = {
+        {"fallback", test_fallback},
+        {"segregator", test_segregator},
+        {"stack_buffer", test_stack_buffer},
+        {"stats", test_stats},
+        {"freelist", test_freelist},
+    };
+}
+
+int main (int argc, char **argv) {
+    return tinystl_test::run(cases, argc, argv);
+}
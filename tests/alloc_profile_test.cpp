@@ -0,0 +1,123 @@
+/*
+ * @Author: suzy HideSue@github.com
+ * @Date: 2026-10-19 16:20:15
+ * @LastEditors: suzy HideSue@github.com
+ * @LastEditTime: 2026-10-19 16:20:15
+ * @FilePath: /tinystl/tests/alloc_profile_test.cpp
+ * @Description: 采样堆剖析（TINYSTL_ALLOC_PROFILE）的测试：采样率调到1字节，每次分配都采，检查导出格式和释放后样本被删掉
+ *               用法：alloc_profile_test 用例名
+ *
+ * Copyright (c) 2023 by ${suzy HideSue@github.com}, All Rights Reserved.
+ */
+#include<cstdint>
+#include<sstream>
+#include<string>
+#include<vector>
+#include "alloc.h"
+#include "check.h"
+
+#ifndef TINYSTL_ALLOC_PROFILE
+#error "alloc_profile_test要定义TINYSTL_ALLOC_PROFILE编译"
+#endif
+
+namespace
+{
+    // 假的调用栈，不同的分配点用不同的地址，导出的内容固定
+    uintptr_t site = 0x1000;
+
+    int fake_unwinder (void **frames, int max_frames) {
+        if (max_frames < 3) {
+            return 0;
+        }
+        frames[0] = nullptr;                // 会被当作sample_slow自己跳过
+        frames[1] = (void *) site;
+        frames[2] = (void *) 0x9000;
+        return 3;
+    }
+
+    size_t live_count () {
+        size_t count;
+        double bytes;
+        tinystl::alloc_profiler::live(count, bytes);
+        return count;
+    }
+
+    // ---------------- 采到的样本能导出成heap_v2和折叠栈，释放以后从表里删掉 ----------------
+    void test_sample () {
+        tinystl::alloc_profiler::set_unwinder(fake_unwinder);
+        tinystl::alloc_profiler::set_sample_rate(1);
+        // 每个线程第一次分配只抽间隔
+        tinystl::alloc::deallocate(tinystl::alloc::allocate(8), 8);
+        tinystl::alloc_profiler::clear();
+        std::vector<void *> ptrs;
+        site = 0x1000;
+        for (int i = 0; i < 100; i++) {
+            ptrs.push_back(tinystl::alloc::allocate(64));
+        }
+        site = 0x2000;
+        void *big = tinystl::alloc::allocate(tinystl::MAX_PAGE_BYTES + 1);
+        CHECK(live_count() == 101);
+
+        std::ostringstream pprof;
+        tinystl::alloc_profiler::write_pprof(pprof);
+        std::string text = pprof.str();
+        CHECK(text.compare(0, 14, "heap profile: ") == 0);
+        CHECK(text.find("@ heap_v2/1\n") != std::string::npos);
+        CHECK(text.find("\n   100:     6400 [   100:     6400] @ 0x1000 0x9000\n") != std::string::npos);
+        CHECK(text.find("MAPPED_LIBRARIES:") != std::string::npos);
+
+        std::ostringstream collapsed;
+        tinystl::alloc_profiler::write_collapsed(collapsed);
+        std::istringstream lines(collapsed.str());
+        std::string line;
+        std::vector<std::string> stacks;
+        while (std::getline(lines, line)) {
+            stacks.push_back(line);
+        }
+        // 栈从外往里，64字节按1字节采样，折算的字节数就是原大小
+        CHECK(stacks.size() == 2);
+        CHECK(stacks[0] == "0x9000;0x1000 6400");
+        CHECK(stacks[1].compare(0, 14, "0x9000;0x2000 ") == 0);
+
+        for (void *p : ptrs) {
+            tinystl::alloc::deallocate(p, 64);
+        }
+        CHECK(live_count() == 1);
+        tinystl::alloc::deallocate(big, tinystl::MAX_PAGE_BYTES + 1);
+        CHECK(live_count() == 0);
+        pprof.str("");
+        tinystl::alloc_profiler::write_pprof(pprof);
+        CHECK(pprof.str().compare(0, 38, "heap profile:      0:        0 [     0") == 0);
+
+        // 采样率为0时关掉
+        tinystl::alloc_profiler::set_sample_rate(0);
+        void *p = tinystl::alloc::allocate(64);
+        void *q = tinystl::alloc::allocate(64);
+        CHECK(live_count() == 0);
+        tinystl::alloc::deallocate(p, 64);
+        tinystl::alloc::deallocate(q, 64);
+    }
+
+    // ---------------- reallocate以后样本跟着新地址走 ----------------
+    void test_reallocate () {
+        tinystl::alloc_profiler::set_unwinder(fake_unwinder);
+        tinystl::alloc_profiler::set_sample_rate(1);
+        tinystl::alloc::deallocate(tinystl::alloc::allocate(8), 8);
+        tinystl::alloc_profiler::clear();
+        void *p = tinystl::alloc::allocate(100);
+        CHECK(live_count() == 1);
+        p = tinystl::alloc::reallocate(p, 100, 100000);
+        CHECK(live_count() == 1);
+        tinystl::alloc::deallocate(p, 100000);
+        CHECK(live_count() == 0);
+    }
+
+    const tinystl_test::test_case cases[] = {
+        {"sample", test_sample},
+        {"reallocate", test_reallocate},
+    };
+}
+
+int main (int argc, char **argv) {
+    return tinystl_test::run(cases, argc, argv);
+}
@@ -0,0 +1,327 @@
+/*
+ * @Author: suzy HideSue@github.com
+ * @Date: 2026-10-19 16:20:15
+ * @LastEditors: suzy HideSue@github.com
+ * @LastEditTime: 2026-10-19 18:05:12
+ * @FilePath: /tinystl/tests/alloc_test.cpp
+ * @Description: tinystl::alloc的功能测试，每个用例单独一个进程跑，互不影响内存池的状态
+ *               用法：alloc_test 用例名，ctest里每个用例注册成一个测试
+ *
+ * Copyright (c) 2023 by ${suzy HideSue@github.com}, All Rights Reserved.
+ */
+#include<sstream>
+#include<thread>
+#include<vector>
+#include "alloc.h"
+#include "check.h"
+
+namespace
+{
+    // 每个字节都和地址、种子有关，搬错位置也能查出来
+    void fill (void *p, size_t n, unsigned seed) {
+        unsigned char *q = (unsigned char *) p;
+        for (size_t i = 0; i < n; i++) {
+            q[i] = (unsigned char) (i * 31 + seed);
+        }
+    }
+
+    bool check_fill (const void *p, size_t n, unsigned seed) {
+        const unsigned char *q = (const unsigned char *) p;
+        for (size_t i = 0; i < n; i++) {
+            if (q[i] != (unsigned char) (i * 31 + seed)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // ---------------- trim把全空闲的chunk还回去 ----------------
+    void test_trim () {
+        std::vector<void *> small, pages;
+        for (int i = 0; i < 20000; i++) {
+            small.push_back(tinystl::alloc::allocate(8 + i % 512));
+        }
+        for (int i = 0; i < 200; i++) {
+            pages.push_back(tinystl::alloc::allocate(tinystl::MAX_BYTES + 1 + i * 997));
+        }
+        tinystl::alloc_stats s = tinystl::alloc::stats();
+        CHECK(s.heap_bytes > 0);
+        CHECK(s.page_heap_bytes > 0);
+        for (int i = 0; i < 20000; i++) {
+            tinystl::alloc::deallocate(small[i], 8 + i % 512);
+        }
+        for (int i = 0; i < 200; i++) {
+            tinystl::alloc::deallocate(pages[i], tinystl::MAX_BYTES + 1 + i * 997);
+        }
+        size_t released = tinystl::alloc::trim();
+        CHECK(released >= s.heap_bytes + s.page_heap_bytes);
+        s = tinystl::alloc::stats();
+        CHECK(s.heap_bytes == 0);
+        CHECK(s.page_heap_bytes == 0);
+        // trim以后照常能用
+        void *p = tinystl::alloc::allocate(64);
+        fill(p, 64, 1);
+        CHECK(check_fill(p, 64, 1));
+        tinystl::alloc::deallocate(p, 64);
+        CHECK(tinystl::alloc::trim() > 0);
+    }
+
+    // ---------------- reallocate跨层级保留内容 ----------------
+    void test_reallocate () {
+        // 小型 -> 小型（换class）-> 页级 -> 页级变大 -> 大块 -> 大块 -> 缩回页级 -> 缩回小型
+        const size_t sizes[] = {24, 24, 200, 3000, tinystl::MAX_BYTES + 100, 3 * tinystl::PAGE_SIZE + 1,
+                                20 * tinystl::PAGE_SIZE, tinystl::MAX_PAGE_BYTES + 1, 2 * tinystl::MAX_PAGE_BYTES,
+                                tinystl::MAX_PAGE_BYTES, 9 * tinystl::PAGE_SIZE, 100, 16};
+        size_t n = sizes[0];
+        void *p = tinystl::alloc::allocate(n);
+        fill(p, n, 7);
+        for (size_t k = 1; k < sizeof(sizes) / sizeof(sizes[0]); k++) {
+            size_t m = sizes[k];
+            p = tinystl::alloc::reallocate(p, n, m);
+            size_t kept = n < m ? n : m;
+            CHECK(check_fill(p, kept, 7));
+            fill(p, m, 7);
+            n = m;
+        }
+        tinystl::alloc::deallocate(p, n);
+        // 页级区块后面空着时原地变大
+        void *a = tinystl::alloc::allocate(4 * tinystl::PAGE_SIZE);
+        void *b = tinystl::alloc::allocate(4 * tinystl::PAGE_SIZE);
+        void *c = tinystl::alloc::allocate(4 * tinystl::PAGE_SIZE);
+        fill(a, 4 * tinystl::PAGE_SIZE, 3);
+        tinystl::alloc::deallocate(b, 4 * tinystl::PAGE_SIZE);
+        void *a2 = tinystl::alloc::reallocate(a, 4 * tinystl::PAGE_SIZE, 8 * tinystl::PAGE_SIZE);
+#ifndef TINYSTL_ALLOC_HARDENED
+        CHECK(a2 == a);
+#endif
+        CHECK(check_fill(a2, 4 * tinystl::PAGE_SIZE, 3));
+        tinystl::alloc::deallocate(a2, 8 * tinystl::PAGE_SIZE);
+        tinystl::alloc::deallocate(c, 4 * tinystl::PAGE_SIZE);
+        // nullptr和old_sz为0时就是allocate
+        void *q = tinystl::alloc::reallocate(nullptr, 0, 40);
+        fill(q, 40, 9);
+        CHECK(check_fill(q, 40, 9));
+        tinystl::alloc::deallocate(q, 40);
+    }
+
+    // ---------------- 页级区块回收时合并，1页的零头不会留下 ----------------
+    void test_page_coalesce () {
+        // 留出硬化模式的头尾，正好占5页、4页
+        const size_t five = 5 * tinystl::PAGE_SIZE - 64, four = 4 * tinystl::PAGE_SIZE - 64;
+        std::vector<void *> v;
+        for (int i = 0; i < 400; i++) {
+            v.push_back(tinystl::alloc::allocate(five));
+        }
+        for (void *p : v) {
+            tinystl::alloc::deallocate(p, five);
+        }
+        size_t heap = tinystl::alloc::stats().page_heap_bytes;
+        // 4页的请求能用上5页切剩的零头合并回来的空间，不需要新chunk
+        for (int round = 0; round < 3; round++) {
+            v.clear();
+            for (int i = 0; i < 500; i++) {
+                v.push_back(tinystl::alloc::allocate(four));
+            }
+            for (void *p : v) {
+                tinystl::alloc::deallocate(p, four);
+            }
+        }
+#ifndef TINYSTL_ALLOC_HARDENED
+        // 硬化模式下刚释放的区块还压在隔离区里，要的chunk会多一些
+        CHECK(tinystl::alloc::stats().page_heap_bytes == heap);
+#else
+        (void) heap;
+#endif
+        tinystl::alloc::trim();
+        CHECK(tinystl::alloc::stats().page_heap_bytes == 0);
+    }
+
+    // ---------------- 批量接口 ----------------
+    void test_batch () {
+        const size_t count = 3000;
+        std::vector<void *> out(count);
+        for (int round = 0; round < 20; round++) {
+            size_t k = count - round * 97;
+            tinystl::alloc::allocate_batch(56, out.data(), k);
+            for (size_t i = 0; i < k; i++) {
+                fill(out[i], 56, (unsigned) i);
+            }
+            for (size_t i = 0; i < k; i++) {
+                CHECK(check_fill(out[i], 56, (unsigned) i));
+            }
+            tinystl::alloc::deallocate_batch(out.data(), k, 56);
+        }
+        tinystl::alloc::trim();
+        CHECK(tinystl::alloc::stats().heap_bytes == 0);
+    }
+
+    // ---------------- 对齐分配 ----------------
+    void test_aligned () {
+        const size_t aligns[] = {16, 32, 64, 128, 1024, tinystl::PAGE_SIZE};
+        const size_t sizes[] = {1, 40, 64, 1000, tinystl::MAX_BYTES, tinystl::MAX_BYTES + 1, tinystl::MAX_PAGE_BYTES + 10};
+        for (size_t a : aligns) {
+            for (size_t n : sizes) {
+                void *p = tinystl::alloc::allocate_aligned(n, a);
+                CHECK(((uintptr_t) p & (a - 1)) == 0);
+                fill(p, n, 2);
+                CHECK(check_fill(p, n, 2));
+                tinystl::alloc::deallocate_aligned(p, n, a);
+            }
+        }
+#ifndef TINYSTL_ALLOC_HARDENED
+        // 超过cache line的对齐，小请求只占一页
+        std::vector<void *> v;
+        for (int i = 0; i < 16; i++) {
+            v.push_back(tinystl::alloc::allocate_aligned(64, 128));
+        }
+        CHECK(tinystl::alloc::stats().page_in_use_bytes == 16 * tinystl::PAGE_SIZE);
+        for (void *p : v) {
+            tinystl::alloc::deallocate_aligned(p, 64, 128);
+        }
+#endif
+    }
+
+    // ---------------- 模拟两个NUMA节点，区块释放后回到它chunk所在的arena ----------------
+    void test_numa_arenas () {
+        tinystl::numa::simulate(2);
+        tinystl::alloc::set_node_arenas(true);
+        const size_t count = 5000, size = 48;
+        std::vector<void *> blocks(count);
+        // 节点1上的线程申请
+        std::thread([&] {
+            tinystl::numa::set_thread_node(1);
+            for (size_t i = 0; i < count; i++) {
+                blocks[i] = tinystl::alloc::allocate(size);
+                fill(blocks[i], size, 5);
+            }
+        }).join();
+        for (size_t i = 0; i < count; i++) {
+            CHECK(tinystl::alloc::node_of(blocks[i], size) == 1);
+        }
+        // 节点0上的线程释放，线程退出时它的缓存还回中心池
+        std::thread([&] {
+            tinystl::numa::set_thread_node(0);
+            for (size_t i = 0; i < count; i++) {
+                CHECK(check_fill(blocks[i], size, 5));
+                tinystl::alloc::deallocate(blocks[i], size);
+            }
+        }).join();
+        // 节点0拿到的都是节点0的，节点1的区块回到了节点1的arena，节点1再申请时能拿回来
+        size_t reused = 0;
+        std::thread([&] {
+            tinystl::numa::set_thread_node(0);
+            std::vector<void *> mine(count);
+            for (size_t i = 0; i < count; i++) {
+                mine[i] = tinystl::alloc::allocate(size);
+                CHECK(tinystl::alloc::node_of(mine[i], size) == 0);
+            }
+            for (size_t i = 0; i < count; i++) {
+                tinystl::alloc::deallocate(mine[i], size);
+            }
+        }).join();
+        std::thread([&] {
+            tinystl::numa::set_thread_node(1);
+            const size_t probe = 200;
+            std::vector<void *> again(probe);
+            for (size_t i = 0; i < probe; i++) {
+                again[i] = tinystl::alloc::allocate(size);
+                CHECK(tinystl::alloc::node_of(again[i], size) == 1);
+                for (size_t k = 0; k < count; k++) {
+                    if (again[i] == blocks[k]) {
+                        reused++;
+                        break;
+                    }
+                }
+            }
+            for (size_t i = 0; i < probe; i++) {
+                tinystl::alloc::deallocate(again[i], size);
+            }
+        }).join();
+        CHECK(reused > 0);
+        tinystl::alloc::trim();
+        CHECK(tinystl::alloc::stats().heap_bytes == 0);
+        tinystl::numa::simulate(0);
+    }
+
+    // ---------------- 按上次的高水位warm_up，再跑一遍不用再要chunk ----------------
+    void run_startup (std::vector<void *> &v, size_t round) {
+        for (size_t i = 0; i < 3000; i++) {
+            v.push_back(tinystl::alloc::allocate(16 + i % 7 * 40));
+            fill(v.back(), 16 + i % 7 * 40, (unsigned) (i + round));
+        }
+        for (size_t i = 0; i < 50; i++) {
+            v.push_back(tinystl::alloc::allocate(tinystl::MAX_BYTES + 1));
+            fill(v.back(), tinystl::MAX_BYTES + 1, (unsigned) (i + round));
+        }
+        void *batch[100];
+        tinystl::alloc::allocate_batch(56, batch, 100);
+        for (void *p : batch) {
+            v.push_back(p);
+            fill(p, 56, (unsigned) round);
+        }
+    }
+
+    void free_startup (std::vector<void *> &v, size_t round) {
+        for (size_t i = 0; i < 3000; i++) {
+            CHECK(check_fill(v[i], 16 + i % 7 * 40, (unsigned) (i + round)));
+            tinystl::alloc::deallocate(v[i], 16 + i % 7 * 40);
+        }
+        for (size_t i = 0; i < 50; i++) {
+            CHECK(check_fill(v[3000 + i], tinystl::MAX_BYTES + 1, (unsigned) (i + round)));
+            tinystl::alloc::deallocate(v[3000 + i], tinystl::MAX_BYTES + 1);
+        }
+        for (size_t i = 3050; i < v.size(); i++) {
+            CHECK(check_fill(v[i], 56, (unsigned) round));
+        }
+        tinystl::alloc::deallocate_batch(v.data() + 3050, v.size() - 3050, 56);
+        v.clear();
+    }
+
+    void test_warm_up () {
+        std::vector<void *> v;
+        tinystl::alloc::reset_high_water();
+        run_startup(v, 0);
+        free_startup(v, 0);
+        // 存下来再读回来，页级区块的高水位也在里面
+        std::stringstream file;
+        tinystl::alloc::high_water().write_text(file);
+        tinystl::pool_profile profile = {};
+        CHECK(profile.read_text(file));
+        CHECK(profile.pages >= 100);
+        tinystl::alloc::trim();
+        CHECK(tinystl::alloc::stats().heap_bytes == 0);
+        size_t warmed = tinystl::alloc::warm_up(profile);
+        CHECK(warmed >= profile.bytes());
+        tinystl::alloc_stats s = tinystl::alloc::stats();
+        CHECK(s.page_free_bytes >= profile.pages * tinystl::PAGE_SIZE);
+        size_t central = 0;
+        for (const tinystl::alloc_class_stats &c : s.classes) {
+            central += c.central_free * c.size;
+        }
+        CHECK(central >= profile.bytes() - profile.pages * tinystl::PAGE_SIZE);
+        // 同样的启动过程，区块全从预热好的里面拿
+        run_startup(v, 1);
+        tinystl::alloc_stats after = tinystl::alloc::stats();
+        CHECK(after.heap_bytes == s.heap_bytes);
+        CHECK(after.page_heap_bytes == s.page_heap_bytes);
+        free_startup(v, 1);
+        tinystl::alloc::trim();
+        s = tinystl::alloc::stats();
+        CHECK(s.heap_bytes == 0);
+        CHECK(s.page_heap_bytes == 0);
+    }
+
+    const tinystl_test::test_case cases[] = {
+        {"trim", test_trim},
+        {"reallocate", test_reallocate},
+        {"page_coalesce", test_page_coalesce},
+        {"batch", test_batch},
+        {"aligned", test_aligned},
+        {"numa_arenas", test_numa_arenas},
+        {"warm_up", test_warm_up},
+    };
+}
+
+int main (int argc, char **argv) {
+    return tinystl_test::run(cases, argc, argv);
+}
@@ -0,0 +1,105 @@
+/*
+ * @Author: suzy HideSue@github.com
+ * @Date: 2026-10-19 16:20:15
+ * @LastEditors: suzy HideSue@github.com
+ * @LastEditTime: 2026-10-19 16:20:15
+ * @FilePath: /tinystl/tests/arena_test.cpp
+ * @Description: monotonic_arena和arena_alloc的测试
+ *               用法：arena_test 用例名
+ *
+ * Copyright (c) 2023 by ${suzy HideSue@github.com}, All Rights Reserved.
+ */
+#include<cstdint>
+#include<thread>
+#include<vector>
+#include "monotonic_arena.h"
+#include "check.h"
+
+namespace
+{
+    // ---------------- 挪指针分配、owns、release ----------------
+    void test_bump () {
+        alignas(16) char buffer[256];
+        tinystl::monotonic_arena arena(buffer, sizeof(buffer));
+        void *a = arena.allocate(100);
+        void *b = arena.allocate(100);
+        CHECK(a == buffer);
+        CHECK((char *) b == buffer + 104);
+        CHECK(arena.owns(a) && arena.in_buffer(a));
+        // 初始缓冲区不够了，要增长块
+        std::vector<void *> grown;
+        for (int i = 0; i < 1000; i++) {
+            void *p = arena.allocate(64, 64);
+            CHECK(((uintptr_t) p & 63) == 0);
+            grown.push_back(p);
+        }
+        for (void *p : grown) {
+            CHECK(arena.owns(p));
+            CHECK(!arena.in_buffer(p));
+            CHECK(tinystl::monotonic_arena::any_owns(p));
+        }
+        tinystl::monotonic_arena other;
+        void *q = other.allocate(8);
+        CHECK(other.owns(q) && !arena.owns(q));
+        arena.release();
+        for (void *p : grown) {
+            CHECK(!arena.owns(p));
+            CHECK(!tinystl::monotonic_arena::any_owns(p));
+        }
+        CHECK(arena.allocate(8) == buffer);
+    }
+
+    // ---------------- arena_alloc只把不是arena分出去的还给alloc ----------------
+    void test_scope_free () {
+        // scope外分配的在scope里释放，要还给alloc，线程缓存后进先出，再要一次拿回同一块
+        void *outside = tinystl::alloc::allocate(48);
+        tinystl::monotonic_arena arena;
+        std::vector<void *> inside;
+        {
+            tinystl::arena_scope scope(arena);
+            tinystl::arena_alloc::deallocate(outside, 48);
+            for (int i = 0; i < 200; i++) {
+                inside.push_back(tinystl::arena_alloc::allocate(48));
+                memset(inside.back(), 0x5a, 48);
+            }
+        }
+        void *again = tinystl::alloc::allocate(48);
+        CHECK(again == outside);
+        // scope结束后、在别的线程释放arena分出去的，都不能交给alloc
+        std::thread t([&] {
+            for (void *p : inside) {
+                tinystl::arena_alloc::deallocate(p, 48);
+            }
+        });
+        t.join();
+        for (void *p : inside) {
+            tinystl::arena_alloc::deallocate(p, 48);
+        }
+        std::vector<void *> fresh;
+        for (int i = 0; i < 200; i++) {
+            void *p = tinystl::alloc::allocate(48);
+            for (void *q : inside) {
+                CHECK(p != q);
+            }
+            memset(p, 0, 48);
+            fresh.push_back(p);
+        }
+        for (void *p : inside) {
+            const unsigned char *c = (const unsigned char *) p;
+            CHECK(c[0] == 0x5a && c[47] == 0x5a);
+        }
+        for (void *p : fresh) {
+            tinystl::alloc::deallocate(p, 48);
+        }
+        tinystl::alloc::deallocate(again, 48);
+    }
+
+    const tinystl_test::test_case cases[] = {
+        {"bump", test_bump},
+        {"scope_free", test_scope_free},
+    };
+}
+
+int main (int argc, char **argv) {
+    return tinystl_test::run(cases, argc, argv);
+}
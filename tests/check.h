@@ -0,0 +1,61 @@
+/*
+ * @Author: suzy HideSue@github.com
+ * @Date: 2026-10-19 16:20:15
+ * @LastEditors: suzy HideSue@github.com
+ * @LastEditTime: 2026-10-19 16:20:15
+ * @FilePath: /tinystl/tests/check.h
+ * @Description: 测试共用的CHECK和用例分派，每个测试程序按命令行参数只跑一个用例，ctest里每个用例注册成一个测试
+ *
+ * Copyright (c) 2023 by ${suzy HideSue@github.com}, All Rights Reserved.
+ */
+#ifndef TINYSTL_TESTS_CHECK_H
+#define TINYSTL_TESTS_CHECK_H
+
+#include<cstddef>
+#include<cstdio>
+#include<cstring>
+
+namespace tinystl_test
+{
+    inline int failures = 0;
+
+    struct test_case {
+        const char *name;
+        void (*fn) ();
+    };
+
+    /**
+     * @description: 跑名字和argv[1]一样的用例，没给参数时全跑
+     * @param {test_case} (&cases)[N]
+     * @param {int} argc
+     * @param {char} **argv
+     * @return {*} 0全部通过，1有CHECK失败，2没有这个用例
+     */
+    template<size_t N>
+    int run (const test_case (&cases)[N], int argc, char **argv) {
+        int ran = 0;
+        for (const test_case &c : cases) {
+            if (argc > 1 && strcmp(argv[1], c.name) != 0) {
+                continue;
+            }
+            c.fn();
+            ran++;
+            printf("%s %s\n", failures == 0 ? "ok  " : "FAIL", c.name);
+        }
+        if (ran == 0) {
+            fprintf(stderr, "unknown test %s\n", argv[1]);
+            return 2;
+        }
+        return failures == 0 ? 0 : 1;
+    }
+} // namespace tinystl_test
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+            tinystl_test::failures++; \
+        } \
+    } while (0)
+
+#endif
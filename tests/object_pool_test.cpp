@@ -0,0 +1,160 @@
+/*
+ * @Author: suzy HideSue@github.com
+ * @Date: 2026-10-19 16:20:15
+ * @LastEditors: suzy HideSue@github.com
+ * @LastEditTime: 2026-10-19 16:20:15
+ * @FilePath: /tinystl/tests/object_pool_test.cpp
+ * @Description: object_pool的测试：reset钩子、线程之间经过depot交换magazine、trim析构缓存的对象并归还slab
+ *               用法：object_pool_test 用例名
+ *
+ * Copyright (c) 2023 by ${suzy HideSue@github.com}, All Rights Reserved.
+ */
+#include<algorithm>
+#include<atomic>
+#include<thread>
+#include<vector>
+#include "object_pool.h"
+#include "check.h"
+
+namespace
+{
+    /**
+     * @description: 记构造、析构次数，child不为空时析构顺带把它还给池子
+     */
+    struct widget {
+        static std::atomic<int> constructed;
+        static std::atomic<int> destroyed;
+        int value;
+        widget *child;
+
+        widget () : value(0), child(nullptr) { constructed++; }
+        ~widget () {
+            destroyed++;
+            if (child != nullptr) {
+                tinystl::object_pool<widget>::release(child);
+            }
+        }
+    };
+    std::atomic<int> widget::constructed(0);
+    std::atomic<int> widget::destroyed(0);
+
+    typedef tinystl::object_pool<widget> pool;
+
+    int resets = 0;
+
+    void reset_widget (widget &w) {
+        resets++;
+        w.value = 0;
+    }
+
+    // ---------------- release时调用reset钩子，对象不析构，下次拿回来是清过的 ----------------
+    void test_reset_hook () {
+        pool::set_reset_hook(reset_widget);
+        widget *w = pool::acquire();
+        CHECK(widget::constructed == 1);
+        w->value = 7;
+        pool::release(w);
+        CHECK(resets == 1);
+        CHECK(widget::destroyed == 0);
+        widget *again = pool::acquire();
+        CHECK(again == w);
+        CHECK(again->value == 0);
+        CHECK(widget::constructed == 1);
+        pool::set_reset_hook(nullptr);
+        again->value = 3;
+        pool::release(again);
+        CHECK(resets == 1);
+        CHECK(pool::acquire()->value == 3);
+    }
+
+    // ---------------- 一个线程还回去的对象经过depot被另一个线程拿到，不重新构造 ----------------
+    void test_magazine_exchange () {
+        enum {N = 10 * TINYSTL_OBJECT_POOL_MAGAZINE};
+        std::vector<widget *> objs;
+        for (int i = 0; i < N; i++) {
+            objs.push_back(pool::acquire());
+        }
+        CHECK(widget::constructed == N);
+        // 另一个线程还回去，装满的magazine交给depot，线程退出时剩下的也交给depot
+        std::thread t([&] {
+            for (widget *w : objs) {
+                pool::release(w);
+            }
+        });
+        t.join();
+        std::vector<widget *> back;
+        for (int i = 0; i < N; i++) {
+            back.push_back(pool::acquire());
+        }
+        CHECK(widget::constructed == N);
+        std::sort(objs.begin(), objs.end());
+        std::sort(back.begin(), back.end());
+        CHECK(objs == back);
+        // 两个线程同时来回换
+        std::thread u([&] {
+            for (int round = 0; round < 100; round++) {
+                std::vector<widget *> mine;
+                for (int i = 0; i < N / 2; i++) {
+                    mine.push_back(pool::acquire());
+                }
+                for (widget *w : mine) {
+                    pool::release(w);
+                }
+            }
+        });
+        for (int round = 0; round < 100; round++) {
+            for (widget *w : back) {
+                pool::release(w);
+            }
+            for (widget *&w : back) {
+                w = pool::acquire();
+            }
+        }
+        u.join();
+        for (widget *w : back) {
+            pool::release(w);
+        }
+        CHECK(widget::constructed <= 2 * N);
+    }
+
+    // ---------------- trim析构缓存的对象，没有活着的对象时归还slab；~T里可以再release ----------------
+    void test_trim () {
+        enum {N = 2000};
+        std::vector<widget *> objs;
+        for (int i = 0; i < N; i++) {
+            objs.push_back(pool::acquire());
+        }
+        // 还有对象在用户手里，slab不能还
+        widget *kept = objs.back();
+        objs.pop_back();
+        for (widget *w : objs) {
+            pool::release(w);
+        }
+        CHECK(pool::trim() == 0);
+        CHECK(widget::destroyed == N - 1);
+        // 缓存着的对象析构时把kept还回来，trim不能在锁里析构，否则这里自锁
+        widget *holder = pool::acquire();
+        holder->child = kept;
+        pool::release(holder);
+        CHECK(pool::trim() == 0);
+        CHECK(widget::destroyed == N);
+        // kept被析构里的release放进了magazine，再trim一次全部析构，slab还回去
+        CHECK(pool::trim() > 0);
+        CHECK(widget::destroyed == widget::constructed);
+        // trim以后照常能用
+        widget *w = pool::acquire();
+        CHECK(w->value == 0 && w->child == nullptr);
+        pool::release(w);
+        CHECK(pool::trim() > 0);
+    }
+
+    const tinystl_test::test_case cases[] = {
+        {"reset_hook", test_reset_hook},
+        {"magazine_exchange", test_magazine_exchange},
+        {"trim", test_trim},
+    };
+}
+
+int main (int argc, char **argv) {
+    return tinystl_test::run(cases, argc, argv);
+}
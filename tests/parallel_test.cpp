@@ -0,0 +1,126 @@
+/*
+ * @Author: suzy HideSue@github.com
+ * @Date: 2026-10-19 16:20:15
+ * @LastEditors: suzy HideSue@github.com
+ * @LastEditTime: 2026-10-19 16:20:15
+ * @FilePath: /tinystl/tests/parallel_test.cpp
+ * @Description: 并行uninitialized_copy、uninitialized_fill_n、destroy的测试，块大小调小，几千个元素就能切成很多块
+ *               某个块里构造抛异常时，别的线程已经构造好的块要析构掉，异常传回调用线程
+ *               用法：parallel_test 用例名
+ *
+ * Copyright (c) 2023 by ${suzy HideSue@github.com}, All Rights Reserved.
+ */
+#define TINYSTL_PARALLEL_GRAIN_BYTES 256
+
+#include<atomic>
+#include<stdexcept>
+#include<string>
+#include<vector>
+#include "parallel.h"
+#include "check.h"
+
+namespace
+{
+    /**
+     * @description: 构造时值等于fail_value、或者是第fail_copy次拷贝就抛异常，记录活着的对象数
+     */
+    struct element {
+        static std::atomic<int> live;
+        static std::atomic<int> fail_value;
+        static std::atomic<int> copies;
+        static std::atomic<int> fail_copy;
+        long value;
+
+        element (int v) : value(v) {
+            if (v == fail_value.load()) {
+                throw std::runtime_error("element " + std::to_string(v));
+            }
+            live++;
+        }
+        element (const element &other) : value(other.value) {
+            if (++copies == fail_copy.load()) {
+                throw std::runtime_error("copy");
+            }
+            live++;
+        }
+        ~element () { live--; }
+    };
+    std::atomic<int> element::live(0);
+    std::atomic<int> element::fail_value(-1);
+    std::atomic<int> element::copies(0);
+    std::atomic<int> element::fail_copy(-1);
+
+    enum {N = 4000};
+
+    // ---------------- 不抛异常时和串行版本结果一样 ----------------
+    void test_copy () {
+        tinystl::thread_pool pool(3);
+        std::vector<int> src(N);
+        for (int i = 0; i < N; i++) {
+            src[i] = i;
+        }
+        element *dst = (element *) ::operator new(N * sizeof(element));
+        CHECK(tinystl::uninitialized_copy(tinystl::par.on(pool), src.data(), src.data() + N, dst) == dst + N);
+        CHECK(element::live == N);
+        bool same = true;
+        for (int i = 0; i < N; i++) {
+            same &= dst[i].value == i;
+        }
+        CHECK(same);
+        tinystl::destroy(tinystl::par.on(pool), dst, dst + N);
+        CHECK(element::live == 0);
+
+        int *pods = (int *) ::operator new(N * sizeof(int));
+        tinystl::uninitialized_fill_n(tinystl::par.on(pool), pods, (int) N, 5);
+        same = true;
+        for (int i = 0; i < N; i++) {
+            same &= pods[i] == 5;
+        }
+        CHECK(same);
+        ::operator delete(pods);
+        ::operator delete(dst);
+    }
+
+    // ---------------- 一个块构造失败：其他块构造好的全部析构，异常传到调用者 ----------------
+    void test_exception () {
+        tinystl::thread_pool pool(3);
+        std::vector<int> src(N);
+        for (int i = 0; i < N; i++) {
+            src[i] = i;
+        }
+        element *dst = (element *) ::operator new(N * sizeof(element));
+        element::fail_value = N * 5 / 8;
+        std::string message;
+        try {
+            tinystl::uninitialized_copy(tinystl::par.on(pool), src.data(), src.data() + N, dst);
+        } catch (const std::runtime_error &e) {
+            message = e.what();
+        }
+        CHECK(message == "element " + std::to_string(N * 5 / 8));
+        CHECK(element::live == 0);
+
+        element::fail_value = -1;
+        element x(7);
+        element::copies = 0;
+        element::fail_copy = N * 5 / 8;
+        message.clear();
+        try {
+            tinystl::uninitialized_fill_n(tinystl::par.on(pool), dst, (int) N, x);
+        } catch (const std::runtime_error &e) {
+            message = e.what();
+        }
+        CHECK(message == "copy");
+        CHECK(element::live == 1);
+        element::fail_copy = -1;
+        ::operator delete(dst);
+    }
+
+    const tinystl_test::test_case cases[] = {
+        {"copy", test_copy},
+        {"exception", test_exception},
+    };
+}
+
+int main (int argc, char **argv) {
+    return tinystl_test::run(cases, argc, argv);
+}
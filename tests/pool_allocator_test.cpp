@@ -0,0 +1,84 @@
+/*
+ * @Author: suzy HideSue@github.com
+ * @Date: 2026-10-19 16:20:15
+ * @LastEditors: suzy HideSue@github.com
+ * @LastEditTime: 2026-10-19 16:20:15
+ * @FilePath: /tinystl/tests/pool_allocator_test.cpp
+ * @Description: pool_allocator当标准容器的配置器用的测试
+ *               用法：pool_allocator_test 用例名
+ *
+ * Copyright (c) 2023 by ${suzy HideSue@github.com}, All Rights Reserved.
+ */
+#include<cstdint>
+#include<list>
+#include<map>
+#include<memory>
+#include<string>
+#include<vector>
+#include "pool_allocator.h"
+#include "check.h"
+
+namespace
+{
+    // ---------------- std::vector、std::list、std::map ----------------
+    void test_containers () {
+        std::vector<int, tinystl::pool_allocator<int>> v;
+        for (int i = 0; i < 100000; i++) {
+            v.push_back(i);
+        }
+        bool same = true;
+        for (int i = 0; i < 100000; i++) {
+            same &= v[i] == i;
+        }
+        CHECK(same);
+        v.shrink_to_fit();
+
+        std::list<std::string, tinystl::pool_allocator<std::string>> l;
+        for (int i = 0; i < 1000; i++) {
+            l.push_back(std::string(i % 50, 'x'));
+        }
+        l.remove_if([] (const std::string &s) { return s.size() % 2 == 0; });
+        CHECK(l.size() == 500);
+        std::list<std::string, tinystl::pool_allocator<std::string>> moved(std::move(l));
+        CHECK(moved.size() == 500 && l.empty());
+
+        std::map<int, int, std::less<int>, tinystl::pool_allocator<std::pair<const int, int>>> m;
+        for (int i = 0; i < 1000; i++) {
+            m[i] = i * 2;
+        }
+        CHECK(m[999] == 1998);
+
+        struct alignas(64) line {
+            char c[64];
+        };
+        std::vector<line, tinystl::pool_allocator<line>> lines(100);
+        CHECK(((uintptr_t) lines.data() & 63) == 0);
+    }
+
+    // ---------------- rebind以后仍然相等，节点容器可以随便换配置器 ----------------
+    void test_rebind () {
+        typedef tinystl::pool_allocator<int> int_alloc;
+        typedef std::allocator_traits<int_alloc>::rebind_alloc<double> double_alloc;
+        static_assert(std::is_same<double_alloc, tinystl::pool_allocator<double>>::value, "rebind类型不对");
+        int_alloc a;
+        double_alloc b(a);
+        CHECK(a == b);
+        CHECK(!(a != b));
+        CHECK(int_alloc(b) == a);
+        double *p = b.allocate(10);
+        p[9] = 1.5;
+        double_alloc(a).deallocate(p, 10);
+        std::list<int, int_alloc> x(3, 1), y;
+        y.splice(y.begin(), x);
+        CHECK(y.size() == 3 && x.empty());
+    }
+
+    const tinystl_test::test_case cases[] = {
+        {"containers", test_containers},
+        {"rebind", test_rebind},
+    };
+}
+
+int main (int argc, char **argv) {
+    return tinystl_test::run(cases, argc, argv);
+}
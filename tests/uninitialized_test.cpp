@@ -0,0 +1,273 @@
+/*
+ * @Author: suzy HideSue@github.com
+ * @Date: 2026-10-19 16:20:15
+ * @LastEditors: suzy HideSue@github.com
+ * @LastEditTime: 2026-10-19 16:20:15
+ * @FilePath: /tinystl/tests/uninitialized_test.cpp
+ * @Description: uninitialized.h里copy、fill、move、relocate的测试，POD快速路径和逐个构造的路径都要覆盖
+ *               用法：uninitialized_test 用例名
+ *
+ * Copyright (c) 2023 by ${suzy HideSue@github.com}, All Rights Reserved.
+ */
+#include<memory>
+#include<new>
+#include<string>
+#include "uninitialized.h"
+#include "check.h"
+
+namespace
+{
+    template<class T>
+    T *raw (size_t n) {
+        return (T *) ::operator new(n * sizeof(T));
+    }
+
+    // ---------------- copy：POD整段复制、非POD逐个构造 ----------------
+    void test_copy () {
+        int src[1000];
+        for (int i = 0; i < 1000; i++) {
+            src[i] = i * 7;
+        }
+        int *dst = raw<int>(1000);
+        CHECK(tinystl::uninitialized_copy(src, src + 1000, dst) == dst + 1000);
+        bool same = true;
+        for (int i = 0; i < 1000; i++) {
+            same &= dst[i] == i * 7;
+        }
+        CHECK(same);
+        ::operator delete(dst);
+
+        std::string strs[3] = {"a", std::string(100, 'b'), "c"};
+        std::string *sdst = raw<std::string>(3);
+        tinystl::uninitialized_copy(strs, strs + 3, sdst);
+        CHECK(sdst[1] == strs[1] && strs[1].size() == 100);
+        tinystl::destroy(sdst, sdst + 3);
+        ::operator delete(sdst);
+    }
+
+    /**
+     * @description: 记录活着的对象数的类型，第fail_at次拷贝构造时抛异常，移动构造可能抛异常，所以relocate只能复制
+     */
+    struct counted {
+        static int live;
+        static int copies;
+        static int fail_at;     // 0表示不抛
+        int value;
+
+        explicit counted (int v) : value(v) { live++; }
+        counted (const counted &other) : value(other.value) {
+            if (fail_at != 0 && ++copies == fail_at) {
+                throw 1;
+            }
+            live++;
+        }
+        counted (counted &&other) noexcept(false) : value(other.value) {
+            other.value = -1;
+            live++;
+        }
+        ~counted () { live--; }
+    };
+    int counted::live = 0;
+    int counted::copies = 0;
+    int counted::fail_at = 0;
+
+    // ---------------- fill：各种元素大小的POD，非POD中途抛异常时回滚 ----------------
+    void test_fill () {
+        struct three {
+            char c[3];
+        };
+        three t = {{1, 2, 3}};
+        three *td = raw<three>(100);
+        tinystl::uninitialized_fill_n(td, 100, t);
+        bool same = true;
+        for (int i = 0; i < 100; i++) {
+            same &= td[i].c[0] == 1 && td[i].c[1] == 2 && td[i].c[2] == 3;
+        }
+        CHECK(same);
+        ::operator delete(td);
+
+        long *ld = raw<long>(1001);
+        ld[1000] = 42;
+        tinystl::uninitialized_fill(ld, ld + 1000, -5L);
+        same = true;
+        for (int i = 0; i < 1000; i++) {
+            same &= ld[i] == -5;
+        }
+        CHECK(same && ld[1000] == 42);
+        ::operator delete(ld);
+
+        counted x(9);
+        counted *cd = raw<counted>(10);
+        counted::copies = 0;
+        counted::fail_at = 6;
+        bool thrown = false;
+        try {
+            tinystl::uninitialized_fill_n(cd, 10, x);
+        } catch (int) {
+            thrown = true;
+        }
+        CHECK(thrown);
+        CHECK(counted::live == 1);
+        counted::fail_at = 0;
+        ::operator delete(cd);
+    }
+
+    // ---------------- 只能移动的类型：move、relocate、可变参数construct ----------------
+    void test_move_only () {
+        typedef std::unique_ptr<int> ptr;
+        ptr *src = raw<ptr>(5);
+        for (int i = 0; i < 5; i++) {
+            tinystl::construct(src + i, new int(i));
+        }
+        ptr *moved = raw<ptr>(5);
+        CHECK(tinystl::uninitialized_move(src, src + 5, moved) == moved + 5);
+        CHECK(src[0] == nullptr && *moved[4] == 4);
+        tinystl::destroy(src, src + 5);
+        ptr *relocated = raw<ptr>(5);
+        CHECK(tinystl::uninitialized_move_n(moved, 2, relocated) == relocated + 2);
+        tinystl::uninitialized_relocate(moved + 2, moved + 5, relocated + 2);
+        tinystl::destroy(moved, moved + 2);
+        for (int i = 0; i < 5; i++) {
+            CHECK(*relocated[i] == i);
+        }
+        tinystl::destroy(relocated, relocated + 5);
+        ::operator delete(src);
+        ::operator delete(moved);
+        ::operator delete(relocated);
+
+        std::string *s = raw<std::string>(1);
+        tinystl::construct(s, 3, 'z');
+        CHECK(*s == "zzz");
+        tinystl::destroy(s);
+        ::operator delete(s);
+    }
+
+    // ---------------- relocate的强异常保证：移动会抛时复制，复制中途失败源区间不动 ----------------
+    void test_relocate_strong () {
+        counted *src = raw<counted>(8);
+        for (int i = 0; i < 8; i++) {
+            new(src + i) counted(i);
+        }
+        counted *dst = raw<counted>(8);
+        counted::copies = 0;
+        counted::fail_at = 5;
+        bool thrown = false;
+        try {
+            tinystl::uninitialized_relocate(src, src + 8, dst);
+        } catch (int) {
+            thrown = true;
+        }
+        counted::fail_at = 0;
+        CHECK(thrown);
+        // 已经复制过去的4个析构了，源区间8个都在，值没被移走
+        CHECK(counted::live == 8);
+        for (int i = 0; i < 8; i++) {
+            CHECK(src[i].value == i);
+        }
+        // 不失败时搬完源区间被析构
+        CHECK(tinystl::uninitialized_relocate(src, src + 8, dst) == dst + 8);
+        CHECK(counted::live == 8);
+        CHECK(dst[7].value == 7);
+        tinystl::destroy(dst, dst + 8);
+        CHECK(counted::live == 0);
+        ::operator delete(src);
+        ::operator delete(dst);
+    }
+
+    /**
+     * @description: 不是trivially copyable，但手动标了is_trivially_relocatable，relocate应该整段memcpy，不调移动构造和析构
+     */
+    struct relocatable {
+        static int moves;
+        static int destroyed;
+        int *self_check;        // 指向堆上的值，按字节搬走不影响
+        int value;
+
+        explicit relocatable (int v) : self_check(new int(v)), value(v) {}
+        relocatable (relocatable &&other) noexcept : self_check(other.self_check), value(other.value) {
+            other.self_check = nullptr;
+            moves++;
+        }
+        ~relocatable () {
+            delete self_check;
+            destroyed++;
+        }
+    };
+    int relocatable::moves = 0;
+    int relocatable::destroyed = 0;
+}
+
+namespace tinystl
+{
+    template<>
+    struct type_traits<relocatable> {
+        typedef false_type has_trivial_default_constructor;
+        typedef false_type has_trivial_copy_constructor;
+        typedef false_type has_trivial_assignment_constructor;
+        typedef false_type has_trivial_destructor;
+        typedef false_type is_POD_type;
+        typedef true_type is_trivially_relocatable;
+    };
+} // namespace tinystl
+
+namespace
+{
+    // ---------------- 特化了is_trivially_relocatable的类型整段按字节搬 ----------------
+    void test_relocate_trivial () {
+        relocatable *src = raw<relocatable>(16);
+        for (int i = 0; i < 16; i++) {
+            new(src + i) relocatable(i);
+        }
+        relocatable *dst = raw<relocatable>(16);
+        relocatable::moves = 0;
+        relocatable::destroyed = 0;
+        CHECK(tinystl::uninitialized_relocate(src, src + 16, dst) == dst + 16);
+        CHECK(relocatable::moves == 0);
+        CHECK(relocatable::destroyed == 0);
+        for (int i = 0; i < 16; i++) {
+            CHECK(dst[i].value == i && *dst[i].self_check == i);
+        }
+        tinystl::destroy(dst, dst + 16);
+        CHECK(relocatable::destroyed == 16);
+        ::operator delete(src);
+        ::operator delete(dst);
+    }
+
+    // ---------------- type_traits从编译器的判断推出来，聚合体、数组不用手写特化 ----------------
+    void test_traits () {
+        struct point {
+            int x, y;
+        };
+        struct fixed {
+            const int id;
+        };
+        CHECK(tinystl::type_traits<point>::is_POD_type::value);
+        CHECK(tinystl::type_traits<point[4]>::is_trivially_relocatable::value);
+        CHECK(!tinystl::type_traits<std::string>::is_POD_type::value);
+        CHECK(!tinystl::type_traits<std::string>::has_trivial_destructor::value);
+        CHECK(tinystl::type_traits<relocatable>::is_trivially_relocatable::value);
+        CHECK(!tinystl::type_traits<fixed>::has_trivial_assignment_constructor::value);
+        // 有const成员不能赋值，但trivially copyable，按字节填
+        fixed *f = raw<fixed>(100);
+        tinystl::uninitialized_fill_n(f, 100, fixed{3});
+        bool same = true;
+        for (int i = 0; i < 100; i++) {
+            same &= f[i].id == 3;
+        }
+        CHECK(same);
+        ::operator delete(f);
+    }
+
+    const tinystl_test::test_case cases[] = {
+        {"copy", test_copy},
+        {"fill", test_fill},
+        {"move_only", test_move_only},
+        {"relocate_strong", test_relocate_strong},
+        {"relocate_trivial", test_relocate_trivial},
+        {"traits", test_traits},
+    };
+}
+
+int main (int argc, char **argv) {
+    return tinystl_test::run(cases, argc, argv);
+}
@@ -0,0 +1,226 @@
+/*
+ * @Author: suzy HideSue@github.com
+ * @Date: 2026-10-18 22:14:07
+ * @LastEditors: suzy HideSue@github.com
+ * @LastEditTime: 2026-10-18 22:14:07
+ * @FilePath: /tinystl/thread_pool.h
+ * @Description: 给并行算法用的小线程池，每个线程一个任务队列，自己的队列空了去别人队列的另一头偷
+ *               parallel_for的调用线程也干活，任务按编号连续地分给各个队列，同一段数据尽量由同一个线程处理
+ *
+ * Copyright (c) 2023 by ${suzy HideSue@github.com}, All Rights Reserved.
+ */
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include<atomic>
+#include<condition_variable>
+#include<cstddef>
+#include<deque>
+#include<exception>
+#include<memory>
+#include<mutex>
+#include<thread>
+#include<vector>
+
+#ifndef TINYSTL_PARALLEL_THREADS
+#define TINYSTL_PARALLEL_THREADS 0      // 默认线程池的工作线程数，0表示按核数，调用线程自己也算一个
+#endif
+
+namespace tinystl
+{
+    class thread_pool {
+        public:
+            typedef void (*task_fn) (void *ctx, size_t index);
+        private:
+            /**
+             * @description: 一次parallel_for的共享状态，第一个抛出的异常存起来，等所有任务结束后在调用线程重新抛出
+             */
+            struct task_group {
+                std::atomic<size_t> pending;
+                std::mutex lock;
+                std::condition_variable done;
+                std::exception_ptr error;
+            };
+            struct task {
+                task_fn fn;
+                void *ctx;
+                size_t index;
+                task_group *group;
+            };
+            struct task_queue {
+                std::mutex lock;
+                std::deque<task> tasks;
+            };
+        private:
+            std::vector<std::thread> workers;
+            std::unique_ptr<task_queue[]> queues;   // workers.size() + 1个，最后一个属于外面调用parallel_for的线程
+            size_t nqueues;
+            std::atomic<size_t> queued;             // 还在队列里没被拿走的任务数
+            std::mutex idle_lock;
+            std::condition_variable idle;
+            bool stopping;
+        private:
+            /**
+             * @description: 先从自己队列的尾部拿（刚放进去的，还在cache里），没有时从其他队列的头部偷
+             * @param {size_t} self
+             * @return {*} 有没有执行到任务
+             */
+            bool run_one (size_t self);
+            static void execute (const task &t);
+            void worker_loop (size_t self);
+        public:
+            /**
+             * @description: 起threads个工作线程，0个时所有任务都在调用线程上跑
+             * @param {size_t} threads
+             * @return {*}
+             */
+            explicit thread_pool (size_t threads);
+            ~thread_pool ();
+            thread_pool (const thread_pool &) = delete;
+            thread_pool &operator= (const thread_pool &) = delete;
+
+            /**
+             * @description: 进程里共用的线程池，第一次用时创建，工作线程数是TINYSTL_PARALLEL_THREADS或者核数减一
+             * @return {*}
+             */
+            static thread_pool &instance ();
+            /**
+             * @description: 能同时跑的线程数，包括调用线程
+             * @return {*}
+             */
+            size_t concurrency () const { return workers.size() + 1; }
+            /**
+             * @description: 对[0, count)的每个i执行fn(ctx, i)，全部结束后返回；调用线程也执行任务
+             *               编号连续的一段分给同一个队列，有任务抛异常时其他任务照常跑完，然后重新抛出第一个异常
+             * @param {size_t} count
+             * @param {task_fn} fn
+             * @param {void} *ctx
+             * @return {*}
+             */
+            void parallel_for (size_t count, task_fn fn, void *ctx);
+    };
+
+    inline thread_pool::thread_pool (size_t threads) : queues(new task_queue[threads + 1]), nqueues(threads + 1), queued(0), stopping(false) {
+        workers.reserve(threads);
+        for (size_t i = 0; i < threads; i++) {
+            workers.emplace_back(&thread_pool::worker_loop, this, i);
+        }
+    }
+
+    inline thread_pool::~thread_pool () {
+        {
+            std::lock_guard<std::mutex> guard(idle_lock);
+            stopping = true;
+        }
+        idle.notify_all();
+        for (std::thread &t : workers) {
+            t.join();
+        }
+    }
+
+    inline thread_pool &thread_pool::instance () {
+        static thread_pool pool([] {
+            size_t n = TINYSTL_PARALLEL_THREADS;
+            if (n == 0) {
+                unsigned hw = std::thread::hardware_concurrency();
+                n = hw > 1 ? hw - 1 : 0;
+            }
+            return n;
+        }());
+        return pool;
+    }
+
+    inline void thread_pool::execute (const task &t) {
+        task_group *g = t.group;
+        std::exception_ptr error;
+        try {
+            t.fn(t.ctx, t.index);
+        } catch (...) {
+            error = std::current_exception();
+        }
+        // 在锁里减计数，parallel_for看到0以后拿到锁时这里已经不再碰group
+        std::lock_guard<std::mutex> guard(g->lock);
+        if (error && !g->error) {
+            g->error = error;
+        }
+        if (g->pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            g->done.notify_all();
+        }
+    }
+
+    inline bool thread_pool::run_one (size_t self) {
+        task t;
+        bool found = false;
+        {
+            task_queue &q = queues[self];
+            std::lock_guard<std::mutex> guard(q.lock);
+            if (!q.tasks.empty()) {
+                t = q.tasks.back();
+                q.tasks.pop_back();
+                found = true;
+            }
+        }
+        for (size_t k = 1; !found && k < nqueues; k++) {
+            task_queue &q = queues[(self + k) % nqueues];
+            std::lock_guard<std::mutex> guard(q.lock);
+            if (!q.tasks.empty()) {
+                t = q.tasks.front();
+                q.tasks.pop_front();
+                found = true;
+            }
+        }
+        if (!found) {
+            return false;
+        }
+        queued.fetch_sub(1, std::memory_order_relaxed);
+        execute(t);
+        return true;
+    }
+
+    inline void thread_pool::worker_loop (size_t self) {
+        for (;;) {
+            if (run_one(self)) {
+                continue;
+            }
+            std::unique_lock<std::mutex> guard(idle_lock);
+            idle.wait(guard, [this] { return stopping || queued.load(std::memory_order_relaxed) > 0; });
+            if (stopping) {
+                return;
+            }
+        }
+    }
+
+    inline void thread_pool::parallel_for (size_t count, task_fn fn, void *ctx) {
+        if (count == 0) {
+            return;
+        }
+        task_group group;
+        group.pending.store(count, std::memory_order_relaxed);
+        // 第i个任务放进第i * nqueues / count个队列，每个线程拿到连续的一段
+        for (size_t i = 0; i < count; i++) {
+            task_queue &q = queues[i * nqueues / count];
+            std::lock_guard<std::mutex> guard(q.lock);
+            q.tasks.push_back(task{fn, ctx, i, &group});
+        }
+        {
+            std::lock_guard<std::mutex> guard(idle_lock);
+            queued.fetch_add(count, std::memory_order_relaxed);
+        }
+        idle.notify_all();
+        // 调用线程从最后一个队列开始干，没得偷了就等别的线程把手上的做完
+        while (group.pending.load(std::memory_order_acquire) > 0) {
+            if (!run_one(nqueues - 1)) {
+                std::unique_lock<std::mutex> guard(group.lock);
+                group.done.wait(guard, [&group] { return group.pending.load(std::memory_order_acquire) == 0; });
+            }
+        }
+        // 最后一个任务通知完才释放锁，拿一下锁保证group析构时没人还在用它
+        std::unique_lock<std::mutex> guard(group.lock);
+        guard.unlock();
+        if (group.error) {
+            std::rethrow_exception(group.error);
+        }
+    }
+} // namespace tinystl
+
+#endif
@@ -2,7 +2,7 @@
  * @Author: suzy HideSue@github.com
  * @Date: 2023-11-24 16:58:03
  * @LastEditors: suzy HideSue@github.com
- * @LastEditTime: 2023-11-25 19:05:22
+ * @LastEditTime: 2026-10-18 19:41:05
  * @FilePath: /tinystl/type_traits.h
  * @Description: 
  * 
@@ -12,6 +12,7 @@
 #define TYPE_TRAITS_H
 
 #include <cstddef>
+#include <type_traits>
 
 namespace tinystl
 {
@@ -65,17 +66,44 @@ namespace tinystl
     }
 
     // 类型萃取
-    struct true_type {};
-    struct false_type {};
-
+    // 直接用标准库的标签，既能做重载的标签分派，也有::value可以在if constexpr里用
+    typedef std::true_type true_type;
+    typedef std::false_type false_type;
+
+    template<bool B>
+    using bool_constant = std::integral_constant<bool, B>;
+
+    /**
+     * @description: 默认从编译器的trivial判断推出来，聚合体、枚举这类不用手写特化也能走快速路径
+     *               is_POD_type表示拷贝构造、赋值、析构都是trivial，可以用赋值或memcpy代替构造
+     *               想手动打开（比如is_trivially_relocatable）或关掉某个快速路径时仍然可以特化
+     */
     template<class type>
     struct type_traits {
         typedef true_type this_dummy_member_must_be_first;
-        typedef false_type has_trivial_default_constructor;
-        typedef false_type has_trivial_copy_constructor;
-        typedef false_type has_trivial_assignment_constructor;
-        typedef false_type has_trivial_destructor;
-        typedef false_type is_POD_type;
+        typedef bool_constant<std::is_trivially_default_constructible<type>::value> has_trivial_default_constructor;
+        typedef bool_constant<std::is_trivially_copy_constructible<type>::value> has_trivial_copy_constructor;
+        typedef bool_constant<std::is_trivially_copy_assignable<type>::value> has_trivial_assignment_constructor;
+        typedef bool_constant<std::is_trivially_destructible<type>::value> has_trivial_destructor;
+        typedef bool_constant<std::is_trivially_copyable<type>::value
+                              && std::is_trivially_copy_constructible<type>::value
+                              && std::is_trivially_copy_assignable<type>::value
+                              && std::is_trivially_destructible<type>::value> is_POD_type;
+        // 可以直接按字节搬到新地址、旧对象不用析构
+        typedef bool_constant<std::is_trivially_copyable<type>::value> is_trivially_relocatable;
+    };
+
+    /**
+     * @description: 数组和它的元素一样，连续的数组区间可以整段memcpy、跳过析构
+     */
+    template<class T, size_t N>
+    struct type_traits<T[N]> {
+        typedef typename type_traits<T>::has_trivial_default_constructor has_trivial_default_constructor;
+        typedef typename type_traits<T>::has_trivial_copy_constructor has_trivial_copy_constructor;
+        typedef typename type_traits<T>::has_trivial_assignment_constructor has_trivial_assignment_constructor;
+        typedef typename type_traits<T>::has_trivial_destructor has_trivial_destructor;
+        typedef typename type_traits<T>::is_POD_type is_POD_type;
+        typedef typename type_traits<T>::is_trivially_relocatable is_trivially_relocatable;
     };
 
     template<>
@@ -85,6 +113,7 @@ namespace tinystl
         typedef true_type has_trivial_assignment_constructor;
         typedef true_type has_trivial_destructor;
         typedef true_type is_POD_type;
+        typedef true_type is_trivially_relocatable;
     };
 
     template<>
@@ -94,6 +123,7 @@ namespace tinystl
         typedef true_type has_trivial_assignment_constructor;
         typedef true_type has_trivial_destructor;
         typedef true_type is_POD_type;
+        typedef true_type is_trivially_relocatable;
     };
 
     template<>
@@ -103,6 +133,7 @@ namespace tinystl
         typedef true_type has_trivial_assignment_constructor;
         typedef true_type has_trivial_destructor;
         typedef true_type is_POD_type;
+        typedef true_type is_trivially_relocatable;
     };
 
     template<>
@@ -112,6 +143,7 @@ namespace tinystl
         typedef true_type has_trivial_assignment_constructor;
         typedef true_type has_trivial_destructor;
         typedef true_type is_POD_type;
+        typedef true_type is_trivially_relocatable;
     };
 
     template<>
@@ -121,6 +153,7 @@ namespace tinystl
         typedef true_type has_trivial_assignment_constructor;
         typedef true_type has_trivial_destructor;
         typedef true_type is_POD_type;
+        typedef true_type is_trivially_relocatable;
     };
 
     template<>
@@ -130,6 +163,7 @@ namespace tinystl
         typedef true_type has_trivial_assignment_constructor;
         typedef true_type has_trivial_destructor;
         typedef true_type is_POD_type;
+        typedef true_type is_trivially_relocatable;
     };
 
     template<>
@@ -139,6 +173,7 @@ namespace tinystl
         typedef true_type has_trivial_assignment_constructor;
         typedef true_type has_trivial_destructor;
         typedef true_type is_POD_type;
+        typedef true_type is_trivially_relocatable;
     };
 
     template<>
@@ -148,6 +183,7 @@ namespace tinystl
         typedef true_type has_trivial_assignment_constructor;
         typedef true_type has_trivial_destructor;
         typedef true_type is_POD_type;
+        typedef true_type is_trivially_relocatable;
     };
 
     template<>
@@ -157,6 +193,7 @@ namespace tinystl
         typedef true_type has_trivial_assignment_constructor;
         typedef true_type has_trivial_destructor;
         typedef true_type is_POD_type;
+        typedef true_type is_trivially_relocatable;
     };
 
     template<>
@@ -166,6 +203,7 @@ namespace tinystl
         typedef true_type has_trivial_assignment_constructor;
         typedef true_type has_trivial_destructor;
         typedef true_type is_POD_type;
+        typedef true_type is_trivially_relocatable;
     };
 
     template<>
@@ -175,6 +213,7 @@ namespace tinystl
         typedef true_type has_trivial_assignment_constructor;
         typedef true_type has_trivial_destructor;
         typedef true_type is_POD_type;
+        typedef true_type is_trivially_relocatable;
     };
 
     template<>
@@ -184,6 +223,7 @@ namespace tinystl
         typedef true_type has_trivial_assignment_constructor;
         typedef true_type has_trivial_destructor;
         typedef true_type is_POD_type;
+        typedef true_type is_trivially_relocatable;
     };
 
     template<class T>
@@ -193,6 +233,7 @@ namespace tinystl
         typedef true_type has_trivial_assignment_constructor;
         typedef true_type has_trivial_destructor;
         typedef true_type is_POD_type;
+        typedef true_type is_trivially_relocatable;
     };
 } // namespace tinystl
 
@@ -2,7 +2,7 @@
  * @Author: suzy HideSue@github.com
  * @Date: 2023-11-24 16:50:20
  * @LastEditors: suzy HideSue@github.com
- * @LastEditTime: 2023-11-25 19:47:18
+ * @LastEditTime: 2026-10-18 19:41:05
  * @FilePath: /tinystl/uninitialized.h
  * @Description: 全局函数，对容器进行初始化
  * 
@@ -11,15 +11,16 @@
 #ifndef UNINITIALIZED_H
 #define UNINITIALIZED_H
 
+#include<utility>
 #include "type_traits.h"
 #include "construct.h"
+#include "memory_ops.h"
 
 namespace tinystl
 {
 
     template<class InputIterator, class ForwardIterator>
     ForwardIterator __uninitialized_copy_aux (InputIterator first, InputIterator last, ForwardIterator result, true_type) {
-        // todo 这里应该用copy算法，从底层复制
         ForwardIterator cur = result;
         for (; first != last; ++first, ++cur) {
             *cur = *first;
@@ -27,11 +28,37 @@ namespace tinystl
         return cur;
     }
 
+    /**
+     * @description: 源和目标都是同一种POD类型的原生指针，内存是连续的，整段按字节搬过去
+     * @param {T} *first
+     * @param {T} *last
+     * @param {T} *result
+     * @return {*}
+     */
+    template<class T>
+    T *__uninitialized_copy_aux (const T *first, const T *last, T *result, true_type) {
+        size_t n = last - first;
+        if (n != 0) {
+            __memory_copy(result, first, n * sizeof(T));
+        }
+        return result + n;
+    }
+
+    template<class T>
+    T *__uninitialized_copy_aux (T *first, T *last, T *result, true_type) {
+        return __uninitialized_copy_aux((const T *) first, (const T *) last, result, true_type());
+    }
+
     template<class InputIterator, class ForwardIterator>
     ForwardIterator __uninitialized_copy_aux (InputIterator first, InputIterator last, ForwardIterator result, false_type) {
         ForwardIterator cur = result;
-        for (; first != last; ++first, ++cur) {
-            construct(&*cur, *first);
+        try {
+            for (; first != last; ++first, ++cur) {
+                construct(&*cur, *first);
+            }
+        } catch (...) {
+            tinystl::destroy(result, cur);
+            throw;
         }
         return cur;
     }
@@ -44,24 +71,247 @@ namespace tinystl
 
     template<class InputIterator, class ForwardIterator>
     ForwardIterator uninitialized_copy (InputIterator first, InputIterator last, ForwardIterator result) {
-        __uninitialized_copy(first, last, result, value_type(result));
+        return __uninitialized_copy(first, last, result, value_type(result));
+    }
+
+    /**
+     * @description: 非POD逐个移动构造，源对象还在，由调用者析构；中途抛异常时析构已经构造好的
+     * @param {InputIterator} first
+     * @param {InputIterator} last
+     * @param {ForwardIterator} result
+     * @return {*}
+     */
+    template<class InputIterator, class ForwardIterator>
+    ForwardIterator __uninitialized_move_aux (InputIterator first, InputIterator last, ForwardIterator result, false_type) {
+        ForwardIterator cur = result;
+        try {
+            for (; first != last; ++first, ++cur) {
+                construct(&*cur, std::move(*first));
+            }
+        } catch (...) {
+            tinystl::destroy(result, cur);
+            throw;
+        }
+        return cur;
+    }
+
+    // POD的移动就是复制
+    template<class InputIterator, class ForwardIterator>
+    ForwardIterator __uninitialized_move_aux (InputIterator first, InputIterator last, ForwardIterator result, true_type) {
+        return __uninitialized_copy_aux(first, last, result, true_type());
     }
 
+    template<class InputIterator, class ForwardIterator, class T>
+    ForwardIterator __uninitialized_move (InputIterator first, InputIterator last, ForwardIterator result, T *) {
+        typedef typename type_traits<T>::is_POD_type is_POD;
+        return __uninitialized_move_aux(first, last, result, is_POD());
+    }
+
+    template<class InputIterator, class ForwardIterator>
+    ForwardIterator uninitialized_move (InputIterator first, InputIterator last, ForwardIterator result) {
+        return __uninitialized_move(first, last, result, value_type(result));
+    }
+
+    template<class InputIterator, class Size, class ForwardIterator>
+    ForwardIterator __uninitialized_move_n_aux (InputIterator first, Size n, ForwardIterator result, false_type) {
+        ForwardIterator cur = result;
+        try {
+            for (; n > 0; --n, ++first, ++cur) {
+                construct(&*cur, std::move(*first));
+            }
+        } catch (...) {
+            tinystl::destroy(result, cur);
+            throw;
+        }
+        return cur;
+    }
+
+    template<class InputIterator, class Size, class ForwardIterator>
+    ForwardIterator __uninitialized_move_n_aux (InputIterator first, Size n, ForwardIterator result, true_type) {
+        ForwardIterator cur = result;
+        for (; n > 0; --n, ++first, ++cur) {
+            *cur = *first;
+        }
+        return cur;
+    }
+
+    template<class T, class Size>
+    T *__uninitialized_move_n_aux (T *first, Size n, T *result, true_type) {
+        return n > 0 ? __uninitialized_copy_aux(first, first + n, result, true_type()) : result;
+    }
+
+    template<class InputIterator, class Size, class ForwardIterator, class T>
+    ForwardIterator __uninitialized_move_n (InputIterator first, Size n, ForwardIterator result, T *) {
+        typedef typename type_traits<T>::is_POD_type is_POD;
+        return __uninitialized_move_n_aux(first, n, result, is_POD());
+    }
+
+    /**
+     * @description: 从first开始移动n个元素到result，返回result的结束位置
+     * @param {InputIterator} first
+     * @param {Size} n
+     * @param {ForwardIterator} result
+     * @return {*}
+     */
+    template<class InputIterator, class Size, class ForwardIterator>
+    ForwardIterator uninitialized_move_n (InputIterator first, Size n, ForwardIterator result) {
+        return __uninitialized_move_n(first, n, result, value_type(result));
+    }
+
+    /**
+     * @description: 先全部构造过去再析构源对象，用move_if_noexcept：移动构造不抛异常时移动，会抛并且能复制时复制，
+     *               所以中途抛异常时已经构造的目标对象析构掉，源区间原样不动（强异常保证）；
+     *               移动会抛又不能复制的类型只能照样移动，抛异常时源区间里已经移走的对象处于移动后的状态
+     * @param {ForwardIterator1} first
+     * @param {ForwardIterator1} last
+     * @param {ForwardIterator2} result
+     * @return {*}
+     */
+    template<class ForwardIterator1, class ForwardIterator2>
+    ForwardIterator2 __uninitialized_relocate_aux (ForwardIterator1 first, ForwardIterator1 last, ForwardIterator2 result, false_type) {
+        ForwardIterator2 cur = result;
+        try {
+            for (ForwardIterator1 p = first; p != last; ++p, ++cur) {
+                construct(&*cur, std::move_if_noexcept(*p));
+            }
+        } catch (...) {
+            tinystl::destroy(result, cur);
+            throw;
+        }
+        tinystl::destroy(first, last);
+        return cur;
+    }
+
+    template<class ForwardIterator1, class ForwardIterator2>
+    ForwardIterator2 __uninitialized_relocate_aux (ForwardIterator1 first, ForwardIterator1 last, ForwardIterator2 result, true_type) {
+        return __uninitialized_relocate_aux(first, last, result, false_type());
+    }
+
+    /**
+     * @description: 标记了is_trivially_relocatable的类型，连续内存整段按字节搬走，源对象当作已经不存在，不调析构
+     * @param {T} *first
+     * @param {T} *last
+     * @param {T} *result
+     * @return {*}
+     */
+    template<class T>
+    T *__uninitialized_relocate_aux (T *first, T *last, T *result, true_type) {
+        size_t n = last - first;
+        if (n != 0) {
+            __memory_copy((void *) result, (const void *) first, n * sizeof(T));
+        }
+        return result + n;
+    }
+
+    template<class ForwardIterator1, class ForwardIterator2, class T>
+    ForwardIterator2 __uninitialized_relocate (ForwardIterator1 first, ForwardIterator1 last, ForwardIterator2 result, T *) {
+        typedef typename type_traits<T>::is_trivially_relocatable is_relocatable;
+        return __uninitialized_relocate_aux(first, last, result, is_relocatable());
+    }
+
+    /**
+     * @description: 把[first, last)的对象搬到result开始的未初始化内存，搬完后源区间变回未初始化内存
+     *               容器扩容时用它把旧缓冲区的元素挪到新缓冲区
+     * @param {ForwardIterator1} first
+     * @param {ForwardIterator1} last
+     * @param {ForwardIterator2} result
+     * @return {*}
+     */
+    template<class ForwardIterator1, class ForwardIterator2>
+    ForwardIterator2 uninitialized_relocate (ForwardIterator1 first, ForwardIterator1 last, ForwardIterator2 result) {
+        return __uninitialized_relocate(first, last, result, value_type(result));
+    }
+
+    /**
+     * @description: 原生指针、元素是POD时的填充，元素大小能整除32时按字节模式批量写，否则逐个复制
+     *               太短的区间直接赋值，省掉铺模式的开销
+     * @param {T} *first
+     * @param {size_t} n
+     * @param {T} &x
+     * @return {*}
+     */
+    template<class T>
+    T *__fill_pod (T *first, size_t n, const T &x) {
+        if constexpr (32 % sizeof(T) == 0) {
+            if (n * sizeof(T) >= 64) {
+                __memory_fill(first, &x, sizeof(T), n);
+                return first + n;
+            }
+        }
+        // 用memcpy而不是赋值，数组、有const成员这种不能赋值的trivially copyable类型也能用
+        for (; n > 0; --n, ++first) {
+            memcpy((void *) first, (const void *) &x, sizeof(T));
+        }
+        return first;
+    }
+
+    template<class ForwardIterator, class T>
+    void __uninitialized_fill_aux (ForwardIterator first, ForwardIterator last, const T &x, true_type) {
+        for (; first != last; ++first) {
+            *first = x;
+        }
+    }
+
+    template<class T>
+    void __uninitialized_fill_aux (T *first, T *last, const T &x, true_type) {
+        __fill_pod(first, last - first, x);
+    }
+
+    /**
+     * @description: 逐个构造，中途构造抛异常时把已经构造好的析构掉再抛出去，要么全成功要么什么都没做
+     * @param {ForwardIterator} first
+     * @param {ForwardIterator} last
+     * @param {T} &x
+     * @return {*}
+     */
     template<class ForwardIterator, class T>
-    void uninitialized_fill (ForwardIterator first, ForwardIterator last, const T &result) {
+    void __uninitialized_fill_aux (ForwardIterator first, ForwardIterator last, const T &x, false_type) {
+        ForwardIterator cur = first;
+        try {
+            for (; cur != last; ++cur) {
+                construct(&*cur, x);
+            }
+        } catch (...) {
+            tinystl::destroy(first, cur);
+            throw;
+        }
+    }
 
+    template<class ForwardIterator, class T, class T1>
+    void __uninitialized_fill (ForwardIterator first, ForwardIterator last, const T &x, T1 *) {
+        typedef typename type_traits<T1>::is_POD_type is_POD;
+        __uninitialized_fill_aux(first, last, x, is_POD());
+    }
+
+    template<class ForwardIterator, class T>
+    void uninitialized_fill (ForwardIterator first, ForwardIterator last, const T &x) {
+        __uninitialized_fill(first, last, x, value_type(first));
     }
 
     template<class ForwardIterator, class Size, class T>
     ForwardIterator __uninitialized_fill_n_aux (ForwardIterator first, Size n, const T &x, true_type) {
-        // todo
+        ForwardIterator cur = first;
+        for (; n > 0; --n, ++cur) {
+            *cur = x;
+        }
+        return cur;
+    }
+
+    template<class T, class Size>
+    T *__uninitialized_fill_n_aux (T *first, Size n, const T &x, true_type) {
+        return n > 0 ? __fill_pod(first, (size_t) n, x) : first;
     }
 
     template<class ForwardIterator, class Size, class T>
     ForwardIterator __uninitialized_fill_n_aux (ForwardIterator first, Size n, const T &x, false_type) {
         ForwardIterator cur = first;
-        for (; n > 0; --n, ++cur) {
-            construct(&*cur, x);
+        try {
+            for (; n > 0; --n, ++cur) {
+                construct(&*cur, x);
+            }
+        } catch (...) {
+            tinystl::destroy(first, cur);
+            throw;
         }
         return cur;
     }